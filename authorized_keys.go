@@ -0,0 +1,211 @@
+// Parse authorized_keys files and serialize them
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"sort"
+	"strings"
+)
+
+// Version written in SerializeAuthorizedKeys()
+const AuthorizedKeysVersion = 1
+
+type AuthorizedKeys struct {
+	Name string
+	Keys []string // lines in sshd's authorized_keys format
+}
+
+// ParseAuthorizedKeys parses a file with lines in the format "user:key"
+// (where key is a line in sshd's authorized_keys format) and returns all
+// entries as slice of AuthorizedKeys structs. Multiple lines for the same
+// user are merged into one entry, keeping the order of the keys.
+func ParseAuthorizedKeys(r io.Reader) ([]AuthorizedKeys, error) {
+	var res []AuthorizedKeys
+	users := make(map[string]int) // index in res
+
+	s := bufio.NewReader(r)
+	for {
+		t, err := s.ReadString('\n')
+		if err != nil {
+			if err == io.EOF {
+				if t != "" {
+					return nil, fmt.Errorf(
+						"no newline in last line: %q",
+						t)
+				}
+				break
+			}
+			return nil, err
+		}
+
+		x := strings.SplitN(t, ":", 2)
+		if len(x) != 2 || x[0] == "" {
+			return nil, fmt.Errorf("invalid line %q", t)
+		}
+		// ReadString() contains the delimiter
+		key := strings.TrimSuffix(x[1], "\n")
+		if key == "" {
+			return nil, fmt.Errorf("invalid line %q", t)
+		}
+
+		i, ok := users[x[0]]
+		if !ok {
+			i = len(res)
+			users[x[0]] = i
+			res = append(res, AuthorizedKeys{
+				Name: x[0],
+			})
+		}
+		res[i].Keys = append(res[i].Keys, key)
+	}
+
+	return res, nil
+}
+
+func SerializeAuthorizedKey(a AuthorizedKeys) ([]byte, error) {
+	// Concatenate the NUL-terminated name and the keys (one per line) as
+	// single NUL-terminated string which can be written directly
+	var data bytes.Buffer
+	data.Write([]byte(a.Name))
+	data.WriteByte(0)
+	offKeys := data.Len()
+	for _, k := range a.Keys {
+		data.Write([]byte(k))
+		data.WriteByte('\n')
+	}
+	data.WriteByte(0)
+	// Ensure the offsets can fit the length of this entry
+	if uint64(data.Len()) > math.MaxUint32 {
+		return nil, fmt.Errorf("authorized_keys too large to "+
+			"serialize: %v, %v", data.Len(), a.Name)
+	}
+	size := uint32(data.Len())
+
+	var res bytes.Buffer // serialized result
+	le := binary.LittleEndian
+
+	off := make([]byte, 4)
+	// off_keys
+	le.PutUint32(off, uint32(offKeys))
+	res.Write(off)
+	// data_size
+	le.PutUint32(off, size)
+	res.Write(off)
+
+	res.Write(data.Bytes())
+	// Pad each entry so that all uint32 at the beginning of the struct are
+	// aligned; use 8 bytes like the other types
+	alignBufferTo(&res, 8)
+
+	return res.Bytes(), nil
+}
+
+func SerializeAuthorizedKeys(w io.Writer, aks []AuthorizedKeys) error {
+	// Serialize authorized_keys and store offsets; ParseAuthorizedKeys()
+	// merges duplicate users so the name is unique
+	var data bytes.Buffer
+	offsets := make(map[string]uint64)
+	for _, a := range aks {
+		offsets[a.Name] = uint64(data.Len())
+		x, err := SerializeAuthorizedKey(a)
+		if err != nil {
+			return err
+		}
+		data.Write(x)
+	}
+
+	// Copy to prevent sorting from modifying the argument
+	sorted := make([]AuthorizedKeys, len(aks))
+	copy(sorted, aks)
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	// Create index "sorted" in input order, used when iterating over all
+	// entries; keeping the original order makes debugging easier
+	var indexOrig bytes.Buffer
+	for _, a := range aks {
+		le.PutUint64(tmp, offsets[a.Name])
+		indexOrig.Write(tmp)
+	}
+
+	// There are no ids, the id index is empty
+
+	// Create index sorted after name
+	var indexName bytes.Buffer
+	sort.Slice(sorted, func(i, j int) bool {
+		return sorted[i].Name < sorted[j].Name
+	})
+	for _, a := range sorted {
+		le.PutUint64(tmp, offsets[a.Name])
+		indexName.Write(tmp)
+	}
+
+	// Sanity check
+	if len(aks)*8 != indexOrig.Len() ||
+		indexOrig.Len() != indexName.Len() {
+		return fmt.Errorf("indexes have inconsistent length")
+	}
+
+	// Write result
+
+	// magic
+	w.Write([]byte("NSS-CASH"))
+	// version
+	le.PutUint64(tmp, AuthorizedKeysVersion)
+	w.Write(tmp)
+	// count
+	le.PutUint64(tmp, uint64(len(aks)))
+	w.Write(tmp)
+	// off_orig_index
+	offset := uint64(0)
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_id_index
+	offset += uint64(indexOrig.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_name_index (id index is empty)
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_data
+	offset += uint64(indexName.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+
+	_, err := indexOrig.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = indexName.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = data.WriteTo(w)
+	if err != nil {
+		return err
+	}
+
+	return nil
+}
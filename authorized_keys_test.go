@@ -0,0 +1,90 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"fmt"
+	"reflect"
+	"strings"
+	"testing"
+)
+
+func TestParseAuthorizedKeys(t *testing.T) {
+	tests := []struct {
+		data string
+		exp  []AuthorizedKeys
+		err  error
+	}{
+		{
+			"",
+			nil,
+			nil,
+		},
+		{
+			"root:ssh-ed25519 AAAA",
+			nil,
+			fmt.Errorf("no newline in last line: \"root:ssh-ed25519 AAAA\""),
+		},
+		{
+			"root\n",
+			nil,
+			fmt.Errorf("invalid line \"root\\n\""),
+		},
+		{
+			":ssh-ed25519 AAAA\n",
+			nil,
+			fmt.Errorf("invalid line \":ssh-ed25519 AAAA\\n\""),
+		},
+		{
+			"root:\n",
+			nil,
+			fmt.Errorf("invalid line \"root:\\n\""),
+		},
+		{
+			"root:ssh-ed25519 AAAA root@host\n" +
+				"user:command=\"a:b\" ssh-rsa BBBB\n" +
+				"root:ssh-rsa CCCC\n",
+			[]AuthorizedKeys{
+				AuthorizedKeys{
+					Name: "root",
+					Keys: []string{
+						"ssh-ed25519 AAAA root@host",
+						"ssh-rsa CCCC",
+					},
+				},
+				AuthorizedKeys{
+					Name: "user",
+					Keys: []string{
+						"command=\"a:b\" ssh-rsa BBBB",
+					},
+				},
+			},
+			nil,
+		},
+	}
+
+	for n, tc := range tests {
+		res, err := ParseAuthorizedKeys(strings.NewReader(tc.data))
+		if !reflect.DeepEqual(err, tc.err) {
+			t.Errorf("%d: err = %v, want %v",
+				n, err, tc.err)
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %v, want %v",
+				n, res, tc.exp)
+		}
+	}
+}
@@ -0,0 +1,139 @@
+// Combine passwd and group files into a single file
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io/ioutil"
+	"log"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+// Section types, see nss/file.h
+const (
+	SectionPasswd uint32 = 1
+	SectionGroup  uint32 = 2
+)
+
+// SerializeCombined stores the serialized passwd and group files in a single
+// file (FeatureCombined) so the NSS module has to map only one file and both
+// are always updated together.
+func SerializeCombined(passwd, group []byte) ([]byte, error) {
+	for _, x := range [][]byte{passwd, group} {
+		// Verifies the file is a normal (e.g. not sharded) file
+		_, err := reader.New(x)
+		if err != nil {
+			return nil, err
+		}
+	}
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	// Empty file without entries, only the sections are used
+	var x bytes.Buffer
+	// magic
+	x.Write([]byte("NSS-CASH"))
+	// version
+	le.PutUint64(tmp, 1|FeatureCombined)
+	x.Write(tmp)
+	// count, off_orig_index, off_id_index, off_name_index, off_data
+	le.PutUint64(tmp, 0)
+	for i := 0; i < 5; i++ {
+		x.Write(tmp)
+	}
+
+	return AddSections(x.Bytes(), []Section{
+		{
+			Type:  SectionPasswd,
+			Flags: SectionRequired,
+			Data:  passwd,
+		},
+		{
+			Type:  SectionGroup,
+			Flags: SectionRequired,
+			Data:  group,
+		},
+	})
+}
+
+// deployCombined writes the combined file if its content has changed. The
+// passwd and group files are read from disk if they were not updated.
+func deployCombined(cfg *Config) error {
+	var bodies [2][]byte
+	var warm bool
+	for _, f := range cfg.Files {
+		i := 0
+		if f.Type == FileTypeGroup {
+			i = 1
+		} else if f.Type != FileTypePasswd {
+			continue
+		}
+		// Warm the combined file if one of its parts is warmed
+		warm = warm || f.Warm
+
+		x := f.body
+		if x == nil {
+			var err error
+			x, err = ioutil.ReadFile(f.Path)
+			if err != nil {
+				return err
+			}
+		}
+		bodies[i] = x
+	}
+	if bodies[0] == nil || bodies[1] == nil {
+		return fmt.Errorf("combinedpath requires passwd and group files")
+	}
+
+	x, err := SerializeCombined(bodies[0], bodies[1])
+	if err != nil {
+		return err
+	}
+	old, err := ioutil.ReadFile(cfg.CombinedPath)
+	if err == nil && bytes.Equal(old, x) {
+		log.Printf("%q: not modified", cfg.CombinedPath)
+		return nil
+	}
+	return deployFile(&File{
+		Type: FileTypePlain,
+		Url:  "passwd+group",
+		Path: cfg.CombinedPath,
+		Warm: warm,
+		body: x,
+	})
+}
+
+func mainCombine(passwdPath, groupPath, dstPath string) error {
+	passwd, err := ioutil.ReadFile(passwdPath)
+	if err != nil {
+		return err
+	}
+	group, err := ioutil.ReadFile(groupPath)
+	if err != nil {
+		return err
+	}
+	x, err := SerializeCombined(passwd, group)
+	if err != nil {
+		return err
+	}
+	return convertWrite(FileTypePlain, passwdPath, dstPath, x)
+}
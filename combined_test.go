@@ -0,0 +1,86 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func TestSerializeCombined(t *testing.T) {
+	var passwd, group, sharded bytes.Buffer
+	err := SerializePasswds(&passwd, []Passwd{
+		{Name: "root", Passwd: "x", Uid: 0, Gid: 0},
+	}, SerializeOptions{Compact: true})
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = SerializeGroups(&group, []Group{
+		{Name: "root", Passwd: "x", Gid: 0, Members: []string{"a"}},
+	}, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	_, err = SerializeGroupShards(&sharded, []Group{
+		{Name: "root", Passwd: "x", Gid: 0},
+	}, 2, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	x, err := SerializeCombined(passwd.Bytes(), group.Bytes())
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// Combined files are not normal files
+	_, err = reader.New(x)
+	mustBeErrorWithSubstring(t, err, "unsupported version")
+
+	le := binary.LittleEndian
+	if le.Uint64(x[8:]) != SectionVersion|FeatureCombined {
+		t.Errorf("invalid version %#x", le.Uint64(x[8:]))
+	}
+	if le.Uint64(x[56:]) != 2 {
+		t.Fatalf("invalid section count %d", le.Uint64(x[56:]))
+	}
+	for i, exp := range [][]byte{passwd.Bytes(), group.Bytes()} {
+		s := x[64+i*sectionSize:]
+		typ := le.Uint32(s)
+		flags := le.Uint32(s[4:])
+		off := le.Uint64(s[8:])
+		length := le.Uint64(s[16:])
+		if typ != uint32(i+1) || flags != SectionRequired {
+			t.Errorf("%d: invalid type/flags %d %d", i, typ, flags)
+		}
+		if off%8 != 0 {
+			t.Errorf("%d: unaligned offset %d", i, off)
+		}
+		res := x[headerSize+off : headerSize+off+length]
+		if !bytes.Equal(res, exp) {
+			t.Errorf("%d: got %q, want %q", i, res, exp)
+		}
+	}
+
+	// Only normal files can be combined
+	_, err = SerializeCombined(passwd.Bytes(), sharded.Bytes())
+	mustBeErrorWithSubstring(t, err, "unsupported version")
+	_, err = SerializeCombined(nil, group.Bytes())
+	mustBeErrorWithSubstring(t, err, "invalid magic")
+}
@@ -25,8 +25,10 @@ import (
 )
 
 type Config struct {
-	StatePath string
-	Files     []File `toml:"file"`
+	StatePath    string
+	CombinedPath string
+	MetricsPath  string
+	Files        []File `toml:"file"`
 }
 
 type File struct {
@@ -36,8 +38,25 @@ type File struct {
 	CA       string
 	Username string
 	Password string
-
-	body []byte // internally used by handleFiles()
+	Compact  bool     // use compact format, see SerializeOptions
+	Shards   int      // split into shards, see SerializeOptions
+	Hot      []string // hot entries, see SerializeOptions
+	Counters string   // path of lookup counters, see SerializeOptions
+	Warm     bool     // read indices after deploy, see warmFile()
+
+	// Only for type "group": omit user private groups, see
+	// SerializeOptions
+	ImplicitUPG bool
+
+	// Only for type "table"
+	Columns    []string
+	Index      []string
+	MultiIndex []string
+
+	body    []byte      // internally used by handleFiles()
+	shards  []Shard     // internally used by handleFiles()
+	metrics fileMetrics // internally used by handleFiles()
+	passwds []Passwd    // internally used by handleFiles()
 }
 
 //go:generate stringer -type=FileType
@@ -47,6 +66,10 @@ const (
 	FileTypePlain FileType = iota
 	FileTypePasswd
 	FileTypeGroup
+	FileTypeServices
+	FileTypeProtocols
+	FileTypeAuthorizedKeys
+	FileTypeTable
 )
 
 func (t *FileType) UnmarshalText(text []byte) error {
@@ -57,6 +80,14 @@ func (t *FileType) UnmarshalText(text []byte) error {
 		*t = FileTypePasswd
 	case "group":
 		*t = FileTypeGroup
+	case "services":
+		*t = FileTypeServices
+	case "protocols":
+		*t = FileTypeProtocols
+	case "authorized_keys":
+		*t = FileTypeAuthorizedKeys
+	case "table":
+		*t = FileTypeTable
 	default:
 		return fmt.Errorf("invalid file type %q", text)
 	}
@@ -86,7 +117,20 @@ func LoadConfig(path string) (*Config, error) {
 		return nil, fmt.Errorf("statepath must not be empty")
 	}
 
+	var passwds, groups, upgs int
+	var passwdShards int
 	for i, f := range cfg.Files {
+		if f.Type == FileTypePasswd {
+			passwds++
+			passwdShards = f.Shards
+		} else if f.Type == FileTypeGroup {
+			groups++
+		}
+		if cfg.CombinedPath != "" && f.Shards != 0 {
+			return nil, fmt.Errorf(
+				"file[%d].shards not permitted with "+
+					"combinedpath", i)
+		}
 		if f.Url == "" {
 			return nil, fmt.Errorf(
 				"file[%d].url must not be empty", i)
@@ -95,6 +139,59 @@ func LoadConfig(path string) (*Config, error) {
 			return nil, fmt.Errorf(
 				"file[%d].path must not be empty", i)
 		}
+		if f.Type == FileTypeTable {
+			err := f.TableSchema().Validate()
+			if err != nil {
+				return nil, fmt.Errorf(
+					"file[%d]: invalid table: %v", i, err)
+			}
+		} else if len(f.Columns) != 0 || len(f.Index) != 0 ||
+			len(f.MultiIndex) != 0 {
+			return nil, fmt.Errorf(
+				"file[%d].columns/index/multiindex only "+
+					"permitted for type table", i)
+		}
+		if f.Compact && f.Type != FileTypePasswd &&
+			f.Type != FileTypeGroup {
+			return nil, fmt.Errorf(
+				"file[%d].compact only permitted for type "+
+					"passwd and group", i)
+		}
+		if f.Shards != 0 && f.Type != FileTypePasswd &&
+			f.Type != FileTypeGroup {
+			return nil, fmt.Errorf(
+				"file[%d].shards only permitted for type "+
+					"passwd and group", i)
+		}
+		if len(f.Hot) != 0 && f.Type != FileTypePasswd &&
+			f.Type != FileTypeGroup {
+			return nil, fmt.Errorf(
+				"file[%d].hot only permitted for type "+
+					"passwd and group", i)
+		}
+		if f.Counters != "" && f.Type != FileTypePasswd &&
+			f.Type != FileTypeGroup {
+			return nil, fmt.Errorf(
+				"file[%d].counters only permitted for type "+
+					"passwd and group", i)
+		}
+		if f.ImplicitUPG {
+			upgs++
+			if f.Type != FileTypeGroup {
+				return nil, fmt.Errorf(
+					"file[%d].implicitupg only permitted "+
+						"for type group", i)
+			}
+			if f.Shards != 0 {
+				return nil, fmt.Errorf(
+					"file[%d].implicitupg not permitted "+
+						"with shards", i)
+			}
+		}
+		if f.Shards < 0 {
+			return nil, fmt.Errorf(
+				"file[%d].shards must not be negative", i)
+		}
 		if (f.Username != "" || f.Password != "") && unsafe {
 			return nil, fmt.Errorf(
 				"file[%d].username/passsword in use and "+
@@ -103,5 +200,44 @@ func LoadConfig(path string) (*Config, error) {
 		}
 	}
 
+	if cfg.CombinedPath != "" && (passwds != 1 || groups != 1) {
+		return nil, fmt.Errorf("combinedpath requires exactly one " +
+			"passwd and one group file")
+	}
+
+	if upgs != 0 && (passwds != 1 || passwdShards != 0) {
+		return nil, fmt.Errorf("implicitupg requires exactly one " +
+			"passwd file without shards")
+	}
+	// The NSS module synthesizes the groups only from the passwd file of
+	// the same combined file so both are always of the same update
+	if upgs != 0 && cfg.CombinedPath == "" {
+		return nil, fmt.Errorf("implicitupg requires combinedpath")
+	}
+
 	return &cfg, nil
 }
+
+func (f *File) SerializeOptions() (SerializeOptions, error) {
+	counts, err := LoadCounters(f.Counters)
+	if err != nil {
+		return SerializeOptions{}, err
+	}
+	return SerializeOptions{
+		Compact: f.Compact,
+		Shards:  f.Shards,
+		Hot:     f.Hot,
+		Counts:  counts,
+
+		ImplicitUPG: f.ImplicitUPG,
+		UPGPasswds:  f.passwds,
+	}, nil
+}
+
+func (f *File) TableSchema() TableSchema {
+	return TableSchema{
+		Columns:    f.Columns,
+		Index:      f.Index,
+		MultiIndex: f.MultiIndex,
+	}
+}
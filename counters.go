@@ -0,0 +1,241 @@
+// Per-host lookup counters used to optimize the data layout
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"syscall"
+
+	"github.com/google/renameio"
+)
+
+// Magic value of counter files, see nss/counter.h
+const counterMagic = "NSS-CNT1"
+
+// Number of counters in files created by CreateCounters()
+const CounterSlots = 4096
+
+// Counters are the lookup counts recorded by the NSS module. Entries are
+// counted by the hash of their name so different entries can share a
+// counter; this is good enough to find frequently used entries.
+type Counters struct {
+	slots []uint64
+}
+
+// counterPath returns the path of the counter file of uid, see
+// map_counter() in nss/counter.c.
+func counterPath(path string, uid int) string {
+	return fmt.Sprintf("%s.%d", path, uid)
+}
+
+// LoadCounters reads the counter files of all uids of path and returns the
+// sum of their counts. Missing files are not an error, nil is returned
+// instead.
+func LoadCounters(path string) (*Counters, error) {
+	files, err := loadCounterFiles(path)
+	if err != nil {
+		return nil, err
+	}
+
+	var res *Counters
+	for _, c := range files {
+		if res == nil {
+			res = &Counters{
+				slots: make([]uint64, len(c.slots)),
+			}
+		}
+		if len(c.slots) != len(res.slots) {
+			return nil, fmt.Errorf("%q: counter files have "+
+				"different sizes", path)
+		}
+		for i, x := range c.slots {
+			res.slots[i] += x
+		}
+	}
+	return res, nil
+}
+
+// loadCounterFiles reads the counter files of all uids of path (path.<uid>).
+// Files which are not used by the NSS module (not owned by the uid or
+// writable by group or others) are ignored.
+func loadCounterFiles(path string) (map[int]*Counters, error) {
+	if path == "" {
+		return nil, nil
+	}
+	paths, err := filepath.Glob(path + ".*")
+	if err != nil {
+		return nil, err
+	}
+
+	res := make(map[int]*Counters)
+	for _, p := range paths {
+		uid, err := strconv.Atoi(strings.TrimPrefix(p, path+"."))
+		if err != nil || uid < 0 || counterPath(path, uid) != p {
+			continue
+		}
+		fi, err := os.Lstat(p)
+		if err != nil {
+			return nil, err
+		}
+		if !counterFileUsable(fi, uid) {
+			continue
+		}
+
+		c, err := loadCounterFile(p)
+		if err != nil {
+			return nil, err
+		}
+		res[uid] = c
+	}
+	return res, nil
+}
+
+// isSymlinkError returns true if err was caused by opening a symlink with
+// O_NOFOLLOW.
+func isSymlinkError(err error) bool {
+	e, ok := err.(*os.PathError)
+	return ok && e.Err == syscall.ELOOP
+}
+
+// counterFileUsable returns true if the NSS module maps the counter file
+// described by fi for uid, i.e. it is a regular file owned by uid which is
+// not writable by group or others.
+func counterFileUsable(fi os.FileInfo, uid int) bool {
+	stat, ok := fi.Sys().(*syscall.Stat_t)
+	return ok && fi.Mode().IsRegular() && fi.Mode().Perm()&0022 == 0 &&
+		int(stat.Uid) == uid
+}
+
+func loadCounterFile(path string) (*Counters, error) {
+	x, err := ioutil.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+
+	le := binary.LittleEndian
+	if len(x) < 16 || string(x[:8]) != counterMagic {
+		return nil, fmt.Errorf("%q: invalid counter file", path)
+	}
+	n := le.Uint64(x[8:])
+	if n == 0 || n > uint64(len(x)-16)/8 {
+		return nil, fmt.Errorf("%q: invalid counter file", path)
+	}
+	res := &Counters{
+		slots: make([]uint64, n),
+	}
+	for i := range res.slots {
+		res.slots[i] = le.Uint64(x[16+8*i:])
+	}
+	return res, nil
+}
+
+// Get returns the lookup count of name; c can be nil.
+func (c *Counters) Get(name string) uint64 {
+	if c == nil {
+		return 0
+	}
+	return c.slots[shardHash(name)%uint64(len(c.slots))]
+}
+
+// CreateCounters creates an empty counter file for uid (path.<uid>) owned by
+// uid and only writable by it, the NSS module ignores other files (see
+// map_counter() in nss/counter.c). An existing file with the proper owner
+// and permissions is reset in place so running processes continue to use
+// it.
+func CreateCounters(path string, uid int) error {
+	le := binary.LittleEndian
+	path = counterPath(path, uid)
+
+	var x bytes.Buffer
+	x.Write([]byte(counterMagic))
+	tmp := make([]byte, 8)
+	le.PutUint64(tmp, CounterSlots)
+	x.Write(tmp)
+	x.Write(make([]byte, 8*CounterSlots))
+
+	f, err := os.OpenFile(path, os.O_WRONLY|syscall.O_NOFOLLOW, 0)
+	if err == nil {
+		var fi os.FileInfo
+		fi, err = f.Stat()
+		if err == nil && counterFileUsable(fi, uid) {
+			_, err = f.WriteAt(x.Bytes(), 0)
+			closeErr := f.Close()
+			if err != nil {
+				return err
+			}
+			return closeErr
+		}
+		f.Close()
+		if err != nil {
+			return err
+		}
+		// Replace files which are ignored by the NSS module
+	} else if !os.IsNotExist(err) && !isSymlinkError(err) {
+		return err
+	}
+
+	t, err := renameio.TempFile(filepath.Dir(path), path)
+	if err != nil {
+		return err
+	}
+	defer t.Cleanup()
+	err = t.Chmod(0644)
+	if err != nil {
+		return err
+	}
+	if uid != os.Geteuid() {
+		err = t.Chown(uid, -1)
+		if err != nil {
+			return err
+		}
+	}
+	_, err = t.Write(x.Bytes())
+	if err != nil {
+		return err
+	}
+	err = t.CloseAtomicallyReplace()
+	if err != nil {
+		return err
+	}
+	return syncPath(filepath.Dir(path))
+}
+
+// layoutOrder returns the order to store count entries in the data section:
+// the most frequently used entries first (so they share few pages), the
+// rest in input order.
+func layoutOrder(count int, name func(i int) string, c *Counters) []int {
+	res := make([]int, count)
+	for i := range res {
+		res[i] = i
+	}
+	if c == nil {
+		return res
+	}
+	sort.SliceStable(res, func(i, j int) bool {
+		return c.Get(name(res[i])) > c.Get(name(res[j]))
+	})
+	return res
+}
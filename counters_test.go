@@ -0,0 +1,324 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func TestCounters(t *testing.T) {
+	dir, err := ioutil.TempDir("", "nsscash")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "passwd.counts")
+	uid := os.Geteuid()
+	file := counterPath(path, uid)
+
+	// Missing files have no counts
+	c, err := LoadCounters(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c != nil || c.Get("root") != 0 {
+		t.Errorf("got %v, want nil", c)
+	}
+
+	err = CreateCounters(path, uid)
+	if err != nil {
+		t.Fatal(err)
+	}
+	fi, err := os.Stat(file)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if fi.Mode().Perm() != 0644 {
+		t.Errorf("got mode %v, want 0644", fi.Mode().Perm())
+	}
+
+	// Count a lookup as the NSS module does
+	x, err := ioutil.ReadFile(file)
+	if err != nil {
+		t.Fatal(err)
+	}
+	le := binary.LittleEndian
+	slot := 16 + 8*(shardHash("root")%CounterSlots)
+	le.PutUint64(x[slot:], 42)
+	err = ioutil.WriteFile(file, x, 0644)
+	if err != nil {
+		t.Fatal(err)
+	}
+	c, err = LoadCounters(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c.Get("root") != 42 {
+		t.Errorf("got %d, want 42", c.Get("root"))
+	}
+
+	// Files not used by the NSS module are ignored: owned by another
+	// uid, writable by others or with an invalid suffix
+	other := 12345
+	if uid == other {
+		other++
+	}
+	for _, p := range []string{
+		counterPath(path, other),
+		path + ".x",
+		path + ".01",
+	} {
+		err = ioutil.WriteFile(p, x, 0644)
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+	c, err = LoadCounters(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c.Get("root") != 42 {
+		t.Errorf("got %d, want 42", c.Get("root"))
+	}
+	err = os.Chmod(file, 0666)
+	if err != nil {
+		t.Fatal(err)
+	}
+	c, err = LoadCounters(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c != nil {
+		t.Errorf("got %v, want nil", c)
+	}
+
+	// ... and replaced
+	err = CreateCounters(path, uid)
+	if err != nil {
+		t.Fatal(err)
+	}
+	fi, err = os.Stat(file)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if fi.Mode().Perm() != 0644 {
+		t.Errorf("got mode %v, want 0644", fi.Mode().Perm())
+	}
+	c, err = LoadCounters(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c.Get("root") != 0 {
+		t.Errorf("got %d, want 0", c.Get("root"))
+	}
+
+	// Existing files are reset in place
+	err = ioutil.WriteFile(file, x, 0644)
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = CreateCounters(path, uid)
+	if err != nil {
+		t.Fatal(err)
+	}
+	fi2, err := os.Stat(file)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !os.SameFile(fi, fi2) {
+		t.Errorf("counter file was replaced")
+	}
+	c, err = LoadCounters(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c.Get("root") != 0 {
+		t.Errorf("got %d, want 0", c.Get("root"))
+	}
+
+	// Invalid files
+	err = ioutil.WriteFile(file, []byte("NSS-CASH"), 0644)
+	if err != nil {
+		t.Fatal(err)
+	}
+	_, err = LoadCounters(path)
+	if err == nil {
+		t.Errorf("no error for invalid counter file")
+	}
+}
+
+// newCounters returns counters with the given counts.
+func newCounters(counts map[string]uint64) *Counters {
+	c := &Counters{
+		slots: make([]uint64, CounterSlots),
+	}
+	for name, n := range counts {
+		c.slots[shardHash(name)%CounterSlots] += n
+	}
+	return c
+}
+
+func TestSerializeCounts(t *testing.T) {
+	pws := []Passwd{
+		{Name: "user-alpha", Passwd: "x", Uid: 1, Gid: 1},
+		{Name: "user-beta", Passwd: "x", Uid: 2, Gid: 2},
+		{Name: "user-gamma", Passwd: "x", Uid: 3, Gid: 3},
+	}
+	grs := []Group{
+		{Name: "user-alpha", Passwd: "x", Gid: 1},
+		{Name: "user-beta", Passwd: "x", Gid: 2},
+		{Name: "user-gamma", Passwd: "x", Gid: 3},
+	}
+	counts := newCounters(map[string]uint64{
+		"user-gamma": 10,
+		"user-beta":  5,
+	})
+	// Most frequently used entries are stored first
+	exp := []string{"user-gamma", "user-beta", "user-alpha"}
+
+	for _, compact := range []bool{false, true} {
+		opts := SerializeOptions{
+			Compact: compact,
+			Counts:  counts,
+		}
+		var x, y bytes.Buffer
+		err := SerializePasswds(&x, pws, opts)
+		if err != nil {
+			t.Fatal(err)
+		}
+		err = SerializeGroups(&y, grs, opts)
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		for _, b := range [][]byte{x.Bytes(), y.Bytes()} {
+			last := -1
+			for _, name := range exp {
+				i := bytes.Index(b, []byte(name))
+				if i <= last {
+					t.Errorf("compact %v: %q stored at %d, "+
+						"before %d", compact, name, i, last)
+				}
+				last = i
+			}
+		}
+
+		// Lookups and the enumeration order are not affected
+		f, err := reader.New(x.Bytes())
+		if err != nil {
+			t.Fatal(err)
+		}
+		for i, p := range pws {
+			e, ok := f.Passwd(i)
+			if !ok || string(e.Name) != p.Name {
+				t.Errorf("passwd %d: got %q", i, e.Name)
+			}
+			e, ok = f.PasswdByName(p.Name)
+			if !ok || e.Uid != p.Uid {
+				t.Errorf("%q: got %v", p.Name, e)
+			}
+		}
+		f, err = reader.New(y.Bytes())
+		if err != nil {
+			t.Fatal(err)
+		}
+		for i, g := range grs {
+			e, ok := f.Group(i)
+			if !ok || string(e.Name) != g.Name {
+				t.Errorf("group %d: got %q", i, e.Name)
+			}
+			e, ok = f.GroupByGid(g.Gid)
+			if !ok || string(e.Name) != g.Name {
+				t.Errorf("gid %d: got %q", g.Gid, e.Name)
+			}
+		}
+	}
+}
+
+func TestPrintStats(t *testing.T) {
+	dir, err := ioutil.TempDir("", "nsscash")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "stats.counts")
+
+	var buf bytes.Buffer
+	err = PrintStats(&buf, path)
+	if err == nil {
+		t.Errorf("missing file: got no error")
+	}
+
+	uid := os.Geteuid()
+	err = CreateCounters(path, uid)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// Record statistics as the NSS module does
+	x, err := ioutil.ReadFile(counterPath(path, uid))
+	if err != nil {
+		t.Fatal(err)
+	}
+	le := binary.LittleEndian
+	le.PutUint64(x[16+8*0:], 7) // passwd_lookups
+	le.PutUint64(x[16+8*3:], 2) // passwd_erange
+	le.PutUint64(x[16+8*11:], 1234)
+	err = ioutil.WriteFile(counterPath(path, uid), x, 0644)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	err = PrintStats(&buf, path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	exp := fmt.Sprintf(`passwd_lookups 7
+passwd_found 0
+passwd_notfound 0
+passwd_erange 2
+passwd_unavail 0
+group_lookups 0
+group_found 0
+group_notfound 0
+group_erange 0
+group_unavail 0
+maps 0
+map_nsec 1234
+uid %[1]d passwd_lookups 7
+uid %[1]d passwd_found 0
+uid %[1]d passwd_notfound 0
+uid %[1]d passwd_erange 2
+uid %[1]d passwd_unavail 0
+uid %[1]d group_lookups 0
+uid %[1]d group_found 0
+uid %[1]d group_notfound 0
+uid %[1]d group_erange 0
+uid %[1]d group_unavail 0
+uid %[1]d maps 0
+uid %[1]d map_nsec 1234
+`, uid)
+	if buf.String() != exp {
+		t.Errorf("got %q, want %q", buf.String(), exp)
+	}
+}
@@ -23,6 +23,8 @@ import (
 	"fmt"
 	"io/ioutil"
 	"net/http"
+	"net/http/httptrace"
+	"sync"
 	"time"
 
 	"github.com/pkg/errors"
@@ -36,7 +38,10 @@ func init() {
 	clients[""] = &http.Client{}
 }
 
-func fetchIfModified(url, user, pass, ca string, lastModified *time.Time) (int, []byte, error) {
+// fetchIfModified fetches url if it was modified since lastModified (if not
+// zero) and updates lastModified. The duration of the request's phases and
+// the size of the response are recorded in m.
+func fetchIfModified(url, user, pass, ca string, lastModified *time.Time, m *fileMetrics) (int, []byte, error) {
 	req, err := http.NewRequest("GET", url, nil)
 	if err != nil {
 		return 0, nil, err
@@ -72,16 +77,63 @@ func fetchIfModified(url, user, pass, ca string, lastModified *time.Time) (int,
 		clients[ca] = client
 	}
 
+	// The callbacks can be called concurrently, e.g. when connecting to
+	// multiple addresses at once
+	var mutex sync.Mutex
+	var dnsStart, connectStart, tlsStart, wroteRequest time.Time
+	begin := func(t *time.Time) {
+		mutex.Lock()
+		*t = time.Now()
+		mutex.Unlock()
+	}
+	end := func(p phase, t *time.Time) {
+		mutex.Lock()
+		m.phase(p, *t)
+		mutex.Unlock()
+	}
+	trace := &httptrace.ClientTrace{
+		DNSStart: func(httptrace.DNSStartInfo) {
+			begin(&dnsStart)
+		},
+		DNSDone: func(httptrace.DNSDoneInfo) {
+			end(phaseDNS, &dnsStart)
+		},
+		ConnectStart: func(string, string) {
+			begin(&connectStart)
+		},
+		ConnectDone: func(string, string, error) {
+			end(phaseConnect, &connectStart)
+		},
+		TLSHandshakeStart: func() {
+			begin(&tlsStart)
+		},
+		TLSHandshakeDone: func(tls.ConnectionState, error) {
+			end(phaseTLS, &tlsStart)
+		},
+		WroteRequest: func(httptrace.WroteRequestInfo) {
+			begin(&wroteRequest)
+		},
+		GotFirstResponseByte: func() {
+			end(phaseTTFB, &wroteRequest)
+		},
+	}
+	req = req.WithContext(httptrace.WithClientTrace(req.Context(), trace))
+
 	resp, err := client.Do(req)
 	if err != nil {
 		return 0, nil, err
 	}
 	defer resp.Body.Close()
 
+	start := time.Now()
 	body, err := ioutil.ReadAll(resp.Body)
 	if err != nil {
 		return 0, nil, err
 	}
+	mutex.Lock()
+	m.phase(phaseDownload, start)
+	m.bytes = int64(len(body))
+	mutex.Unlock()
 
 	modified, err := http.ParseTime(resp.Header.Get("Last-Modified"))
 	if err == nil {
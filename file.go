@@ -20,13 +20,16 @@ package main
 import (
 	"bytes"
 	"crypto/sha512"
+	"encoding/binary"
 	"encoding/hex"
 	"fmt"
+	"io"
 	"io/ioutil"
 	"log"
 	"net/http"
 	"os"
 	"path/filepath"
+	"strings"
 	"syscall"
 	"time"
 
@@ -40,8 +43,25 @@ func handleFiles(cfg *Config, state *State) error {
 	// work during the deploy phase, but it helps if the web server fails
 	// to deliver some files
 
-	for i, f := range cfg.Files {
-		err := fetchFile(&cfg.Files[i], state)
+	// Passwd files are fetched first as group files with implicit user
+	// private groups depend on them
+	var order []int
+	for _, passwd := range []bool{true, false} {
+		for i, f := range cfg.Files {
+			if (f.Type == FileTypePasswd) == passwd {
+				order = append(order, i)
+			}
+		}
+	}
+	for _, i := range order {
+		f := &cfg.Files[i]
+		if f.ImplicitUPG {
+			err := prepareImplicitUPG(cfg, f, state)
+			if err != nil {
+				return errors.Wrapf(err, "%q (%v)", f.Url, f.Type)
+			}
+		}
+		err := fetchFile(f, state)
 		if err != nil {
 			return errors.Wrapf(err, "%q (%v)", f.Url, f.Type)
 		}
@@ -59,9 +79,42 @@ func handleFiles(cfg *Config, state *State) error {
 		}
 	}
 
+	if cfg.CombinedPath != "" {
+		err := deployCombined(cfg)
+		if err != nil {
+			return errors.Wrapf(err, "%q", cfg.CombinedPath)
+		}
+	}
+
 	return nil
 }
 
+// prepareImplicitUPG stores the passwd entries whose user private groups are
+// omitted from file in file.passwds. The passwd file was already fetched, if
+// it has changed the group file must be converted again.
+func prepareImplicitUPG(cfg *Config, file *File, state *State) error {
+	for _, f := range cfg.Files {
+		if f.Type != FileTypePasswd {
+			continue
+		}
+
+		if f.passwds != nil {
+			log.Printf("%q -> %q: passwd has changed",
+				file.Url, file.Path)
+			file.passwds = f.passwds
+			delete(state.LastModified, file.Url) // force download
+			return nil
+		}
+		pws, err := readPasswds(f.Path)
+		if err != nil {
+			return errors.Wrapf(err, "implicitupg: passwd %q", f.Path)
+		}
+		file.passwds = pws
+		return nil
+	}
+	return fmt.Errorf("implicitupg: no passwd file")
+}
+
 func checksumFile(file *File) (string, error) {
 	x, err := ioutil.ReadFile(file.Path)
 	if err != nil {
@@ -92,7 +145,7 @@ func fetchFile(file *File, state *State) error {
 
 	oldT := t
 	status, body, err := fetchIfModified(file.Url,
-		file.Username, file.Password, file.CA, &t)
+		file.Username, file.Password, file.CA, &t, &file.metrics)
 	if err != nil {
 		return err
 	}
@@ -102,12 +155,16 @@ func fetchFile(file *File, state *State) error {
 				"but did not send If-Modified-Since")
 		}
 		log.Printf("%q -> %q: not modified", file.Url, file.Path)
+		state.countResponse(file.Url, status)
 		return nil
 	}
 	if status != http.StatusOK {
 		return fmt.Errorf("status code %v", status)
 	}
 	state.LastModified[file.Url] = t
+	state.countResponse(file.Url, status)
+
+	start := time.Now()
 
 	if file.Type == FileTypePlain {
 		if len(body) == 0 {
@@ -120,14 +177,25 @@ func fetchFile(file *File, state *State) error {
 		if err != nil {
 			return err
 		}
+		start = file.metrics.phase(phaseParse, start)
 		// Safety check: having no users can be very dangerous, don't
 		// permit it
 		if len(pws) == 0 {
 			return fmt.Errorf("refusing to use empty passwd file")
 		}
+		file.passwds = pws
 
 		var x bytes.Buffer
-		err = SerializePasswds(&x, pws)
+		opts, err := file.SerializeOptions()
+		if err != nil {
+			return err
+		}
+		if opts.Shards > 0 {
+			file.shards, err = SerializePasswdShards(&x, pws,
+				opts.Shards, opts)
+		} else {
+			err = SerializePasswds(&x, pws, opts)
+		}
 		if err != nil {
 			return err
 		}
@@ -138,12 +206,93 @@ func fetchFile(file *File, state *State) error {
 		if err != nil {
 			return err
 		}
+		start = file.metrics.phase(phaseParse, start)
 		if len(grs) == 0 {
 			return fmt.Errorf("refusing to use empty group file")
 		}
 
 		var x bytes.Buffer
-		err = SerializeGroups(&x, grs)
+		opts, err := file.SerializeOptions()
+		if err != nil {
+			return err
+		}
+		if opts.Shards > 0 {
+			file.shards, err = SerializeGroupShards(&x, grs,
+				opts.Shards, opts)
+		} else {
+			err = SerializeGroups(&x, grs, opts)
+		}
+		if err != nil {
+			return err
+		}
+		file.body = x.Bytes()
+
+	} else if file.Type == FileTypeServices {
+		svs, err := ParseServices(bytes.NewReader(body))
+		if err != nil {
+			return err
+		}
+		start = file.metrics.phase(phaseParse, start)
+		if len(svs) == 0 {
+			return fmt.Errorf("refusing to use empty services file")
+		}
+
+		var x bytes.Buffer
+		err = SerializeServices(&x, svs)
+		if err != nil {
+			return err
+		}
+		file.body = x.Bytes()
+
+	} else if file.Type == FileTypeProtocols {
+		prs, err := ParseProtocols(bytes.NewReader(body))
+		if err != nil {
+			return err
+		}
+		start = file.metrics.phase(phaseParse, start)
+		if len(prs) == 0 {
+			return fmt.Errorf("refusing to use empty protocols file")
+		}
+
+		var x bytes.Buffer
+		err = SerializeProtocols(&x, prs)
+		if err != nil {
+			return err
+		}
+		file.body = x.Bytes()
+
+	} else if file.Type == FileTypeAuthorizedKeys {
+		aks, err := ParseAuthorizedKeys(bytes.NewReader(body))
+		if err != nil {
+			return err
+		}
+		start = file.metrics.phase(phaseParse, start)
+		if len(aks) == 0 {
+			return fmt.Errorf(
+				"refusing to use empty authorized_keys file")
+		}
+
+		var x bytes.Buffer
+		err = SerializeAuthorizedKeys(&x, aks)
+		if err != nil {
+			return err
+		}
+		file.body = x.Bytes()
+
+	} else if file.Type == FileTypeTable {
+		schema := file.TableSchema()
+		rows, err := ParseTable(bytes.NewReader(body),
+			len(schema.Columns))
+		if err != nil {
+			return err
+		}
+		start = file.metrics.phase(phaseParse, start)
+		if len(rows) == 0 {
+			return fmt.Errorf("refusing to use empty table file")
+		}
+
+		var x bytes.Buffer
+		err = SerializeTable(&x, schema, rows)
 		if err != nil {
 			return err
 		}
@@ -153,6 +302,8 @@ func fetchFile(file *File, state *State) error {
 		return fmt.Errorf("unsupported file type %v", file.Type)
 	}
 
+	file.metrics.phase(phaseSerialize, start)
+
 	state.Checksum[file.Url] = checksumBytes(file.body)
 	return nil
 }
@@ -165,12 +316,6 @@ func deployFile(file *File) error {
 		return fmt.Errorf("refusing to write empty file")
 	}
 
-	f, err := renameio.TempFile(filepath.Dir(file.Path), file.Path)
-	if err != nil {
-		return err
-	}
-	defer f.Cleanup()
-
 	// Apply permissions/user/group from the target file but remove the
 	// write permissions to discourage manual modifications, use Stat
 	// instead of Lstat as only the target's permissions are relevant
@@ -180,6 +325,61 @@ func deployFile(file *File) error {
 		// do not know the proper permissions
 		return errors.Wrapf(err, "file.path %q must exist", file.Path)
 	}
+
+	// Write the shards before the root file which references them. The
+	// paths of the shards contain the hash of their content (see
+	// serializeShards()) so changed shards use new paths and replacing the
+	// root file is the only step visible to lookups; existing shards are
+	// unchanged and kept
+	for _, s := range file.shards {
+		path := file.Path + s.Suffix
+		_, err := os.Lstat(path)
+		if err == nil {
+			continue
+		}
+		err = writeFile(path, s.Body, stat, &file.metrics)
+		if err != nil {
+			return err
+		}
+		if file.Warm {
+			err = warmFile(path)
+			if err != nil {
+				return err
+			}
+		}
+	}
+	err = writeFile(file.Path, file.body, stat, &file.metrics)
+	if err != nil {
+		return err
+	}
+	if file.Warm {
+		err = warmFile(file.Path)
+		if err != nil {
+			return err
+		}
+	}
+	if file.Type == FileTypePasswd || file.Type == FileTypeGroup {
+		err = removeStaleShards(file.Path, file.shards)
+		if err != nil {
+			return err
+		}
+	}
+	start := time.Now()
+	err = syncPath(filepath.Dir(file.Path))
+	file.metrics.phase(phaseFsync, start)
+	return err
+}
+
+// writeFile atomically replaces path with body and applies permissions and
+// owner from stat (without write permissions). The time to sync and rename
+// the file is recorded in m.
+func writeFile(path string, body []byte, stat os.FileInfo, m *fileMetrics) error {
+	f, err := renameio.TempFile(filepath.Dir(path), path)
+	if err != nil {
+		return err
+	}
+	defer f.Cleanup()
+
 	err = f.Chmod(stat.Mode() & ^os.FileMode(0222)) // remove write perms
 	if err != nil {
 		return err
@@ -194,13 +394,110 @@ func deployFile(file *File) error {
 		return err
 	}
 
-	_, err = f.Write(file.body)
+	_, err = f.Write(body)
 	if err != nil {
 		return err
 	}
+	// Sync explicitly (CloseAtomicallyReplace() does it as well) to
+	// record the time of both steps
+	start := time.Now()
+	err = f.Sync()
+	if err != nil {
+		return err
+	}
+	start = m.phase(phaseFsync, start)
 	err = f.CloseAtomicallyReplace()
+	m.phase(phaseRename, start)
+	return err
+}
+
+// warmFile reads the parts of the file at path which are used by every
+// lookup so they are in the page cache before the first process maps the
+// new file (see warmSize()). Otherwise the first lookups of all processes
+// have to wait for the disk which can take seconds on slow network disks.
+func warmFile(path string) error {
+	f, err := os.Open(path)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	stat, err := f.Stat()
+	if err != nil {
+		return err
+	}
+	hdr := make([]byte, headerSize)
+	n, err := io.ReadFull(f, hdr)
+	if err != nil && err != io.EOF && err != io.ErrUnexpectedEOF {
+		return err
+	}
+	size := warmSize(hdr[:n], stat.Size())
+
+	_, err = io.Copy(ioutil.Discard, io.NewSectionReader(f, 0, size))
+	return err
+}
+
+// warmSize returns the number of bytes at the beginning of a file with the
+// given header and size which are used by every lookup. For nsscash files
+// that's the header, the sections stored directly after it (e.g. hot
+// entries) and the indices which are all stored before the data. Other
+// files (and combined files whose indices are spread over the sections) are
+// read completely.
+func warmSize(hdr []byte, size int64) int64 {
+	le := binary.LittleEndian
+	if len(hdr) < headerSize || string(hdr[:8]) != "NSS-CASH" ||
+		le.Uint64(hdr[8:])&FeatureCombined != 0 {
+		return size
+	}
+	n := uint64(headerSize) + le.Uint64(hdr[48:]) // off_data
+	if n > uint64(size) {
+		return size
+	}
+	return int64(n)
+}
+
+// removeStaleShards removes shard files of path which are no longer
+// referenced by the root file, i.e. whose content has changed or after the
+// number of shards was reduced. It must be called after the root file was replaced.
+func removeStaleShards(path string, shards []Shard) error {
+	keep := make(map[string]bool)
+	for _, s := range shards {
+		keep[path+s.Suffix] = true
+	}
+	xs, err := shardFiles(path)
 	if err != nil {
 		return err
 	}
-	return syncPath(filepath.Dir(file.Path))
+	for _, x := range xs {
+		if keep[x] {
+			continue
+		}
+		err = os.Remove(x)
+		if err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// shardFiles returns the paths of all existing shard files of path
+// (referenced or not). Other files starting with path are ignored.
+func shardFiles(path string) ([]string, error) {
+	dir, base := filepath.Split(path)
+	if dir == "" {
+		dir = "."
+	}
+	xs, err := ioutil.ReadDir(dir)
+	if err != nil {
+		return nil, err
+	}
+	var res []string
+	for _, x := range xs {
+		name := x.Name()
+		if strings.HasPrefix(name, base) &&
+			shardSuffixRegexp.MatchString(name[len(base):]) {
+			res = append(res, path+name[len(base):])
+		}
+	}
+	return res, nil
 }
@@ -16,6 +16,8 @@
 package main
 
 import (
+	"bytes"
+	"encoding/binary"
 	"io/ioutil"
 	"log"
 	"os"
@@ -96,3 +98,68 @@ func TestDeployFile(t *testing.T) {
 		}
 	}
 }
+
+func TestWarmSize(t *testing.T) {
+	var pw bytes.Buffer
+	err := SerializePasswds(&pw, []Passwd{
+		{Name: "root", Passwd: "x", Uid: 0, Gid: 0, Shell: "/bin/sh"},
+	}, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	x := pw.Bytes()
+	combined, err := SerializeCombined(x, x)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// off_data, the indices of one entry use 3*8 bytes
+	offData := binary.LittleEndian.Uint64(x[48:])
+
+	tests := []struct {
+		name string
+		x    []byte
+		exp  int64
+	}{
+		{"passwd", x, int64(headerSize + offData)},
+		{"combined", combined, int64(len(combined))},
+		{"plain", []byte("Hello World!\n"), 13},
+		{"short", []byte("NSS-CASH"), 8},
+		// Invalid offsets are limited to the file
+		{"truncated", x[:headerSize+8], headerSize + 8},
+	}
+
+	for _, tc := range tests {
+		n := len(tc.x)
+		if n > headerSize {
+			n = headerSize
+		}
+		res := warmSize(tc.x[:n], int64(len(tc.x)))
+		if res != tc.exp {
+			t.Errorf("%s: got %d, want %d", tc.name, res, tc.exp)
+		}
+	}
+	if offData != 3*8 {
+		t.Errorf("off_data = %d, want %d", offData, 3*8)
+	}
+}
+
+func TestWarmFile(t *testing.T) {
+	const path = "testdata/warm"
+	defer os.Remove(path)
+
+	for _, x := range [][]byte{nil, []byte("x"), []byte("Hello World!\n")} {
+		err := ioutil.WriteFile(path, x, 0644)
+		if err != nil {
+			t.Fatal(err)
+		}
+		err = warmFile(path)
+		if err != nil {
+			t.Errorf("%q: %v", x, err)
+		}
+	}
+
+	err := warmFile("testdata/does-not-exist")
+	if !os.IsNotExist(err) {
+		t.Errorf("got %v, want not exist error", err)
+	}
+}
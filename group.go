@@ -138,8 +138,7 @@ func SerializeGroup(g Group) ([]byte, error) {
 	data.Write(mems.Bytes())
 	// Ensure the offsets can fit the length of this entry
 	if data.Len() > math.MaxUint16 {
-		return nil, fmt.Errorf("group too large to serialize: %v, %v",
-			data.Len(), g)
+		return nil, groupTooLargeError{data.Len(), g}
 	}
 	size := uint16(data.Len())
 
@@ -172,19 +171,199 @@ func SerializeGroup(g Group) ([]byte, error) {
 	return res.Bytes(), nil
 }
 
-func SerializeGroups(w io.Writer, grs []Group) error {
-	// Serialize groups and store offsets
+// groupTooLargeError is returned if a group does not fit in an entry.
+type groupTooLargeError struct {
+	size  int
+	group Group
+}
+
+func (e groupTooLargeError) Error() string {
+	return fmt.Sprintf("group too large to serialize: %v, %v",
+		e.size, e.group)
+}
+
+// SerializeGroupLarge serializes g like SerializeGroup() but with 32 bit
+// offsets and counts (FeatureLargeGroups) to support groups with more than
+// 64 KiB of data.
+func SerializeGroupLarge(g Group) ([]byte, error) {
+	return serializeGroup32(g, nil)
+}
+
+// SerializeGroupCompact serializes g with its members stored as references
+// into mems (FeatureMemberTable); each member name is stored only once per
+// file instead of once per group. All offsets and counts are 32 bit.
+func SerializeGroupCompact(g Group, mems *stringTable) ([]byte, error) {
+	return serializeGroup32(g, mems)
+}
+
+// serializeGroup32 serializes g with 32 bit offsets and counts; the members
+// are stored in data (mems == nil) or as references into mems.
+func serializeGroup32(g Group, mems *stringTable) ([]byte, error) {
+	le := binary.LittleEndian
+	tmp := make([]byte, 4)
+
+	var members bytes.Buffer
+	var membersOff []uint32
+	if mems == nil {
+		// Concatenate all (NUL-terminated) strings and store the
+		// offsets as in SerializeGroup()
+		for _, m := range g.Members {
+			membersOff = append(membersOff, uint32(members.Len()))
+			members.Write([]byte(m))
+			members.WriteByte(0)
+		}
+	} else {
+		for _, m := range g.Members {
+			off, err := mems.add(m)
+			if err != nil {
+				return nil, err
+			}
+			membersOff = append(membersOff, off)
+		}
+	}
+
 	var data bytes.Buffer
+	data.Write([]byte(g.Name))
+	data.WriteByte(0)
+	offPasswd := uint32(data.Len())
+	data.Write([]byte(g.Passwd))
+	data.WriteByte(0)
+	alignBufferTo(&data, 4) // align the following uint32
+	offMemOff := uint32(data.Len())
+	// Offsets of group members; relative to data or to the member table
+	offMem := uint64(offMemOff) + 4*uint64(len(membersOff))
+	if mems != nil {
+		offMem = 0
+	}
+	for _, o := range membersOff {
+		x := offMem + uint64(o)
+		if x > math.MaxUint32 {
+			return nil, groupTooLargeError{int(x), g}
+		}
+		le.PutUint32(tmp, uint32(x))
+		data.Write(tmp)
+	}
+	// And the group members concatenated as above
+	data.Write(members.Bytes())
+	// Ensure the offsets can fit the length of this entry
+	if uint64(data.Len()) > math.MaxUint32 {
+		return nil, groupTooLargeError{data.Len(), g}
+	}
+
+	var res bytes.Buffer // serialized result
+
+	id := make([]byte, 8)
+	// gid
+	le.PutUint64(id, g.Gid)
+	res.Write(id)
+
+	// off_passwd
+	le.PutUint32(tmp, offPasswd)
+	res.Write(tmp)
+	// off_mem_off
+	le.PutUint32(tmp, offMemOff)
+	res.Write(tmp)
+	// mem_count
+	le.PutUint32(tmp, uint32(len(g.Members)))
+	res.Write(tmp)
+	// data_size
+	le.PutUint32(tmp, uint32(data.Len()))
+	res.Write(tmp)
+
+	res.Write(data.Bytes())
+	// We must pad each entry so that all uint64 at the beginning of the
+	// struct are 8 byte aligned
+	alignBufferTo(&res, 8)
+
+	return res.Bytes(), nil
+}
+
+// serializeGroupEntries serializes all groups with serialize and returns the
+// data and the offset of each group in it.
+func serializeGroupEntries(grs []Group, serialize func(Group) ([]byte, error)) (*bytes.Buffer, map[GroupKey]uint64, error) {
+	data := new(bytes.Buffer)
 	offsets := make(map[GroupKey]uint64)
 	for _, g := range grs {
 		// TODO: warn about duplicate entries
 		offsets[toKey(g)] = uint64(data.Len())
-		x, err := SerializeGroup(g)
+		x, err := serialize(g)
 		if err != nil {
-			return err
+			return nil, nil, err
 		}
 		data.Write(x)
 	}
+	return data, offsets, nil
+}
+
+func SerializeGroups(w io.Writer, grs []Group, opts SerializeOptions) error {
+	if opts.ImplicitUPG {
+		x, ok := removeImplicitUPGs(grs, opts.UPGPasswds)
+		if ok {
+			grs = x
+		} else {
+			// Store all groups, the file is readable by every
+			// NSS module
+			opts.ImplicitUPG = false
+		}
+	}
+	if len(opts.Hot) == 0 {
+		return serializeGroups(w, grs, opts)
+	}
+
+	var x bytes.Buffer
+	err := serializeGroups(&x, grs, opts)
+	if err != nil {
+		return err
+	}
+	return writeWithHot(w, x.Bytes(), hotGroups(grs, opts.Hot))
+}
+
+func serializeGroups(w io.Writer, grs []Group, opts SerializeOptions) error {
+	version := uint64(GroupVersion)
+	var mems *stringTable
+	index32 := opts.Compact
+	if opts.Compact {
+		version |= FeatureMemberTable | FeatureIndex32
+		mems = newStringTable()
+	}
+	if opts.ImplicitUPG {
+		version |= FeatureImplicitUPG
+	}
+
+	// Serialize groups and store offsets
+	serialize := SerializeGroup
+	if mems != nil {
+		serialize = func(g Group) ([]byte, error) {
+			return SerializeGroupCompact(g, mems)
+		}
+	}
+	order := layoutOrder(len(grs),
+		func(i int) string { return grs[i].Name }, opts.Counts)
+	ordered := make([]Group, 0, len(grs))
+	for _, i := range order {
+		ordered = append(ordered, grs[i])
+	}
+	data, offsets, err := serializeGroupEntries(ordered, serialize)
+	if _, ok := err.(groupTooLargeError); ok && mems == nil {
+		// 32 bit offsets are only used when necessary so that older
+		// NSS modules can still read all other files
+		version |= FeatureLargeGroups
+		data, offsets, err = serializeGroupEntries(ordered,
+			SerializeGroupLarge)
+	}
+	if err != nil {
+		return err
+	}
+	// The member table is stored at the beginning of the data section so
+	// its offsets are relative to the data section as well
+	var table bytes.Buffer
+	if mems != nil {
+		table.Write(mems.data.Bytes())
+		alignBufferTo(&table, 8)
+		for k := range offsets {
+			offsets[k] += uint64(table.Len())
+		}
+	}
 
 	// Copy to prevent sorting from modifying the argument
 	sorted := make([]Group, len(grs))
@@ -198,8 +377,10 @@ func SerializeGroups(w io.Writer, grs []Group) error {
 	// debugging easier
 	var indexOrig bytes.Buffer
 	for _, g := range grs {
-		le.PutUint64(tmp, offsets[toKey(g)])
-		indexOrig.Write(tmp)
+		err := writeIndexSlot(&indexOrig, offsets[toKey(g)], index32)
+		if err != nil {
+			return err
+		}
 	}
 
 	// Create index sorted after id
@@ -208,8 +389,10 @@ func SerializeGroups(w io.Writer, grs []Group) error {
 		return sorted[i].Gid < sorted[j].Gid
 	})
 	for _, g := range sorted {
-		le.PutUint64(tmp, offsets[toKey(g)])
-		indexId.Write(tmp)
+		err := writeIndexSlot(&indexId, offsets[toKey(g)], index32)
+		if err != nil {
+			return err
+		}
 	}
 
 	// Create index sorted after name
@@ -218,12 +401,18 @@ func SerializeGroups(w io.Writer, grs []Group) error {
 		return sorted[i].Name < sorted[j].Name
 	})
 	for _, g := range sorted {
-		le.PutUint64(tmp, offsets[toKey(g)])
-		indexName.Write(tmp)
+		err := writeIndexSlot(&indexName, offsets[toKey(g)], index32)
+		if err != nil {
+			return err
+		}
 	}
 
+	alignBufferTo(&indexOrig, 8)
+	alignBufferTo(&indexId, 8)
+	alignBufferTo(&indexName, 8)
+
 	// Sanity check
-	if len(grs)*8 != indexOrig.Len() ||
+	if indexSize(len(grs), index32) != indexOrig.Len() ||
 		indexOrig.Len() != indexId.Len() ||
 		indexId.Len() != indexName.Len() {
 		return fmt.Errorf("indexes have inconsistent length")
@@ -234,7 +423,7 @@ func SerializeGroups(w io.Writer, grs []Group) error {
 	// magic
 	w.Write([]byte("NSS-CASH"))
 	// version
-	le.PutUint64(tmp, GroupVersion)
+	le.PutUint64(tmp, version)
 	w.Write(tmp)
 	// count
 	le.PutUint64(tmp, uint64(len(grs)))
@@ -256,7 +445,7 @@ func SerializeGroups(w io.Writer, grs []Group) error {
 	le.PutUint64(tmp, offset)
 	w.Write(tmp)
 
-	_, err := indexOrig.WriteTo(w)
+	_, err = indexOrig.WriteTo(w)
 	if err != nil {
 		return err
 	}
@@ -268,6 +457,10 @@ func SerializeGroups(w io.Writer, grs []Group) error {
 	if err != nil {
 		return err
 	}
+	_, err = table.WriteTo(w)
+	if err != nil {
+		return err
+	}
 	_, err = data.WriteTo(w)
 	if err != nil {
 		return err
@@ -0,0 +1,176 @@
+// Hot-entry section for fast lookups of frequently used entries
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"io"
+)
+
+// Section type of the hot-entry table, see nss/hot.h
+const SectionHot uint32 = 3
+
+type hotEntry struct {
+	name string
+	id   uint64
+	data []byte // entry in the basic format (struct passwd_entry/group_entry)
+}
+
+// hotIdHash hashes ids for the hot-entry table, see hot_id_hash() in
+// nss/hot.c.
+func hotIdHash(id uint64) uint64 {
+	return (id * 0x9e3779b97f4a7c15) >> 32
+}
+
+// serializeHot creates a direct-probe hash table which contains complete
+// copies of the given entries so lookups for them only touch the first
+// pages of the file: the number of slots (a power of two), the name and id
+// slots (offset of the entry relative to the section, 0 if empty) and the
+// entries. Collisions are resolved via linear probing.
+func serializeHot(entries []hotEntry) []byte {
+	slots := 1
+	for slots < 2*len(entries) {
+		slots *= 2
+	}
+	mask := uint64(slots - 1)
+
+	names := make([]uint64, slots)
+	ids := make([]uint64, slots)
+	offset := uint64(8 + 2*8*slots)
+	for _, e := range entries {
+		for i := shardHash(e.name) & mask; ; i = (i + 1) & mask {
+			if names[i] == 0 {
+				names[i] = offset
+				break
+			}
+		}
+		for i := hotIdHash(e.id) & mask; ; i = (i + 1) & mask {
+			if ids[i] == 0 {
+				ids[i] = offset
+				break
+			}
+		}
+		offset += uint64(len(e.data))
+	}
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	var res bytes.Buffer
+	le.PutUint64(tmp, uint64(slots))
+	res.Write(tmp)
+	for _, x := range append(names, ids...) {
+		le.PutUint64(tmp, x)
+		res.Write(tmp)
+	}
+	for _, e := range entries {
+		res.Write(e.data)
+	}
+	return res.Bytes()
+}
+
+// writeWithHot writes the serialized file x to w; if there are hot entries
+// they are added as section.
+func writeWithHot(w io.Writer, x []byte, hot []hotEntry) error {
+	if len(hot) > 0 {
+		var err error
+		x, err = AddSections(x, []Section{
+			{
+				Type: SectionHot,
+				Data: serializeHot(hot),
+			},
+		})
+		if err != nil {
+			return err
+		}
+	}
+	_, err := w.Write(x)
+	return err
+}
+
+func hotSet(names []string) map[string]bool {
+	res := make(map[string]bool)
+	for _, x := range names {
+		res[x] = true
+	}
+	return res
+}
+
+// hotUnique returns a function reporting if name and id are used only by a
+// single entry; other entries are not stored as hot entry because the normal
+// lookup might return a different entry than the hot-entry table.
+func hotUnique(count int, name func(i int) string, id func(i int) uint64) func(i int) bool {
+	names := make(map[string]int)
+	ids := make(map[uint64]int)
+	for i := 0; i < count; i++ {
+		names[name(i)]++
+		ids[id(i)]++
+	}
+	return func(i int) bool {
+		return names[name(i)] == 1 && ids[id(i)] == 1
+	}
+}
+
+func hotPasswds(pws []Passwd, names []string) []hotEntry {
+	set := hotSet(names)
+	unique := hotUnique(len(pws),
+		func(i int) string { return pws[i].Name },
+		func(i int) uint64 { return pws[i].Uid })
+
+	var res []hotEntry
+	for i, p := range pws {
+		if !set[p.Name] || !unique(i) {
+			continue
+		}
+		x, err := SerializePasswd(p)
+		if err != nil {
+			continue // too large, not worth it
+		}
+		res = append(res, hotEntry{
+			name: p.Name,
+			id:   p.Uid,
+			data: x,
+		})
+	}
+	return res
+}
+
+func hotGroups(grs []Group, names []string) []hotEntry {
+	set := hotSet(names)
+	unique := hotUnique(len(grs),
+		func(i int) string { return grs[i].Name },
+		func(i int) uint64 { return grs[i].Gid })
+
+	var res []hotEntry
+	for i, g := range grs {
+		if !set[g.Name] || !unique(i) {
+			continue
+		}
+		x, err := SerializeGroup(g)
+		if err != nil {
+			continue
+		}
+		res = append(res, hotEntry{
+			name: g.Name,
+			id:   g.Gid,
+			data: x,
+		})
+	}
+	return res
+}
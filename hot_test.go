@@ -0,0 +1,132 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"reflect"
+	"sort"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+// hotLookup mirrors hot_lookup() in nss/hot.c and returns the name of the
+// entry (a passwd_entry) found in the hot-entry section x.
+func hotLookup(x []byte, name string, id uint64) string {
+	le := binary.LittleEndian
+
+	slots := le.Uint64(x)
+	mask := slots - 1
+	index := x[8:]
+	i := shardHash(name) & mask
+	if name == "" {
+		index = x[8+8*slots:]
+		i = hotIdHash(id) & mask
+	}
+	for n := uint64(0); n < slots; n++ {
+		off := le.Uint64(index[8*i:])
+		if off == 0 {
+			break
+		}
+		e := x[off:]
+		// struct passwd_entry has 26 bytes before the name
+		s := string(e[26 : 26+bytes.IndexByte(e[26:], 0)])
+		if (name != "" && s == name) ||
+			(name == "" && le.Uint64(e) == id) {
+			return s
+		}
+		i = (i + 1) & mask
+	}
+	return ""
+}
+
+func TestSerializePasswdsHot(t *testing.T) {
+	pws := []Passwd{
+		{Name: "root", Passwd: "x", Uid: 0, Gid: 0, Shell: "/bin/sh"},
+		{Name: "a", Passwd: "x", Uid: 1, Gid: 1},
+		{Name: "b", Passwd: "x", Uid: 2, Gid: 2},
+		{Name: "dup", Passwd: "x", Uid: 3, Gid: 3},
+		{Name: "dup", Passwd: "x", Uid: 4, Gid: 4},
+		{Name: "c", Passwd: "x", Uid: 2, Gid: 5},
+	}
+
+	for _, compact := range []bool{false, true} {
+		var x bytes.Buffer
+		err := SerializePasswds(&x, pws, SerializeOptions{
+			Compact: compact,
+			// "b" and "dup" are not unique, "missing" doesn't
+			// exist
+			Hot: []string{"root", "a", "b", "dup", "missing"},
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		f, err := reader.New(x.Bytes())
+		if err != nil {
+			t.Fatal(err)
+		}
+		// The normal lookups still work
+		for _, p := range pws {
+			_, ok := f.PasswdByUid(p.Uid)
+			if !ok {
+				t.Errorf("uid %d not found", p.Uid)
+			}
+		}
+
+		sec, ok := f.Section(SectionHot)
+		if !ok {
+			t.Fatalf("no hot section")
+		}
+		if binary.LittleEndian.Uint64(sec) != 4 {
+			t.Errorf("got %d slots, want 4",
+				binary.LittleEndian.Uint64(sec))
+		}
+		var found []string
+		for _, p := range pws {
+			if hotLookup(sec, p.Name, 0) != "" {
+				found = append(found, p.Name)
+			}
+			name := hotLookup(sec, "", p.Uid)
+			if name != "" && name != p.Name {
+				t.Errorf("uid %d: got %q", p.Uid, name)
+			}
+		}
+		sort.Strings(found)
+		exp := []string{"a", "root"}
+		if !reflect.DeepEqual(found, exp) {
+			t.Errorf("got %v, want %v", found, exp)
+		}
+	}
+
+	// No hot entries, no section; the file can be read by older modules
+	var x, y bytes.Buffer
+	err := SerializePasswds(&x, pws, SerializeOptions{
+		Hot: []string{"missing"},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = SerializePasswds(&y, pws, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(x.Bytes(), y.Bytes()) {
+		t.Errorf("hot section written without hot entries")
+	}
+}
@@ -0,0 +1,541 @@
+// Analyze the layout of nsscash files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"math"
+	"sort"
+	"strings"
+	"time"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+// Sizes used to estimate the memory accessed per lookup
+const (
+	pageSize      = 4096
+	cacheLineSize = 64
+)
+
+// Maximum number of entries used to estimate the memory accessed by lookups
+const inspectSamples = 10000
+
+// Number of candidates compared linearly at the end of the search of the
+// NSS module, see LINEAR_COUNT in nss/search.c
+const inspectLinearCount = 4
+
+// Warn about entries which use more than this fraction of the limit of the
+// basic format (the converter fails or switches to the large format)
+const inspectLimitWarning = 0.8
+
+// inspectEntry describes a single passwd or group entry in a file.
+type inspectEntry struct {
+	name     string
+	id       uint64
+	offset   uint64 // relative to the data section
+	size     uint64 // header and data (without padding)
+	dataSize uint64
+	members  uint64 // group only
+}
+
+// mainInspect prints the header, the size of the sections and indices, the
+// distribution of entry sizes and the largest entries of the passwd or group
+// file at path. It then estimates the memory accessed by lookups and runs a
+// benchmark with repeat lookups (with the Go reader). Combined files are
+// inspected with the section of the given type.
+func mainInspect(w io.Writer, typ, path string, repeat int) error {
+	var t FileType
+	err := t.UnmarshalText([]byte(typ))
+	if err != nil {
+		return err
+	}
+	if t != FileTypePasswd && t != FileTypeGroup {
+		return fmt.Errorf("unsupported file type %v", t)
+	}
+
+	x, err := ioutil.ReadFile(path)
+	if err != nil {
+		return err
+	}
+	if repeat <= 0 {
+		repeat = 100000
+	}
+	err = inspectFile(w, t, x, repeat)
+	if err != nil {
+		return fmt.Errorf("%s: %v", path, err)
+	}
+	return nil
+}
+
+func inspectFile(w io.Writer, t FileType, x []byte, repeat int) error {
+	le := binary.LittleEndian
+
+	if len(x) < headerSize || string(x[:8]) != "NSS-CASH" {
+		return fmt.Errorf("invalid magic")
+	}
+	version := le.Uint64(x[8:])
+	count := le.Uint64(x[16:])
+	offOrig := le.Uint64(x[24:])
+	offId := le.Uint64(x[32:])
+	offName := le.Uint64(x[40:])
+	offData := le.Uint64(x[48:])
+	data := x[headerSize:]
+	if offOrig > offId || offId > offName || offName > offData ||
+		offData > uint64(len(data)) {
+		return fmt.Errorf("invalid header")
+	}
+
+	fmt.Fprintf(w, "size: %d bytes (%d pages)\n",
+		len(x), pages(uint64(len(x))))
+	fmt.Fprintf(w, "version: %d, features: %s\n",
+		version&(1<<32-1), featureNames(version))
+	fmt.Fprintf(w, "count: %d\n", count)
+
+	// Version 2 files start with the section table
+	var sections [][]byte
+	if version&(1<<32-1) == SectionVersion {
+		if len(data) < 8 ||
+			le.Uint64(data) > uint64(len(data)-8)/sectionSize {
+			return fmt.Errorf("invalid section table")
+		}
+		n := le.Uint64(data)
+		fmt.Fprintf(w, "sections: %d\n", n)
+		for i := uint64(0); i < n; i++ {
+			s := data[8+i*sectionSize:]
+			typ := le.Uint32(s)
+			off := le.Uint64(s[8:])
+			length := le.Uint64(s[16:])
+			if off > uint64(len(data)) ||
+				uint64(len(data))-off < length {
+				return fmt.Errorf("invalid section %d", i)
+			}
+			fmt.Fprintf(w, "  %s: offset %d, %d bytes, flags %#x\n",
+				sectionName(typ), headerSize+off, length,
+				le.Uint32(s[4:]))
+			if version&FeatureCombined != 0 &&
+				typ == sectionOfType(t) {
+				sections = append(sections,
+					data[off:off+length])
+			}
+		}
+	}
+
+	if version&FeatureCombined != 0 {
+		if len(sections) != 1 {
+			return fmt.Errorf("no %s section",
+				sectionName(sectionOfType(t)))
+		}
+		fmt.Fprintf(w, "\n%s section:\n", sectionName(sectionOfType(t)))
+		return inspectFile(w, t, sections[0], repeat)
+	}
+	if version&FeatureSharded != 0 {
+		fmt.Fprintf(w, "sharded file, inspect the shard files instead\n")
+		return nil
+	}
+
+	slot := uint64(8)
+	if version&FeatureIndex32 != 0 {
+		slot = 4
+	}
+	if count > (offId-offOrig)/slot || count > (offName-offId)/slot ||
+		count > (offData-offName)/slot {
+		return fmt.Errorf("invalid header")
+	}
+	fmt.Fprintf(w, "indices: %d bytes each (%d byte slots)\n",
+		count*slot, slot)
+	fmt.Fprintf(w, "data: offset %d, %d bytes\n",
+		headerSize+offData, uint64(len(data))-offData)
+
+	entries, err := inspectEntries(t, version, data, offOrig, offData,
+		count, slot)
+	if err != nil {
+		return err
+	}
+	if len(entries) == 0 {
+		return nil
+	}
+
+	// Entry size distribution
+	sizes := make([]uint64, len(entries))
+	var total uint64
+	for i, e := range entries {
+		sizes[i] = e.size
+		total += e.size
+	}
+	sort.Slice(sizes, func(i, j int) bool {
+		return sizes[i] < sizes[j]
+	})
+	percentile := func(p int) uint64 {
+		return sizes[(len(sizes)-1)*p/100]
+	}
+	fmt.Fprintf(w, "\nentry size: min %d, avg %d, median %d, "+
+		"p90 %d, p99 %d, max %d bytes\n",
+		sizes[0], total/uint64(len(sizes)), percentile(50),
+		percentile(90), percentile(99), sizes[len(sizes)-1])
+
+	inspectLargest(w, t, entries)
+
+	// Memory accessed per lookup, simulates the search of the NSS module
+	// (DEFINE_LOWER_BOUND() in nss/search.c); the number of steps only
+	// depends on the count
+	steps, linear := 0, count
+	for linear > inspectLinearCount {
+		linear -= linear / 2
+		steps++
+	}
+	fmt.Fprintf(w, "\nsearch depth: %d binary steps, %d linear\n",
+		steps, linear)
+	idIndex := func(i uint64) uint64 {
+		return headerSize + offId + i*slot
+	}
+	nameIndex := func(i uint64) uint64 {
+		return headerSize + offName + i*slot
+	}
+	entryAt := func(index func(uint64) uint64, i uint64) uint64 {
+		p := index(i) - headerSize
+		if slot == 4 {
+			return uint64(le.Uint32(data[p:])) * 8
+		}
+		return le.Uint64(data[p:])
+	}
+	byOffset := make(map[uint64]*inspectEntry)
+	for i := range entries {
+		byOffset[entries[i].offset] = &entries[i]
+	}
+	nameOffset := entries[0].size - entries[0].dataSize // header size
+	base := headerSize + offData
+
+	samples := entries
+	if len(samples) > inspectSamples {
+		samples = nil
+		step := float64(len(entries)) / inspectSamples
+		for i := 0; i < inspectSamples; i++ {
+			samples = append(samples, entries[int(float64(i)*step)])
+		}
+	}
+	for _, byName := range []bool{false, true} {
+		index := idIndex
+		keyOffset := uint64(0)
+		if byName {
+			index = nameIndex
+			keyOffset = nameOffset
+		}
+
+		var sumPages, sumLines, maxPages, maxLines int
+		for _, e := range samples {
+			var acc memoryAccess
+			// load returns the entry offset stored in slot i
+			load := func(i uint64) uint64 {
+				acc.add(index(i), slot)
+				return entryAt(index, i)
+			}
+			var err error
+			less := func(p uint64) bool {
+				if !byName {
+					acc.add(base+p, 8)
+					return le.Uint64(data[offData+p:]) < e.id
+				}
+				x := byOffset[p]
+				if x == nil {
+					err = fmt.Errorf("invalid index")
+					return false
+				}
+				acc.add(base+p+nameOffset, uint64(len(x.name))+1)
+				return x.name < e.name
+			}
+
+			lo, n := uint64(0), count
+			var probe uint64
+			if n > inspectLinearCount {
+				probe = load(n / 2)
+			}
+			for n > inspectLinearCount {
+				half := n / 2
+				next := (n - half) / 2
+				next2 := (n - half - next) / 2
+				for _, x := range []uint64{next2, next + next2,
+					half + next2, half + next + next2} {
+					acc.add(index(lo+x), slot) // prefetch
+				}
+				pLo := load(lo + next)
+				pHi := load(lo + half + next)
+				acc.add(base+pLo+keyOffset, 1) // prefetch
+				acc.add(base+pHi+keyOffset, 1)
+				if less(probe) {
+					lo += half
+					probe = pHi
+				} else {
+					probe = pLo
+				}
+				n -= half
+			}
+			for i := uint64(0); i < n; i++ {
+				less(load(lo + i))
+			}
+			if err != nil {
+				return err
+			}
+			// The entry is copied completely
+			acc.add(base+e.offset, e.size)
+
+			sumPages += len(acc.pages)
+			sumLines += len(acc.lines)
+			if len(acc.pages) > maxPages {
+				maxPages = len(acc.pages)
+			}
+			if len(acc.lines) > maxLines {
+				maxLines = len(acc.lines)
+			}
+		}
+		key := "id"
+		if byName {
+			key = "name"
+		}
+		fmt.Fprintf(w, "lookup by %s: %.1f pages (max %d), "+
+			"%.1f cache lines (max %d)\n", key,
+			float64(sumPages)/float64(len(samples)), maxPages,
+			float64(sumLines)/float64(len(samples)), maxLines)
+	}
+
+	return inspectBenchmark(w, t, x, entries, repeat)
+}
+
+// inspectEntries parses all entries of a passwd or group file.
+func inspectEntries(t FileType, version uint64, data []byte, offOrig, offData, count, slot uint64) ([]inspectEntry, error) {
+	le := binary.LittleEndian
+
+	var hdr uint64
+	if t == FileTypePasswd {
+		hdr = 26 // struct passwd_entry
+		if version&FeatureStringTable != 0 {
+			hdr = 34 // struct passwd_entry_compact
+		}
+	} else {
+		hdr = 16 // struct group_entry
+		if version&(FeatureMemberTable|FeatureLargeGroups) != 0 {
+			hdr = 24 // struct group_entry_large/_compact
+		}
+	}
+
+	res := make([]inspectEntry, count)
+	for i := range res {
+		var off uint64
+		if slot == 4 {
+			off = uint64(le.Uint32(data[offOrig+uint64(i)*4:])) * 8
+		} else {
+			off = le.Uint64(data[offOrig+uint64(i)*8:])
+		}
+		if off > uint64(len(data))-offData ||
+			uint64(len(data))-offData-off < hdr {
+			return nil, fmt.Errorf("invalid entry %d", i)
+		}
+		e := data[offData+off:]
+
+		var size, members uint64
+		if hdr == 16 {
+			members = uint64(le.Uint16(e[12:]))
+			size = uint64(le.Uint16(e[14:]))
+		} else if hdr == 24 {
+			members = uint64(le.Uint32(e[16:]))
+			size = uint64(le.Uint32(e[20:]))
+		} else {
+			size = uint64(le.Uint16(e[hdr-2:]))
+		}
+		if uint64(len(e))-hdr < size {
+			return nil, fmt.Errorf("invalid entry %d", i)
+		}
+		name := e[hdr : hdr+size]
+		if n := bytes.IndexByte(name, 0); n >= 0 {
+			name = name[:n]
+		}
+
+		res[i] = inspectEntry{
+			name:     string(name),
+			id:       le.Uint64(e),
+			offset:   off,
+			size:     hdr + size,
+			dataSize: size,
+			members:  members,
+		}
+	}
+	return res, nil
+}
+
+// inspectLargest prints the largest entries (and for groups the ones with
+// the most members) and warns about entries which are close to the limits
+// of the basic format.
+func inspectLargest(w io.Writer, t FileType, entries []inspectEntry) {
+	top := func(key func(e inspectEntry) uint64) []inspectEntry {
+		res := make([]inspectEntry, len(entries))
+		copy(res, entries)
+		sort.SliceStable(res, func(i, j int) bool {
+			return key(res[i]) > key(res[j])
+		})
+		if len(res) > 5 {
+			res = res[:5]
+		}
+		return res
+	}
+	warn := func(usage float64) {
+		if usage >= inspectLimitWarning {
+			fmt.Fprintf(w, " WARNING: close to the limit")
+		}
+		fmt.Fprintf(w, "\n")
+	}
+
+	fmt.Fprintf(w, "largest entries (data size of %d permitted "+
+		"in the basic format):\n", math.MaxUint16)
+	for _, e := range top(func(e inspectEntry) uint64 {
+		return e.dataSize
+	}) {
+		usage := float64(e.dataSize) / math.MaxUint16
+		fmt.Fprintf(w, "  %s: %d bytes (%.1f%%)", e.name, e.dataSize,
+			usage*100)
+		if t == FileTypeGroup {
+			fmt.Fprintf(w, ", %d members", e.members)
+		}
+		warn(usage)
+	}
+
+	if t != FileTypeGroup {
+		return
+	}
+	// mem_count of struct group_entry is an uint16_t as well
+	fmt.Fprintf(w, "most members (%d permitted in the basic format):\n",
+		math.MaxUint16)
+	for _, e := range top(func(e inspectEntry) uint64 {
+		return e.members
+	}) {
+		usage := float64(e.members) / math.MaxUint16
+		fmt.Fprintf(w, "  %s: %d members (%.1f%%)", e.name, e.members,
+			usage*100)
+		warn(usage)
+	}
+}
+
+// inspectBenchmark performs repeat lookups of all entries by name and by id
+// with the Go reader.
+func inspectBenchmark(w io.Writer, t FileType, x []byte, entries []inspectEntry, repeat int) error {
+	f, err := reader.New(x)
+	if err != nil {
+		return err
+	}
+
+	fmt.Fprintf(w, "\nbenchmark (Go reader, %d lookups):\n", repeat)
+	for _, byName := range []bool{false, true} {
+		start := time.Now()
+		for i := 0; i < repeat; i++ {
+			e := &entries[i%len(entries)]
+			var ok bool
+			if t == FileTypePasswd && byName {
+				_, ok = f.PasswdByName(e.name)
+			} else if t == FileTypePasswd {
+				_, ok = f.PasswdByUid(e.id)
+			} else if byName {
+				_, ok = f.GroupByName(e.name)
+			} else {
+				_, ok = f.GroupByGid(e.id)
+			}
+			if !ok {
+				return fmt.Errorf("lookup of %q failed", e.name)
+			}
+		}
+		d := time.Since(start)
+		key := "id"
+		if byName {
+			key = "name"
+		}
+		fmt.Fprintf(w, "lookup by %s: %v per lookup\n",
+			key, d/time.Duration(repeat))
+	}
+	return nil
+}
+
+// memoryAccess collects the pages and cache lines accessed by a lookup.
+type memoryAccess struct {
+	pages map[uint64]bool
+	lines map[uint64]bool
+}
+
+func (m *memoryAccess) add(offset, size uint64) {
+	if m.pages == nil {
+		m.pages = make(map[uint64]bool)
+		m.lines = make(map[uint64]bool)
+	}
+	if size == 0 {
+		size = 1
+	}
+	for x := offset / pageSize; x <= (offset+size-1)/pageSize; x++ {
+		m.pages[x] = true
+	}
+	for x := offset / cacheLineSize; x <= (offset+size-1)/cacheLineSize; x++ {
+		m.lines[x] = true
+	}
+}
+
+// pages returns the number of pages required to store size bytes.
+func pages(size uint64) uint64 {
+	return (size + pageSize - 1) / pageSize
+}
+
+func featureNames(version uint64) string {
+	names := []string{
+		"string-table",
+		"member-table",
+		"large-groups",
+		"index32",
+		"sharded",
+		"combined",
+		"implicit-upg",
+		"table",
+	}
+	var res []string
+	for i, x := range names {
+		if version&(FeatureStringTable<<uint(i)) != 0 {
+			res = append(res, x)
+		}
+	}
+	if len(res) == 0 {
+		return "none"
+	}
+	return strings.Join(res, ", ")
+}
+
+func sectionName(typ uint32) string {
+	switch typ {
+	case SectionPasswd:
+		return "passwd"
+	case SectionGroup:
+		return "group"
+	case SectionHot:
+		return "hot"
+	}
+	return fmt.Sprintf("type %d", typ)
+}
+
+func sectionOfType(t FileType) uint32 {
+	if t == FileTypePasswd {
+		return SectionPasswd
+	}
+	return SectionGroup
+}
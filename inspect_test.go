@@ -0,0 +1,207 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"strings"
+	"testing"
+)
+
+func TestInspect(t *testing.T) {
+	var pws []Passwd
+	for i := 0; i < 100; i++ {
+		pws = append(pws, Passwd{
+			Name:  strings.Repeat("u", i%10+1) + string(rune('a'+i%26)),
+			Uid:   uint64(1000 + i),
+			Gid:   100,
+			Dir:   "/home/user",
+			Shell: "/bin/sh",
+		})
+	}
+	// Uniqueness of names
+	for i := range pws {
+		pws[i].Name += strings.Repeat("x", i/26)
+	}
+	var mems []string
+	for i := 0; i < 5000; i++ {
+		mems = append(mems, "member-"+strings.Repeat("m", 3))
+	}
+	grs := []Group{
+		{Name: "root", Passwd: "x", Gid: 0},
+		{Name: "large", Passwd: "x", Gid: 1, Members: mems},
+	}
+
+	var passwd, passwdCompact, group, groupCompact, sharded bytes.Buffer
+	err := SerializePasswds(&passwd, pws, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = SerializePasswds(&passwdCompact, pws, SerializeOptions{
+		Compact: true,
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = SerializeGroups(&group, grs, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = SerializeGroups(&groupCompact, grs, SerializeOptions{
+		Compact: true,
+		Hot:     []string{"root"},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	// Exceeds the basic format, close to its member count limit
+	var many bytes.Buffer
+	err = SerializeGroups(&many, []Group{
+		{Name: "many", Passwd: "x", Gid: 2,
+			Members: strings.Split(strings.Repeat("m,", 59999)+"m", ",")},
+	}, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	_, err = SerializeGroupShards(&sharded, grs, 2, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	combined, err := SerializeCombined(passwd.Bytes(), group.Bytes())
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	tests := []struct {
+		typ  FileType
+		x    []byte
+		exps []string
+		err  string
+	}{
+		{
+			FileTypePasswd,
+			passwd.Bytes(),
+			[]string{
+				"version: 1, features: none\n",
+				"count: 100\n",
+				"indices: 800 bytes each (8 byte slots)\n",
+				"search depth: 5 binary steps, 4 linear\n",
+				"lookup by id: ",
+				"lookup by name: ",
+				"benchmark (Go reader, 10 lookups):\n",
+			},
+			"",
+		},
+		{
+			FileTypePasswd,
+			passwdCompact.Bytes(),
+			[]string{
+				"features: string-table, index32\n",
+				"indices: 400 bytes each (4 byte slots)\n",
+			},
+			"",
+		},
+		{
+			FileTypeGroup,
+			group.Bytes(),
+			[]string{
+				"count: 2\n",
+				"  large: 65008 bytes (99.2%), 5000 members WARNING: close to the limit\n",
+				"  root: 8 bytes (0.0%), 0 members\n",
+				"most members (65535 permitted in the basic format):\n" +
+					"  large: 5000 members (7.6%)\n" +
+					"  root: 0 members (0.0%)\n",
+			},
+			"",
+		},
+		{
+			FileTypeGroup,
+			many.Bytes(),
+			[]string{
+				"features: large-groups\n",
+				"  many: 60000 members (91.6%) WARNING: close to the limit\n",
+			},
+			"",
+		},
+		{
+			FileTypeGroup,
+			groupCompact.Bytes(),
+			[]string{
+				"version: 2, features: member-table, index32\n",
+				"sections: 1\n  hot: offset 88, ",
+			},
+			"",
+		},
+		{
+			FileTypeGroup,
+			combined,
+			[]string{
+				"features: combined\n",
+				"  passwd: offset 112, ",
+				"\ngroup section:\n",
+				"  large: 65008 bytes",
+			},
+			"",
+		},
+		{
+			FileTypeGroup,
+			sharded.Bytes(),
+			[]string{
+				"features: sharded\n",
+				"sharded file, inspect the shard files instead\n",
+			},
+			"",
+		},
+		{
+			FileTypeGroup,
+			[]byte("NSS-CASX"),
+			nil,
+			"invalid magic",
+		},
+	}
+
+	for n, tc := range tests {
+		var w bytes.Buffer
+		err := inspectFile(&w, tc.typ, tc.x, 10)
+		if tc.err != "" {
+			mustBeErrorWithSubstring(t, err, tc.err)
+			continue
+		}
+		if err != nil {
+			t.Errorf("%d: %v", n, err)
+			continue
+		}
+		for _, exp := range tc.exps {
+			if !strings.Contains(w.String(), exp) {
+				t.Errorf("%d: %q missing in:\n%s", n, exp, w.String())
+			}
+		}
+	}
+}
+
+func TestMemoryAccess(t *testing.T) {
+	var m memoryAccess
+	m.add(0, 8)
+	m.add(60, 8)   // crosses a cache line
+	m.add(4090, 8) // crosses a page
+	m.add(100, 0)
+	if len(m.pages) != 2 {
+		t.Errorf("pages: got %d, want 2", len(m.pages))
+	}
+	if len(m.lines) != 4 {
+		t.Errorf("lines: got %d, want 4", len(m.lines))
+	}
+}
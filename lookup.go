@@ -0,0 +1,185 @@
+// Look up entries in nsscash files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"fmt"
+	"io"
+	"os"
+	"strconv"
+	"strings"
+	"time"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+// mainLookup prints the entries for keys (uids/gids or names) of the
+// nsscash file at path in the format of the original file, for tables see
+// mainLookupTable(). All entries are
+// printed if no keys are given. With repeat > 0 each lookup is performed
+// repeat times and the average duration is printed to stderr.
+func mainLookup(w io.Writer, typ, path string, keys []string, repeat int) error {
+	var t FileType
+	err := t.UnmarshalText([]byte(typ))
+	if err != nil {
+		return err
+	}
+	if t == FileTypeTable {
+		return mainLookupTable(w, path, keys, repeat)
+	}
+	if t != FileTypePasswd && t != FileTypeGroup {
+		return fmt.Errorf("unsupported file type %v", t)
+	}
+
+	f, err := reader.Open(path)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	if len(keys) == 0 {
+		for i := 0; i < f.Len(); i++ {
+			if t == FileTypePasswd {
+				p, _ := f.Passwd(i)
+				writePasswd(w, p)
+			} else {
+				g, _ := f.Group(i)
+				writeGroup(w, g)
+			}
+		}
+		return nil
+	}
+
+	for _, k := range keys {
+		id, err := strconv.ParseUint(k, 10, 64)
+		isId := err == nil
+
+		lookup := func(out io.Writer) bool {
+			if t == FileTypePasswd {
+				var p reader.Passwd
+				var ok bool
+				if isId {
+					p, ok = f.PasswdByUid(id)
+				} else {
+					p, ok = f.PasswdByName(k)
+				}
+				if ok && out != nil {
+					writePasswd(out, p)
+				}
+				return ok
+			}
+			var g reader.Group
+			var ok bool
+			if isId {
+				g, ok = f.GroupByGid(id)
+			} else {
+				g, ok = f.GroupByName(k)
+			}
+			if ok && out != nil {
+				writeGroup(out, g)
+			}
+			return ok
+		}
+
+		if !lookup(w) {
+			return fmt.Errorf("%q not found", k)
+		}
+		if repeat > 0 {
+			start := time.Now()
+			for i := 0; i < repeat; i++ {
+				lookup(nil)
+			}
+			d := time.Since(start)
+			fmt.Fprintf(os.Stderr, "%s: %v per lookup\n",
+				k, d/time.Duration(repeat))
+		}
+	}
+	return nil
+}
+
+// mainLookupTable prints the rows of the table at path matching keys
+// ("column=value", the column must be indexed) like mainLookup(). All rows
+// are printed if no keys are given.
+func mainLookupTable(w io.Writer, path string, keys []string, repeat int) error {
+	t, err := reader.OpenTable(path)
+	if err != nil {
+		return err
+	}
+	defer t.Close()
+
+	if len(keys) == 0 {
+		for i := 0; i < t.Len(); i++ {
+			row, err := t.Row(i)
+			if err != nil {
+				return err
+			}
+			writeTableRow(w, row)
+		}
+		return nil
+	}
+
+	for _, k := range keys {
+		i := strings.IndexByte(k, '=')
+		if i < 0 {
+			return fmt.Errorf("invalid key %q, expected column=value",
+				k)
+		}
+		column, value := k[:i], k[i+1:]
+
+		rows, err := t.Lookup(column, value)
+		if err != nil {
+			return err
+		}
+		if len(rows) == 0 {
+			return fmt.Errorf("%q not found", k)
+		}
+		for _, row := range rows {
+			writeTableRow(w, row)
+		}
+		if repeat > 0 {
+			start := time.Now()
+			for i := 0; i < repeat; i++ {
+				t.Lookup(column, value)
+			}
+			d := time.Since(start)
+			fmt.Fprintf(os.Stderr, "%s: %v per lookup\n",
+				k, d/time.Duration(repeat))
+		}
+	}
+	return nil
+}
+
+func writePasswd(w io.Writer, p reader.Passwd) {
+	fmt.Fprintf(w, "%s:%s:%d:%d:%s:%s:%s\n",
+		p.Name, p.Passwd, p.Uid, p.Gid, p.Gecos, p.Dir, p.Shell)
+}
+
+func writeGroup(w io.Writer, g reader.Group) {
+	fmt.Fprintf(w, "%s:%s:%d:", g.Name, g.Passwd, g.Gid)
+	for i := 0; i < g.MemberCount(); i++ {
+		if i > 0 {
+			fmt.Fprint(w, ",")
+		}
+		fmt.Fprintf(w, "%s", g.Member(i))
+	}
+	fmt.Fprint(w, "\n")
+}
+
+func writeTableRow(w io.Writer, row []string) {
+	fmt.Fprintf(w, "%s\n", strings.Join(row, ":"))
+}
@@ -0,0 +1,306 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func mustConvert(t *testing.T, typ, src string, opts SerializeOptions) string {
+	dir, err := ioutil.TempDir("", "nsscash")
+	if err != nil {
+		t.Fatal(err)
+	}
+	dst := filepath.Join(dir, typ+".nsscash")
+	err = mainConvert(typ, src, dst, TableSchema{}, opts)
+	if err != nil {
+		t.Fatal(err)
+	}
+	return dst
+}
+
+func TestLookupPasswd(t *testing.T) {
+	for _, compact := range []bool{false, true} {
+		testLookupPasswd(t, SerializeOptions{
+			Compact: compact,
+		})
+	}
+}
+
+func testLookupPasswd(t *testing.T, opts SerializeOptions) {
+	src := "nss/tests/passwd"
+	path := mustConvert(t, "passwd", src, opts)
+	defer os.RemoveAll(filepath.Dir(path))
+
+	orig, err := ioutil.ReadFile(src)
+	if err != nil {
+		t.Fatal(err)
+	}
+	pws, err := ParsePasswds(bytes.NewReader(orig))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// Iteration reproduces the original file
+	var buf bytes.Buffer
+	err = mainLookup(&buf, "passwd", path, nil, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(buf.Bytes(), orig) {
+		t.Errorf("got %q, want %q", buf.String(), string(orig))
+	}
+
+	f, err := reader.Open(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+
+	if f.Len() != len(pws) {
+		t.Errorf("len: got %d, want %d", f.Len(), len(pws))
+	}
+	for _, x := range pws {
+		p, ok := f.PasswdByName(x.Name)
+		if !ok || p.Uid != x.Uid || string(p.Shell) != x.Shell {
+			t.Errorf("name %q: got %v %v", x.Name, p, ok)
+		}
+		p, ok = f.PasswdByUid(x.Uid)
+		if !ok || string(p.Name) != x.Name || string(p.Dir) != x.Dir {
+			t.Errorf("uid %d: got %v %v", x.Uid, p, ok)
+		}
+	}
+	_, ok := f.PasswdByName("does-not-exist")
+	if ok {
+		t.Errorf("found non-existent name")
+	}
+	_, ok = f.PasswdByUid(12)
+	if ok {
+		t.Errorf("found non-existent uid")
+	}
+	_, ok = f.Passwd(f.Len())
+	if ok {
+		t.Errorf("found entry after end")
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		f.PasswdByName("systemd-coredump")
+		f.PasswdByUid(65534)
+		f.Passwd(3)
+	})
+	if allocs != 0 {
+		t.Errorf("lookups allocated %v times", allocs)
+	}
+
+	buf.Reset()
+	err = mainLookup(&buf, "passwd", path, []string{"www-data", "0"}, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	exp := "www-data:x:33:33:www-data:/var/www:/usr/sbin/nologin\n" +
+		"root:x:0:0:root:/root:/bin/bash\n"
+	if buf.String() != exp {
+		t.Errorf("got %q, want %q", buf.String(), exp)
+	}
+	err = mainLookup(&buf, "passwd", path, []string{"12"}, 0)
+	mustBeErrorWithSubstring(t, err, `"12" not found`)
+}
+
+func TestLookupGroup(t *testing.T) {
+	for _, compact := range []bool{false, true} {
+		testLookupGroup(t, SerializeOptions{
+			Compact: compact,
+		})
+	}
+}
+
+func testLookupGroup(t *testing.T, opts SerializeOptions) {
+	src := "nss/tests/group"
+	path := mustConvert(t, "group", src, opts)
+	defer os.RemoveAll(filepath.Dir(path))
+
+	orig, err := ioutil.ReadFile(src)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	var buf bytes.Buffer
+	err = mainLookup(&buf, "group", path, nil, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(buf.Bytes(), orig) {
+		t.Errorf("got %q, want %q", buf.String(), string(orig))
+	}
+
+	f, err := reader.Open(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+
+	g, ok := f.GroupByName("daemon")
+	if !ok || g.Gid != 1 || g.MemberCount() != 5 ||
+		string(g.Member(4)) != "baal" {
+		t.Errorf("got %v %v", g, ok)
+	}
+	_, ok = f.GroupByGid(14)
+	if ok {
+		t.Errorf("found non-existent gid")
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		g, _ := f.GroupByName("daemon")
+		g.Member(0)
+		f.GroupByGid(1)
+	})
+	if allocs != 0 {
+		t.Errorf("lookups allocated %v times", allocs)
+	}
+
+	buf.Reset()
+	err = mainLookup(&buf, "group", path, []string{"1"}, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	exp := "daemon:x:1:andariel,duriel,mephisto,diablo,baal\n"
+	if buf.String() != exp {
+		t.Errorf("got %q, want %q", buf.String(), exp)
+	}
+
+	err = mainLookup(&buf, "services", path, nil, 0)
+	mustBeErrorWithSubstring(t, err, "unsupported file type")
+}
+
+func TestLookupDuplicateIds(t *testing.T) {
+	// Like the NSS module the first entry in the id index is returned,
+	// i.e. the first one in the original file
+	pws, err := ParsePasswds(strings.NewReader(
+		"root:x:0:0:root:/root:/bin/bash\n" +
+			"toor:x:0:0:root:/root:/bin/sh\n" +
+			"daemon:x:1:1:daemon:/usr/sbin:/usr/sbin/nologin\n"))
+	if err != nil {
+		t.Fatal(err)
+	}
+	grs, err := ParseGroups(strings.NewReader(
+		"root:x:0:\n" +
+			"wheel:x:0:root\n" +
+			"daemon:x:1:\n"))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	for _, compact := range []bool{false, true} {
+		opts := SerializeOptions{
+			Compact: compact,
+		}
+		var x, y bytes.Buffer
+		err := SerializePasswds(&x, pws, opts)
+		if err != nil {
+			t.Fatal(err)
+		}
+		err = SerializeGroups(&y, grs, opts)
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		f, err := reader.New(x.Bytes())
+		if err != nil {
+			t.Fatal(err)
+		}
+		p, ok := f.PasswdByUid(0)
+		if !ok || string(p.Name) != "root" {
+			t.Errorf("compact %v: uid 0: got %q %v",
+				compact, p.Name, ok)
+		}
+		p, ok = f.PasswdByName("toor")
+		if !ok || string(p.Shell) != "/bin/sh" {
+			t.Errorf("compact %v: toor: got %q %v",
+				compact, p.Shell, ok)
+		}
+
+		f, err = reader.New(y.Bytes())
+		if err != nil {
+			t.Fatal(err)
+		}
+		g, ok := f.GroupByGid(0)
+		if !ok || string(g.Name) != "root" {
+			t.Errorf("compact %v: gid 0: got %q %v",
+				compact, g.Name, ok)
+		}
+		_, ok = f.GroupByGid(2)
+		if ok {
+			t.Errorf("compact %v: found non-existent gid", compact)
+		}
+	}
+}
+
+func TestLookupTable(t *testing.T) {
+	dir, err := ioutil.TempDir("", "nsscash")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "table.nsscash")
+	err = mainConvert("table", "nss/tests/table", path, TableSchema{
+		Columns:    []string{"key", "options", "location"},
+		Index:      []string{"key"},
+		MultiIndex: []string{"options"},
+	}, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// Iteration prints all rows (without comments)
+	var buf bytes.Buffer
+	err = mainLookup(&buf, "table", path, nil, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	exp := "home:-rw,hard:nfs1:/export/home\n" +
+		"data:-ro:nfs2:/export/data\n" +
+		"scratch:-rw,hard:nfs1:/export/scratch\n"
+	if buf.String() != exp {
+		t.Errorf("got %q, want %q", buf.String(), exp)
+	}
+
+	buf.Reset()
+	err = mainLookup(&buf, "table", path,
+		[]string{"key=data", "options=-rw,hard"}, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	exp = "data:-ro:nfs2:/export/data\n" +
+		"home:-rw,hard:nfs1:/export/home\n" +
+		"scratch:-rw,hard:nfs1:/export/scratch\n"
+	if buf.String() != exp {
+		t.Errorf("got %q, want %q", buf.String(), exp)
+	}
+
+	err = mainLookup(&buf, "table", path, []string{"key=nope"}, 0)
+	mustBeErrorWithSubstring(t, err, `"key=nope" not found`)
+	err = mainLookup(&buf, "table", path, []string{"location=/"}, 0)
+	mustBeErrorWithSubstring(t, err, `column "location" is not indexed`)
+	err = mainLookup(&buf, "table", path, []string{"home"}, 0)
+	mustBeErrorWithSubstring(t, err, "expected column=value")
+}
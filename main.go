@@ -25,15 +25,54 @@ import (
 	"log"
 	"os"
 	"path/filepath"
+	"strconv"
 
 	"github.com/google/renameio"
 )
 
 func main() {
+	// Only used by "convert table"
+	columns := flag.String("columns", "",
+		"comma-separated column names of a table")
+	index := flag.String("index", "",
+		"comma-separated columns of a table with unique values to index")
+	multiIndex := flag.String("multiindex", "",
+		"comma-separated columns of a table with non-unique values to index")
+
+	// Only used by "convert passwd" and "convert group"
+	compact := flag.Bool("compact", false,
+		"use compact format (requires an updated NSS module)")
+	shards := flag.Int("shards", 0,
+		"split into n shards (requires an updated NSS module)")
+	hot := flag.String("hot", "",
+		"comma-separated names of entries to store in a hot-entry section")
+	counters := flag.String("counters", "",
+		"path of lookup counters to store frequently used entries together")
+	// Only used by "convert group"
+	implicitUPG := flag.String("implicitupg", "",
+		"omit the user private groups of this passwd file (requires an updated NSS module)")
+	// Only used by "lookup" and "inspect"
+	repeat := flag.Int("repeat", 0,
+		"repeat each lookup n times and print the average duration")
+	// Profiling of nsscash itself
+	cpuProfile := flag.String("cpuprofile", "",
+		"write a CPU profile to this file")
+	memProfile := flag.String("memprofile", "",
+		"write a heap profile to this file before exiting")
+	traceFile := flag.String("trace", "",
+		"write an execution trace to this file")
+	pprofAddr := flag.String("pprof", "",
+		"serve pprof on this loopback address while running (e.g. localhost:6060)")
+
 	flag.Usage = func() {
 		fmt.Fprintf(os.Stderr,
 			"usage: %[1]s [options] fetch <config>\n"+
 				"usage: %[1]s [options] convert <type> <src> <dst>\n"+
+				"usage: %[1]s [options] lookup <type> <path> [<key>...]\n"+
+				"usage: %[1]s [options] inspect <type> <path>\n"+
+				"usage: %[1]s [options] combine <passwd> <group> <dst>\n"+
+				"usage: %[1]s [options] counters <path> [<uid>...]\n"+
+				"usage: %[1]s [options] stats <path>\n"+
 				"",
 			os.Args[0])
 		flag.PrintDefaults()
@@ -46,6 +85,23 @@ func main() {
 		os.Exit(1)
 	}
 
+	stopProfiling, err := startProfiling(*cpuProfile, *memProfile,
+		*traceFile, *pprofAddr)
+	if err != nil {
+		log.Fatal(err)
+	}
+	// log.Fatal() doesn't run deferred functions
+	fatal := func(err error) {
+		stopProfiling()
+		log.Fatal(err)
+	}
+	defer func() {
+		err := stopProfiling()
+		if err != nil {
+			log.Fatal(err)
+		}
+	}()
+
 	switch args[0] {
 	case "fetch":
 		if len(args) != 2 {
@@ -54,7 +110,7 @@ func main() {
 
 		err := mainFetch(args[1])
 		if err != nil {
-			log.Fatal(err)
+			fatal(err)
 		}
 		return
 
@@ -63,13 +119,105 @@ func main() {
 			break
 		}
 
-		err := mainConvert(args[1], args[2], args[3])
+		schema := TableSchema{
+			Columns:    splitList(*columns),
+			Index:      splitList(*index),
+			MultiIndex: splitList(*multiIndex),
+		}
+		counts, err := LoadCounters(*counters)
 		if err != nil {
-			log.Fatal(err)
+			fatal(err)
+		}
+		opts := SerializeOptions{
+			Compact: *compact,
+			Shards:  *shards,
+			Hot:     splitList(*hot),
+			Counts:  counts,
+		}
+		if *implicitUPG != "" {
+			opts.ImplicitUPG = true
+			opts.UPGPasswds, err = parsePasswdFile(*implicitUPG)
+			if err != nil {
+				fatal(err)
+			}
+		}
+		err = mainConvert(args[1], args[2], args[3], schema, opts)
+		if err != nil {
+			fatal(err)
+		}
+		return
+
+	case "combine":
+		if len(args) != 4 {
+			break
+		}
+
+		err := mainCombine(args[1], args[2], args[3])
+		if err != nil {
+			fatal(err)
+		}
+		return
+
+	case "counters":
+		if len(args) < 2 {
+			break
+		}
+
+		uids := []int{os.Geteuid()}
+		if len(args) > 2 {
+			uids = nil
+			for _, x := range args[2:] {
+				uid, err := strconv.Atoi(x)
+				if err != nil || uid < 0 {
+					fatal(fmt.Errorf("invalid uid %q", x))
+				}
+				uids = append(uids, uid)
+			}
+		}
+		for _, uid := range uids {
+			err := CreateCounters(args[1], uid)
+			if err != nil {
+				fatal(err)
+			}
+		}
+		return
+
+	case "stats":
+		if len(args) != 2 {
+			break
+		}
+
+		err := PrintStats(os.Stdout, args[1])
+		if err != nil {
+			fatal(err)
+		}
+		return
+
+	case "inspect":
+		if len(args) != 3 {
+			break
+		}
+
+		err := mainInspect(os.Stdout, args[1], args[2], *repeat)
+		if err != nil {
+			fatal(err)
+		}
+		return
+
+	case "lookup":
+		if len(args) < 3 {
+			break
+		}
+
+		err := mainLookup(os.Stdout, args[1], args[2], args[3:],
+			*repeat)
+		if err != nil {
+			fatal(err)
 		}
 		return
 	}
 
+	stopProfiling()
 	flag.Usage()
 	os.Exit(1)
 }
@@ -93,10 +241,16 @@ func mainFetch(cfgPath string) error {
 	if err != nil {
 		return err
 	}
+	if cfg.MetricsPath != "" {
+		err = WriteMetrics(cfg.MetricsPath, cfg, state)
+		if err != nil {
+			return err
+		}
+	}
 	return nil
 }
 
-func mainConvert(typ, srcPath, dstPath string) error {
+func mainConvert(typ, srcPath, dstPath string, schema TableSchema, opts SerializeOptions) error {
 	var t FileType
 	err := t.UnmarshalText([]byte(typ))
 	if err != nil {
@@ -108,6 +262,7 @@ func mainConvert(typ, srcPath, dstPath string) error {
 		return err
 	}
 	var x bytes.Buffer
+	var shards []Shard
 	if t == FileTypePlain {
 		x.Write(src)
 	} else if t == FileTypePasswd {
@@ -115,7 +270,12 @@ func mainConvert(typ, srcPath, dstPath string) error {
 		if err != nil {
 			return err
 		}
-		err = SerializePasswds(&x, pws)
+		if opts.Shards > 0 {
+			shards, err = SerializePasswdShards(&x, pws,
+				opts.Shards, opts)
+		} else {
+			err = SerializePasswds(&x, pws, opts)
+		}
 		if err != nil {
 			return err
 		}
@@ -124,7 +284,49 @@ func mainConvert(typ, srcPath, dstPath string) error {
 		if err != nil {
 			return err
 		}
-		err = SerializeGroups(&x, grs)
+		if opts.Shards > 0 {
+			shards, err = SerializeGroupShards(&x, grs,
+				opts.Shards, opts)
+		} else {
+			err = SerializeGroups(&x, grs, opts)
+		}
+		if err != nil {
+			return err
+		}
+	} else if t == FileTypeServices {
+		svs, err := ParseServices(bytes.NewReader(src))
+		if err != nil {
+			return err
+		}
+		err = SerializeServices(&x, svs)
+		if err != nil {
+			return err
+		}
+	} else if t == FileTypeProtocols {
+		prs, err := ParseProtocols(bytes.NewReader(src))
+		if err != nil {
+			return err
+		}
+		err = SerializeProtocols(&x, prs)
+		if err != nil {
+			return err
+		}
+	} else if t == FileTypeAuthorizedKeys {
+		aks, err := ParseAuthorizedKeys(bytes.NewReader(src))
+		if err != nil {
+			return err
+		}
+		err = SerializeAuthorizedKeys(&x, aks)
+		if err != nil {
+			return err
+		}
+	} else if t == FileTypeTable {
+		rows, err := ParseTable(bytes.NewReader(src),
+			len(schema.Columns))
+		if err != nil {
+			return err
+		}
+		err = SerializeTable(&x, schema, rows)
 		if err != nil {
 			return err
 		}
@@ -132,6 +334,33 @@ func mainConvert(typ, srcPath, dstPath string) error {
 		return fmt.Errorf("unsupported file type %v", t)
 	}
 
+	// Write the shards before the root file which references them;
+	// existing shards are unchanged as their paths contain the hash of
+	// their content
+	for _, s := range shards {
+		_, err = os.Lstat(dstPath + s.Suffix)
+		if err == nil {
+			continue
+		}
+		err = convertWrite(t, srcPath, dstPath+s.Suffix, s.Body)
+		if err != nil {
+			return err
+		}
+	}
+	err = convertWrite(t, srcPath, dstPath, x.Bytes())
+	if err != nil {
+		return err
+	}
+	if t == FileTypePasswd || t == FileTypeGroup {
+		err = removeStaleShards(dstPath, shards)
+		if err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+func convertWrite(t FileType, srcPath, dstPath string, body []byte) error {
 	// We must create the file first or deployFile() will abort; this is
 	// ugly because deployFile() already performs an atomic replacement
 	// but the simplest solution with the least duplicate code
@@ -145,7 +374,7 @@ func mainConvert(typ, srcPath, dstPath string) error {
 		Type: t,
 		Url:  srcPath,
 		Path: f.Name(),
-		body: x.Bytes(),
+		body: body,
 	})
 	if err != nil {
 		return err
@@ -31,18 +31,22 @@ import (
 	"strings"
 	"testing"
 	"time"
+
+	"ruderich.org/simon/nsscash/reader"
 )
 
 const (
-	configPath  = "testdata/config.toml"
-	statePath   = "testdata/var/state.json"
-	passwdPath  = "testdata/passwd.nsscash"
-	plainPath   = "testdata/plain"
-	groupPath   = "testdata/group.nsscash"
-	tlsCAPath   = "testdata/ca.crt"
-	tlsCertPath = "testdata/server.crt"
-	tlsKeyPath  = "testdata/server.key"
-	tlsCA2Path  = "testdata/ca2.crt"
+	configPath   = "testdata/config.toml"
+	statePath    = "testdata/var/state.json"
+	passwdPath   = "testdata/passwd.nsscash"
+	plainPath    = "testdata/plain"
+	groupPath    = "testdata/group.nsscash"
+	combinedPath = "testdata/combined.nsscash"
+	metricsPath  = "testdata/var/nsscash.prom"
+	tlsCAPath    = "testdata/ca.crt"
+	tlsCertPath  = "testdata/server.crt"
+	tlsKeyPath   = "testdata/server.key"
+	tlsCA2Path   = "testdata/ca2.crt"
 )
 
 type args struct {
@@ -208,6 +212,9 @@ func TestMainFetch(t *testing.T) {
 		fetchGroupInvalid,
 		fetchGroupLimits,
 		fetchGroup,
+		fetchCombined,
+		fetchImplicitUPG,
+		fetchMetrics,
 		// Special tests
 		fetchNoConfig,
 		fetchStateCannotRead,
@@ -249,6 +256,8 @@ func runMainTest(t *testing.T, f func(args), tls *tls.Config) {
 		passwdPath,
 		plainPath,
 		groupPath,
+		combinedPath,
+		metricsPath,
 	}
 
 	// NOTE: This is not guaranteed to work according to reflect's
@@ -653,12 +662,24 @@ func fetchGroupLimits(a args) {
 		fmt.Fprint(w, "\n")
 	}
 
+	// Groups which don't fit in the normal format use 32 bit offsets
 	err := mainFetch(configPath)
-	mustBeErrorWithSubstring(t, err,
-		"group too large to serialize")
+	if err != nil {
+		t.Error(err)
+	}
 
-	mustNotExist(t, statePath, passwdPath, plainPath)
-	mustBeOld(t, groupPath)
+	mustNotExist(t, passwdPath, plainPath)
+	mustBeNew(t, groupPath, statePath)
+
+	f, err := reader.Open(groupPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+	g, ok := f.GroupByGid(0)
+	if !ok || g.MemberCount() != 1 || len(g.Member(0)) != 65536 {
+		t.Errorf("got %v %v", g, ok)
+	}
 }
 
 func fetchGroup(a args) {
@@ -689,6 +710,243 @@ func fetchGroup(a args) {
 	// Remaining functionality already tested in fetchPasswd()
 }
 
+func fetchCombined(a args) {
+	t := a.t
+	mustWriteConfig(t, fmt.Sprintf(`
+statepath = "%[1]s"
+combinedpath = "%[2]s"
+
+[[file]]
+type = "passwd"
+url = "%[3]s/passwd"
+path = "%[4]s"
+ca = "%[6]s"
+warm = true
+
+[[file]]
+type = "group"
+url = "%[3]s/group"
+path = "%[5]s"
+ca = "%[6]s"
+`, statePath, combinedPath, a.url, passwdPath, groupPath, tlsCAPath))
+	mustCreate(t, passwdPath)
+	mustCreate(t, groupPath)
+	mustCreate(t, combinedPath)
+
+	*a.handler = func(w http.ResponseWriter, r *http.Request) {
+		if r.URL.Path == "/passwd" {
+			fmt.Fprintln(w, "root:x:0:0:root:/root:/bin/bash")
+		}
+		if r.URL.Path == "/group" {
+			fmt.Fprintln(w, "root:x:0:")
+		}
+	}
+
+	err := mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+
+	mustNotExist(t, plainPath)
+	mustBeNew(t, passwdPath, groupPath, combinedPath, statePath)
+
+	passwd, err := ioutil.ReadFile(passwdPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+	group, err := ioutil.ReadFile(groupPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+	exp, err := SerializeCombined(passwd, group)
+	if err != nil {
+		t.Fatal(err)
+	}
+	mustHaveHash(t, combinedPath, hashAsHex(exp))
+
+	// Unchanged content doesn't replace the combined file; the content
+	// is verified by the NSS tests
+	mustMakeOld(t, combinedPath)
+	err = mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+	mustBeOld(t, combinedPath)
+}
+
+func fetchImplicitUPG(a args) {
+	t := a.t
+	// The group file is listed first but depends on the passwd file
+	mustWriteConfig(t, fmt.Sprintf(`
+statepath = "%[1]s"
+combinedpath = "%[6]s"
+
+[[file]]
+type = "group"
+url = "%[2]s/group"
+path = "%[4]s"
+ca = "%[5]s"
+implicitupg = true
+
+[[file]]
+type = "passwd"
+url = "%[2]s/passwd"
+path = "%[3]s"
+ca = "%[5]s"
+`, statePath, a.url, passwdPath, groupPath, tlsCAPath, combinedPath))
+	mustCreate(t, passwdPath)
+	mustCreate(t, groupPath)
+	mustCreate(t, combinedPath)
+
+	lastChange := time.Now().Add(-time.Hour)
+	passwd := "root:x:0:0:root:/root:/bin/bash\n" +
+		"daemon:x:1:1:daemon:/usr/sbin:/usr/sbin/nologin\n" +
+		"sync:x:4:65534:sync:/bin:/bin/sync\n"
+	passwdChanged := true
+	*a.handler = func(w http.ResponseWriter, r *http.Request) {
+		if r.Header.Get("If-Modified-Since") != "" &&
+			(r.URL.Path == "/group" || !passwdChanged) {
+			w.WriteHeader(http.StatusNotModified)
+			return
+		}
+		w.Header().Add("Last-Modified",
+			lastChange.UTC().Format(http.TimeFormat))
+		if r.URL.Path == "/passwd" {
+			fmt.Fprint(w, passwd)
+			passwdChanged = false
+		}
+		if r.URL.Path == "/group" {
+			fmt.Fprintln(w, "root:x:0:")
+			fmt.Fprintln(w, "daemon:x:1:")
+			fmt.Fprintln(w, "adm:x:4:")
+		}
+	}
+
+	mustHaveGroups := func(exp ...string) {
+		f, err := reader.Open(groupPath)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer f.Close()
+		if !f.ImplicitUPG() {
+			t.Errorf("implicit user private groups not flagged")
+		}
+		var names []string
+		for i := 0; i < f.Len(); i++ {
+			g, _ := f.Group(i)
+			names = append(names, string(g.Name))
+		}
+		if !reflect.DeepEqual(names, exp) {
+			t.Errorf("got groups %q, want %q", names, exp)
+		}
+	}
+
+	err := mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+	mustBeNew(t, passwdPath, groupPath, combinedPath, statePath)
+	mustHaveGroups("adm")
+
+	// Nothing changed
+	mustMakeOld(t, passwdPath, groupPath, combinedPath)
+	err = mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+	mustBeOld(t, passwdPath, groupPath, combinedPath)
+
+	// A changed passwd file converts the unchanged group file again
+	passwd = "root:x:0:0:root:/root:/bin/bash\n" +
+		"daemon:x:1:4:daemon:/usr/sbin:/usr/sbin/nologin\n"
+	passwdChanged = true
+	err = mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+	mustBeNew(t, passwdPath, groupPath, combinedPath)
+	mustHaveGroups("daemon", "adm")
+}
+
+func fetchMetrics(a args) {
+	t := a.t
+	mustWriteConfig(t, fmt.Sprintf(`
+statepath = "%[1]s"
+metricspath = "%[2]s"
+
+[[file]]
+type = "passwd"
+url = "%[3]s/passwd"
+path = "%[4]s"
+ca = "%[5]s"
+`, statePath, metricsPath, a.url, passwdPath, tlsCAPath))
+	mustCreate(t, passwdPath)
+
+	lastChange := time.Now().Add(-time.Hour).Truncate(time.Second)
+	*a.handler = func(w http.ResponseWriter, r *http.Request) {
+		if r.URL.Path != "/passwd" {
+			return
+		}
+		if r.Header.Get("If-Modified-Since") != "" {
+			w.WriteHeader(http.StatusNotModified)
+			return
+		}
+		w.Header().Add("Last-Modified",
+			lastChange.UTC().Format(http.TimeFormat))
+		fmt.Fprintln(w, "root:x:0:0:root:/root:/bin/bash")
+		fmt.Fprintln(w, "daemon:x:1:1:daemon:/usr/sbin:/usr/sbin/nologin")
+	}
+
+	mustHaveMetrics := func(exps ...string) {
+		x, err := ioutil.ReadFile(metricsPath)
+		if err != nil {
+			t.Fatal(err)
+		}
+		for _, exp := range exps {
+			if !strings.Contains(string(x), exp) {
+				t.Errorf("%q missing in metrics:\n%s", exp, x)
+			}
+		}
+	}
+
+	err := mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+	mustBeNew(t, passwdPath, statePath, metricsPath)
+	fi, err := os.Stat(metricsPath)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if fi.Mode().Perm() != 0644 {
+		t.Errorf("got mode %v, want 0644", fi.Mode().Perm())
+	}
+	label := `{path="` + passwdPath + `"}`
+	mustHaveMetrics(
+		"# TYPE nsscash_phase_seconds gauge\n",
+		`nsscash_phase_seconds{path="`+passwdPath+`",phase="parse"} `,
+		`nsscash_phase_seconds{path="`+passwdPath+`",phase="rename"} `,
+		"nsscash_response_bytes"+label+" 80\n",
+		`nsscash_responses_total{path="`+passwdPath+`",code="200"} 1`+"\n",
+		`nsscash_responses_total{path="`+passwdPath+`",code="304"} 0`+"\n",
+		"nsscash_entries"+label+" 2\n",
+		"nsscash_data_age_seconds"+label+" 3600",
+	)
+
+	t.Log("Not modified")
+
+	err = mainFetch(configPath)
+	if err != nil {
+		t.Error(err)
+	}
+	mustHaveMetrics(
+		"nsscash_response_bytes"+label+" 0\n",
+		`nsscash_responses_total{path="`+passwdPath+`",code="200"} 1`+"\n",
+		`nsscash_responses_total{path="`+passwdPath+`",code="304"} 1`+"\n",
+		"nsscash_entries"+label+" 2\n",
+	)
+}
+
 func fetchNoConfig(a args) {
 	t := a.t
 
@@ -0,0 +1,220 @@
+// Write metrics of the last run for the node_exporter textfile collector
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"os"
+	"path/filepath"
+	"strings"
+	"time"
+
+	"github.com/google/renameio"
+)
+
+// Phases of fetching and deploying a file, see fileMetrics
+type phase int
+
+const (
+	phaseDNS phase = iota
+	phaseConnect
+	phaseTLS
+	phaseTTFB // between sending the request and the first response byte
+	phaseDownload
+	phaseParse
+	phaseSerialize
+	phaseFsync
+	phaseRename
+	phaseCount
+)
+
+var phaseNames = [phaseCount]string{
+	"dns",
+	"connect",
+	"tls",
+	"ttfb",
+	"download",
+	"parse",
+	"serialize",
+	"fsync",
+	"rename",
+}
+
+// fileMetrics are recorded by handleFiles() for each file
+type fileMetrics struct {
+	phases [phaseCount]time.Duration
+	bytes  int64 // size of the response body
+}
+
+// phase adds the time since start to phase p and returns the current time
+// which can be used as start of the next phase.
+func (m *fileMetrics) phase(p phase, start time.Time) time.Time {
+	now := time.Now()
+	m.phases[p] += now.Sub(start)
+	return now
+}
+
+// WriteMetrics writes the metrics of all files in cfg in the Prometheus text
+// format to path (for node_exporter's textfile collector). Like the state
+// file it's only written after successful runs.
+func WriteMetrics(path string, cfg *Config, state *State) error {
+	var x bytes.Buffer
+	now := time.Now()
+
+	writeMetricsHeader(&x, "nsscash_last_success_timestamp_seconds",
+		"gauge", "Time of the last successful run.")
+	fmt.Fprintf(&x, "nsscash_last_success_timestamp_seconds %d\n",
+		now.Unix())
+
+	writeMetricsHeader(&x, "nsscash_phase_seconds", "gauge",
+		"Duration of each phase of fetching and deploying the file "+
+			"in the last run.")
+	for _, f := range cfg.Files {
+		for p, d := range f.metrics.phases {
+			fmt.Fprintf(&x, "nsscash_phase_seconds{path=%s,phase=%q} %g\n",
+				metricsLabel(f.Path), phaseNames[p], d.Seconds())
+		}
+	}
+
+	writeMetricsHeader(&x, "nsscash_response_bytes", "gauge",
+		"Size of the response body in the last run.")
+	for _, f := range cfg.Files {
+		fmt.Fprintf(&x, "nsscash_response_bytes{path=%s} %d\n",
+			metricsLabel(f.Path), f.metrics.bytes)
+	}
+
+	writeMetricsHeader(&x, "nsscash_responses_total", "counter",
+		"Responses by HTTP status code (200 or 304) of successful runs.")
+	for _, f := range cfg.Files {
+		for _, code := range []int{200, 304} {
+			fmt.Fprintf(&x, "nsscash_responses_total{path=%s,code=\"%d\"} %d\n",
+				metricsLabel(f.Path), code,
+				state.Responses[f.Url][code])
+		}
+	}
+
+	writeMetricsHeader(&x, "nsscash_entries", "gauge",
+		"Number of entries in the deployed file (not for type plain).")
+	for _, f := range cfg.Files {
+		if f.Type == FileTypePlain {
+			continue
+		}
+		count, err := fileEntries(f.Path)
+		if err != nil {
+			return err
+		}
+		fmt.Fprintf(&x, "nsscash_entries{path=%s} %d\n",
+			metricsLabel(f.Path), count)
+	}
+
+	writeMetricsHeader(&x, "nsscash_file_bytes", "gauge",
+		"Size of the deployed file including its shards.")
+	for _, f := range cfg.Files {
+		size, err := fileSize(f.Path)
+		if err != nil {
+			return err
+		}
+		fmt.Fprintf(&x, "nsscash_file_bytes{path=%s} %d\n",
+			metricsLabel(f.Path), size)
+	}
+
+	writeMetricsHeader(&x, "nsscash_data_age_seconds", "gauge",
+		"Time since the last modification of the data on the server "+
+			"(if it sends Last-Modified).")
+	for _, f := range cfg.Files {
+		t := state.LastModified[f.Url]
+		if t.IsZero() {
+			continue
+		}
+		fmt.Fprintf(&x, "nsscash_data_age_seconds{path=%s} %g\n",
+			metricsLabel(f.Path), now.Sub(t).Seconds())
+	}
+
+	t, err := renameio.TempFile(filepath.Dir(path), path)
+	if err != nil {
+		return err
+	}
+	defer t.Cleanup()
+	// node_exporter doesn't run as root
+	err = t.Chmod(0644)
+	if err != nil {
+		return err
+	}
+	_, err = t.Write(x.Bytes())
+	if err != nil {
+		return err
+	}
+	err = t.CloseAtomicallyReplace()
+	if err != nil {
+		return err
+	}
+	return syncPath(filepath.Dir(path))
+}
+
+func writeMetricsHeader(w io.Writer, name, typ, help string) {
+	fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, typ)
+}
+
+var metricsLabelReplacer = strings.NewReplacer(
+	`\`, `\\`, `"`, `\"`, "\n", `\n`)
+
+// metricsLabel returns x quoted as label value.
+func metricsLabel(x string) string {
+	return `"` + metricsLabelReplacer.Replace(x) + `"`
+}
+
+// fileEntries returns the number of entries stored in the nsscash file at
+// path (the total of all shards for sharded files).
+func fileEntries(path string) (uint64, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return 0, err
+	}
+	defer f.Close()
+
+	hdr := make([]byte, headerSize)
+	_, err = io.ReadFull(f, hdr)
+	if err != nil {
+		return 0, err
+	}
+	if string(hdr[:8]) != "NSS-CASH" {
+		return 0, fmt.Errorf("%q: invalid magic", path)
+	}
+	return binary.LittleEndian.Uint64(hdr[16:]), nil // count
+}
+
+// fileSize returns the size of the file at path and all its shards.
+func fileSize(path string) (int64, error) {
+	shards, err := shardFiles(path)
+	if err != nil {
+		return 0, err
+	}
+
+	var size int64
+	for _, x := range append([]string{path}, shards...) {
+		fi, err := os.Stat(x)
+		if err != nil {
+			return 0, err
+		}
+		size += fi.Size()
+	}
+	return size, nil
+}
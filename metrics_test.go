@@ -0,0 +1,38 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"testing"
+)
+
+func TestMetricsLabel(t *testing.T) {
+	tests := []struct {
+		x   string
+		exp string
+	}{
+		{"", `""`},
+		{"/etc/passwd.nsscash", `"/etc/passwd.nsscash"`},
+		{`a"b\c` + "\n", `"a\"b\\c\n"`},
+	}
+
+	for n, tc := range tests {
+		res := metricsLabel(tc.x)
+		if res != tc.exp {
+			t.Errorf("%d: got %q, want %q", n, res, tc.exp)
+		}
+	}
+}
@@ -19,10 +19,56 @@ package main
 
 import (
 	"bytes"
+	"encoding/binary"
 	"fmt"
+	"math"
 	"os"
+	"sort"
+	"strings"
 )
 
+// Optional format features, stored in the upper 32 bits of the version of a
+// file (see nss/file.h). Readers reject files with unknown features.
+const (
+	// Passwd strings (except the name) are stored in a string table
+	FeatureStringTable uint64 = 1 << (32 + iota)
+	// Group members are stored in a string table
+	FeatureMemberTable
+	// Group entries use 32 bit offsets and counts
+	FeatureLargeGroups
+	// Index slots are uint32 in units of 8 bytes (passwd, group)
+	FeatureIndex32
+	// Root of a sharded passwd/group file, see serializeShards()
+	FeatureSharded
+	// Passwd and group file in one file, see SerializeCombined()
+	FeatureCombined
+	// Group file without the user private groups, see
+	// removeImplicitUPGs()
+	FeatureImplicitUPG
+	// Table file, see SerializeTable(); passwd/group readers reject it
+	FeatureTable
+)
+
+// SerializeOptions configures optional format features.
+type SerializeOptions struct {
+	// Compact enables features which reduce the file size but require an
+	// updated NSS module
+	Compact bool
+	// Shards splits passwd/group files into this many shards (if > 0)
+	Shards int
+	// Hot lists names of passwd/group entries which are stored in a
+	// hot-entry section for faster lookups
+	Hot []string
+	// Counts are lookup counts used to store frequently used entries
+	// together (optional)
+	Counts *Counters
+	// ImplicitUPG omits the user private groups of UPGPasswds from group
+	// files, the NSS module synthesizes them (requires an updated NSS
+	// module, not permitted with Shards)
+	ImplicitUPG bool
+	UPGPasswds  []Passwd
+}
+
 func alignBufferTo(b *bytes.Buffer, align int) {
 	if align <= 0 {
 		panic(fmt.Sprintf("invalid alignment %v", align))
@@ -37,6 +83,37 @@ func alignBufferTo(b *bytes.Buffer, align int) {
 	}
 }
 
+// writeIndexSlot appends a slot with offset to index. With index32 the slot
+// is an uint32 storing offset in units of 8 bytes (FeatureIndex32) which can
+// address 32 GiB of data as all entries are 8 byte aligned.
+func writeIndexSlot(index *bytes.Buffer, offset uint64, index32 bool) error {
+	le := binary.LittleEndian
+
+	if !index32 {
+		tmp := make([]byte, 8)
+		le.PutUint64(tmp, offset)
+		index.Write(tmp)
+		return nil
+	}
+
+	if offset%8 != 0 || offset/8 > math.MaxUint32 {
+		return fmt.Errorf("offset %d not addressable by index", offset)
+	}
+	tmp := make([]byte, 4)
+	le.PutUint32(tmp, uint32(offset/8))
+	index.Write(tmp)
+	return nil
+}
+
+// indexSize returns the size of an index with count slots (see
+// writeIndexSlot()); indices are padded to keep the following data aligned.
+func indexSize(count int, index32 bool) int {
+	if !index32 {
+		return count * 8
+	}
+	return (count*4 + 7) / 8 * 8
+}
+
 // syncPath syncs path, which should be a directory. To guarantee durability
 // it must be called on a parent directory after adding, renaming or removing
 // files therein.
@@ -57,3 +134,82 @@ func syncPath(path string) error {
 	}
 	return closeErr
 }
+
+// splitList splits a comma-separated list; the empty string results in an
+// empty list.
+func splitList(x string) []string {
+	if x == "" {
+		return nil
+	}
+	return strings.Split(x, ",")
+}
+
+// nameKey is a key for the name index of files whose entries can be found
+// by multiple names (e.g. services and protocols with their aliases).
+type nameKey struct {
+	name  string
+	entry uint64 // offset of the entry in data
+}
+
+// serializeNameKeys appends a key record for each key to data and returns
+// the name index referencing these records, sorted by name. Keys with the
+// same name keep their order in keys.
+//
+// Each key record consists of the offset of the entry (uint64) followed by
+// the NUL-terminated name, padded to 8 bytes. Because the number of keys
+// differs from the number of entries the index starts with the number of
+// keys (uint64).
+func serializeNameKeys(data *bytes.Buffer, keys []nameKey) bytes.Buffer {
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	sorted := make([]nameKey, len(keys))
+	copy(sorted, keys)
+	sort.SliceStable(sorted, func(i, j int) bool {
+		return sorted[i].name < sorted[j].name
+	})
+
+	var index bytes.Buffer
+	le.PutUint64(tmp, uint64(len(sorted)))
+	index.Write(tmp)
+	for _, k := range sorted {
+		le.PutUint64(tmp, uint64(data.Len()))
+		index.Write(tmp)
+
+		le.PutUint64(tmp, k.entry)
+		data.Write(tmp)
+		data.Write([]byte(k.name))
+		data.WriteByte(0)
+		alignBufferTo(data, 8)
+	}
+	return index
+}
+
+// stringTable stores each distinct string once (NUL-terminated) so entries
+// can reference it by its offset in the table.
+type stringTable struct {
+	data    bytes.Buffer
+	offsets map[string]uint32
+}
+
+func newStringTable() *stringTable {
+	return &stringTable{
+		offsets: make(map[string]uint32),
+	}
+}
+
+// add returns the offset of s in the table, adding it if necessary.
+func (t *stringTable) add(s string) (uint32, error) {
+	off, ok := t.offsets[s]
+	if ok {
+		return off, nil
+	}
+	if uint64(t.data.Len())+uint64(len(s))+1 > math.MaxUint32 {
+		return 0, fmt.Errorf("string table too large")
+	}
+	off = uint32(t.data.Len())
+	t.data.Write([]byte(s))
+	t.data.WriteByte(0)
+	t.offsets[s] = off
+	return off, nil
+}
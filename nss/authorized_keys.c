@@ -0,0 +1,81 @@
+/*
+ * Print authorized_keys of a user, for sshd's AuthorizedKeysCommand
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "search.h"
+
+
+struct authorized_keys_entry {
+    //       off_name = 0, not stored on disk
+    uint32_t off_keys;
+
+    /*
+     * Data contains the name and the keys (each line terminated by a
+     * newline) concatenated, with their trailing NUL. The off_* variables
+     * point to beginning of each string.
+     */
+    uint32_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+
+int main(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <user> [<path>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *name = argv[1];
+    const char *path = (argc == 3) ? argv[2] : NSSCASH_AUTHORIZED_KEYS_FILE;
+
+    struct file f;
+    if (!map_file(path, &f)) {
+        fprintf(stderr, "%s: failed to load %s: %s\n",
+                argv[0], path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const struct header *h = f.header;
+
+    struct search_key key = {
+        .name = name,
+        .data = h->data + h->off_data,
+        .offset = sizeof(struct authorized_keys_entry), // name is first value in data[]
+    };
+    const uint64_t *off = search(&key, h->data + h->off_name_index, h->count);
+    // Unknown users have no keys; this is not an error for sshd
+    if (off != NULL) {
+        const struct authorized_keys_entry *e =
+            (const struct authorized_keys_entry *)
+            ((const char *)key.data + *off);
+        const char *keys = e->data + e->off_keys;
+        size_t size = e->data_size - e->off_keys - 1; // without NUL
+        if (fwrite(keys, 1, size, stdout) != size || fflush(stdout)) {
+            unmap_file(&f);
+            return EXIT_FAILURE;
+        }
+    }
+
+    unmap_file(&f);
+    return EXIT_SUCCESS;
+}
@@ -21,6 +21,7 @@
 #define CASH_NSS_H
 
 #include <grp.h>
+#include <netdb.h>
 #include <nss.h>
 #include <pwd.h>
 
@@ -39,4 +40,18 @@ enum nss_status _nss_cash_getgrent_r(struct group *result, char *buffer, size_t
 enum nss_status _nss_cash_getgrgid_r(gid_t gid, struct group *result, char *buffer, size_t buflen, int *errnop);
 enum nss_status _nss_cash_getgrnam_r(const char *name, struct group *result, char *buffer, size_t buflen, int *errnop);
 
+// struct servent
+enum nss_status _nss_cash_setservent(int);
+enum nss_status _nss_cash_endservent(void);
+enum nss_status _nss_cash_getservent_r(struct servent *result, char *buffer, size_t buflen, int *errnop);
+enum nss_status _nss_cash_getservbyname_r(const char *name, const char *proto, struct servent *result, char *buffer, size_t buflen, int *errnop);
+enum nss_status _nss_cash_getservbyport_r(int port, const char *proto, struct servent *result, char *buffer, size_t buflen, int *errnop);
+
+// struct protoent
+enum nss_status _nss_cash_setprotoent(int);
+enum nss_status _nss_cash_endprotoent(void);
+enum nss_status _nss_cash_getprotoent_r(struct protoent *result, char *buffer, size_t buflen, int *errnop);
+enum nss_status _nss_cash_getprotobyname_r(const char *name, struct protoent *result, char *buffer, size_t buflen, int *errnop);
+enum nss_status _nss_cash_getprotobynumber_r(int number, struct protoent *result, char *buffer, size_t buflen, int *errnop);
+
 #endif
@@ -0,0 +1,117 @@
+/*
+ * Count lookups of passwd and group entries
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "counter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shard.h"
+
+
+// map_counter maps the counter file of the effective uid of this process
+// (path.<euid>). The file is mapped writable into every process which uses
+// the NSS module; therefore, it's only used if it can be modified solely by
+// this uid (and root): a regular file owned by the uid and not writable by
+// group or others. Otherwise other users could forge the counts or truncate
+// the file which causes SIGBUS on the next access in this process; only the
+// owner can truncate it after the size check below.
+static void map_counter(struct counter *c, const char *path) {
+    uid_t uid = geteuid();
+    char buf[4096];
+    int n = snprintf(buf, sizeof(buf), "%s.%lu", path, (unsigned long)uid);
+    if (n < 0 || (size_t)n >= sizeof(buf)) {
+        return;
+    }
+
+    int fd = open(buf, O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        return;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || !S_ISREG(s.st_mode) || s.st_uid != uid
+            || (s.st_mode & (S_IWGRP | S_IWOTH))
+            || (size_t)s.st_size < sizeof(struct counter_file)) {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t)s.st_size;
+    void *x = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (x == MAP_FAILED) {
+        return;
+    }
+
+    struct counter_file *f = x;
+    if (memcmp(f->magic, COUNTER_MAGIC, sizeof(f->magic))
+            || f->slots == 0
+            || f->slots > (size - sizeof(*f)) / sizeof(uint64_t)) {
+        munmap(x, size);
+        return;
+    }
+    // The mapping is never released, the file is reset in place
+    c->counters = (uint64_t *)((char *)x + sizeof(*f));
+    c->slots = f->slots;
+}
+
+// counter_init maps the counter file at path (see map_counter()) on first use,
+// it is kept mapped for the lifetime of the process (also if the process
+// changes its effective uid). Returns false if it couldn't be mapped.
+static bool counter_init(struct counter *c, const char *path) {
+    if (!__atomic_load_n(&c->initialized, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&c->lock);
+        if (!c->initialized) {
+            map_counter(c, path);
+            __atomic_store_n(&c->initialized, true, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&c->lock);
+    }
+    return c->counters != NULL;
+}
+
+// counter_hit counts a lookup of name in the counter file at path. Errors are
+// ignored (and errno is preserved) as counting is optional.
+void counter_hit(struct counter *c, const char *path, const char *name) {
+    int saved_errno = errno;
+
+    if (counter_init(c, path)) {
+        __atomic_fetch_add(&c->counters[shard_hash(name) % c->slots], 1,
+                __ATOMIC_RELAXED);
+    }
+
+    errno = saved_errno;
+}
+
+// counter_add adds n to the counter in slot of the counter file at path;
+// slots beyond the size of the file are ignored. Errors are ignored as in
+// counter_hit().
+void counter_add(struct counter *c, const char *path, uint64_t slot, uint64_t n) {
+    int saved_errno = errno;
+
+    if (counter_init(c, path) && slot < c->slots) {
+        __atomic_fetch_add(&c->counters[slot], n, __ATOMIC_RELAXED);
+    }
+
+    errno = saved_errno;
+}
@@ -0,0 +1,56 @@
+/*
+ * Count lookups of passwd and group entries
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+
+// Magic value at the beginning of each counter file (8 byte, without the
+// trailing NUL), see counters.go
+#define COUNTER_MAGIC "NSS-CNT1"
+
+// counter_file is the content of a counter file. Each effective uid uses its
+// own file (path.<uid>, see map_counter() in counter.c) so processes only map
+// files which cannot be modified by other users. Entries are counted in
+// counters[shard_hash(name) % slots]; collisions are acceptable as the counts
+// are only used to optimize the layout of the data section.
+struct counter_file {
+    char magic[8];
+    uint64_t slots;
+    uint64_t counters[];
+} __attribute__((packed));
+
+struct counter {
+    pthread_mutex_t lock;
+    bool initialized; // mapping was attempted, only set once
+    uint64_t *counters; // NULL if the file couldn't be mapped
+    uint64_t slots;
+};
+
+#define COUNTER_INITIALIZER { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+void counter_hit(struct counter *c, const char *path, const char *name) __attribute__((visibility("hidden")));
+void counter_add(struct counter *c, const char *path, uint64_t slot, uint64_t n) __attribute__((visibility("hidden")));
+
+#endif
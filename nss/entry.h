@@ -0,0 +1,124 @@
+/*
+ * On-disk structure of passwd and group entries (header)
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTRY_H
+#define ENTRY_H
+
+#include <stdint.h>
+
+
+// Used by pw.c and lib.c
+struct passwd_entry {
+    uint64_t uid;
+    uint64_t gid;
+
+    //       off_name = 0, not stored on disk
+    uint16_t off_passwd;
+    uint16_t off_gecos;
+    uint16_t off_dir;
+    uint16_t off_shell;
+
+    /*
+     * Data contains all strings (name, passwd, gecos, dir, shell)
+     * concatenated, with their trailing NUL. The off_* variables point to
+     * beginning of each string.
+     */
+    uint16_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+// Used instead of struct passwd_entry if FEATURE_STRING_TABLE is set
+struct passwd_entry_compact {
+    uint64_t uid;
+    uint64_t gid;
+
+    // Offsets of the strings in the string table, relative to the beginning
+    // of the data section (h->data + h->off_data)
+    uint32_t off_passwd;
+    uint32_t off_gecos;
+    uint32_t off_dir;
+    uint32_t off_shell;
+
+    uint16_t data_size; // size of data in bytes
+    const char data[]; // only the name
+} __attribute__((packed));
+
+// Used by gr.c and lib.c; see struct group_entry_large for groups with more
+// than about 5000 users (for 9 byte user names)
+struct group_entry {
+    uint64_t gid;
+
+    //       off_name = 0, not stored on disk
+    uint16_t off_passwd;
+    uint16_t off_mem_off;
+
+    uint16_t mem_count; // group member count
+
+    /*
+     * Data contains all strings (name, passwd) concatenated, with their
+     * trailing NUL. The off_* variables point to beginning of each string.
+     *
+     * After that the offsets of the members of the group are stored as
+     * mem_count uint16_t values, followed by the member names concatenated as
+     * with the strings above.
+     *
+     * All offsets are relative to the beginning of data.
+     */
+    uint16_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+// Used instead of struct group_entry if FEATURE_LARGE_GROUPS is set; same as
+// struct group_entry but with 32 bit offsets and counts
+struct group_entry_large {
+    uint64_t gid;
+
+    //       off_name = 0, not stored on disk
+    uint32_t off_passwd;
+    uint32_t off_mem_off;
+
+    uint32_t mem_count; // group member count
+
+    // See struct group_entry, the member offsets are uint32_t
+    uint32_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+// Used instead of struct group_entry if FEATURE_MEMBER_TABLE is set
+struct group_entry_compact {
+    uint64_t gid;
+
+    //       off_name = 0, not stored on disk
+    uint32_t off_passwd;
+    uint32_t off_mem_off;
+
+    uint32_t mem_count; // group member count
+
+    /*
+     * Data contains all strings (name, passwd) concatenated, with their
+     * trailing NUL, followed by mem_count uint32_t offsets of the member
+     * names in the member table. These offsets are relative to the
+     * beginning of the data section (h->data + h->off_data), all other
+     * offsets are relative to the beginning of data.
+     */
+    uint32_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+#endif
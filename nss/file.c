@@ -21,6 +21,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -28,8 +29,127 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "probe.h"
 
-bool map_file(const char *path, struct file *f) {
+
+// section_known returns true if this module supports sections of type.
+static bool section_known(uint32_t type) {
+    switch (type) {
+        case SECTION_PASSWD:
+        case SECTION_GROUP:
+        case SECTION_HOT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool check_sections(const struct header *h, size_t file_size) {
+    if (file_size < sizeof(*h) + sizeof(struct section_table)) {
+        return false;
+    }
+    const size_t size = file_size - sizeof(*h);
+
+    const struct section_table *t = (const struct section_table *)h->data;
+    if (t->count > (size - sizeof(*t)) / sizeof(t->sections[0])) {
+        return false;
+    }
+    for (uint64_t i = 0; i < t->count; i++) {
+        const struct section *s = &t->sections[i];
+        if (s->offset > size || size - s->offset < s->length) {
+            return false;
+        }
+        if ((s->flags & SECTION_REQUIRED) && !section_known(s->type)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// check_header verifies the header of a file with the given size.
+static bool check_header(const struct header *h, size_t size, uint64_t features) {
+    if (size < sizeof(*h)) {
+        return false;
+    }
+    // Check MAGIC
+    if (memcmp(h->magic, MAGIC, sizeof(h->magic))) {
+        return false;
+    }
+    // Only versions 1 and 2 (with sections) are supported at the moment;
+    // this will also prevent running on big-endian systems which is
+    // currently not possible (the swapped version has unknown feature bits
+    // set)
+    uint64_t version = h->version & VERSION_MASK;
+    if ((version != 1 && version != 2)
+            || (h->version & ~(VERSION_MASK | features)) != 0) {
+        return false;
+    }
+    if (version == 2 && !check_sections(h, size)) {
+        return false;
+    }
+    return true;
+}
+
+// advise_range calls madvise(2) for the pages containing [x, x + size).
+// Errors are ignored, advice only affects performance.
+__attribute__((unused))
+static void advise_range(const char *x, size_t size, int advice) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)x & ~(page - 1);
+    uintptr_t end = (uintptr_t)x + size;
+    madvise((void *)start, end - start, advice);
+}
+
+// map_hints applies the optional mapping hints (see file.h) to f which is
+// mapped for a long time. Short-lived mappings (one per lookup) would only
+// pay for the additional system calls.
+static void map_hints(const struct file *f) {
+    (void)f;
+
+#ifdef NSSCASH_MADVISE
+    const struct header *h = f->header;
+    // Lookups access the file randomly, readahead only wastes page cache
+    advise_range((const char *)h, f->size, MADV_RANDOM);
+    // But all lookups use the indices, start reading them now. The indices
+    // of files stored in a combined file are at the beginning of each
+    // section (before off_data).
+    const struct header *files[] = { h, NULL, NULL };
+    if (h->version & FEATURE_COMBINED) {
+        const struct section *p = find_section(h, SECTION_PASSWD);
+        const struct section *g = find_section(h, SECTION_GROUP);
+        files[0] = NULL;
+        if (p != NULL && p->length >= sizeof(struct header)) {
+            files[1] = (const struct header *)(h->data + p->offset);
+        }
+        if (g != NULL && g->length >= sizeof(struct header)) {
+            files[2] = (const struct header *)(h->data + g->offset);
+        }
+    }
+    for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+        const struct header *x = files[i];
+        // Bounds were checked by check_header() or are checked before use
+        // (sections), madvise(2) ignores invalid ranges anyway
+        if (x != NULL && x->off_orig_index <= x->off_data
+                && x->off_data <= f->size) {
+            advise_range(x->data + x->off_orig_index,
+                    x->off_data - x->off_orig_index, MADV_WILLNEED);
+        }
+    }
+#endif
+
+#if defined(NSSCASH_HUGEPAGE_MIN_SIZE) && defined(MADV_HUGEPAGE)
+    // Fewer TLB misses for large files; only used if the kernel supports
+    // transparent huge pages for (read-only) file mappings
+    if (f->size >= NSSCASH_HUGEPAGE_MIN_SIZE) {
+        advise_range((const char *)f->header, f->size, MADV_HUGEPAGE);
+    }
+#endif
+}
+
+// internal_map_file maps the file at path which may use the given features.
+// If long_lived is true the mapping is kept for many lookups and the optional
+// mapping hints are used.
+static bool internal_map_file(const char *path, struct file *f, uint64_t features, bool long_lived) {
     // Fully initialize the struct for unmap_file() and other users
     memset(f, 0, sizeof(*f));
 
@@ -44,37 +164,242 @@ bool map_file(const char *path, struct file *f) {
     f->size = (size_t)s.st_size; // for munmap()
 
     // mmap is used for speed and simple random access
-    void *x = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+    int flags = MAP_PRIVATE;
+#ifdef NSSCASH_MAP_POPULATE
+    if (long_lived) {
+        // Fault in all pages now instead of one page per lookup
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void *x = mmap(NULL, f->size, PROT_READ, flags, f->fd, 0);
     if (x == MAP_FAILED) {
         goto fail;
     }
 
-    const struct header *h = x;
-    f->header = h;
+    f->header = x;
 
-    // Check MAGIC
-    if (memcmp(h->magic, MAGIC, sizeof(h->magic))) {
+    if (!check_header(f->header, f->size, features)) {
         errno = EINVAL;
         goto fail;
     }
-    // Only version 1 is supported at the moment; this will also prevent
-    // running on big-endian systems which is currently not possible
-    if (h->version != 1) {
-        errno = EINVAL;
-        goto fail;
+    if (long_lived) {
+        map_hints(f);
     }
 
+    PROBE(map__file, path, 1, f->size);
     return true;
 
 fail: {
         int save_errno = errno;
         unmap_file(f);
+        PROBE(map__file, path, 0, (size_t)0);
         errno = save_errno;
         return false;
     }
 }
 
+bool map_file(const char *path, struct file *f) {
+    return internal_map_file(path, f, FEATURES_KNOWN, false);
+}
+
+// map_file_root is like map_file() but also accepts the root file of a
+// sharded file, see shard.c.
+bool map_file_root(const char *path, struct file *f) {
+    return internal_map_file(path, f, FEATURES_KNOWN | FEATURE_SHARDED, false);
+}
+
+// map_file_table is like map_file() but only accepts table files
+// (FEATURE_TABLE), see table.c.
+bool map_file_table(const char *path, struct file *f) {
+    if (!internal_map_file(path, f, FEATURE_TABLE, false)) {
+        return false;
+    }
+    if (!(f->header->version & FEATURE_TABLE)) {
+        unmap_file(f);
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+// find_section returns the first section with the given type or NULL if the
+// file has no such section (or is a version 1 file).
+const struct section *find_section(const struct header *h, uint32_t type) {
+    if ((h->version & VERSION_MASK) != 2) {
+        return NULL;
+    }
+    const struct section_table *t = (const struct section_table *)h->data;
+    for (uint64_t i = 0; i < t->count; i++) {
+        if (t->sections[i].type == type) {
+            return &t->sections[i];
+        }
+    }
+    return NULL;
+}
+
+
+// A combined file is mapped only once per process and shared by all users
+// until it's replaced on disk. Mappings are reference counted so a mapping
+// can be replaced while other threads still use it.
+struct shared_map {
+    struct file file;
+    const char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+
+    uint64_t refs;
+    bool stale; // replaced, unmap when refs drops to zero
+};
+static struct shared_map *shared_current;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool shared_map_matches(const struct shared_map *m, const char *path, const struct stat *s) {
+    return !strcmp(m->path, path)
+        && m->dev == s->st_dev && m->ino == s->st_ino
+        && m->size == s->st_size
+        && m->mtime.tv_sec == s->st_mtim.tv_sec
+        && m->mtime.tv_nsec == s->st_mtim.tv_nsec;
+}
+
+static void shared_map_release(struct shared_map *m) {
+    if (--m->refs == 0 && m->stale) {
+        unmap_file(&m->file);
+        free(m);
+    }
+}
+
+// shared_map_get returns the shared mapping of path (with an additional
+// reference), mapping it again if it was replaced on disk. fresh is set if
+// the file was mapped by this call.
+static struct shared_map *shared_map_get(const char *path, bool *fresh) {
+    // Only stat(2) when the file is unchanged, which is much cheaper than
+    // open(2), mmap(2) and the page faults of a fresh mapping
+    struct stat s;
+    if (stat(path, &s)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&shared_lock);
+    struct shared_map *m = shared_current;
+    if (m == NULL || !shared_map_matches(m, path, &s)) {
+        m = calloc(1, sizeof(*m));
+        if (m == NULL) {
+            goto fail;
+        }
+        if (!internal_map_file(path, &m->file,
+                    FEATURES_KNOWN | FEATURE_COMBINED, true)) {
+            free(m);
+            goto fail;
+        }
+        // Use the identity of the mapped file, path might have been
+        // replaced again after stat(2) above
+        if (fstat(m->file.fd, &s)) {
+            unmap_file(&m->file);
+            free(m);
+            goto fail;
+        }
+        m->path = path;
+        m->dev = s.st_dev;
+        m->ino = s.st_ino;
+        m->mtime = s.st_mtim;
+        m->size = s.st_size;
+        m->refs = 1; // held by shared_current
+
+        if (shared_current != NULL) {
+            shared_current->stale = true;
+            shared_map_release(shared_current);
+        }
+        shared_current = m;
+        *fresh = true;
+    }
+    m->refs++;
+    pthread_mutex_unlock(&shared_lock);
+    return m;
+
+fail: {
+        int save_errno = errno;
+        pthread_mutex_unlock(&shared_lock);
+        errno = save_errno;
+        return NULL;
+    }
+}
+
+// shared_map_section stores the section of the given type of m in f; the
+// reference of m is transferred to f (or released on failure).
+static bool shared_map_section(struct shared_map *m, uint32_t type, struct file *f) {
+    const struct header *h = m->file.header;
+    const struct section *s = find_section(h, type);
+    if (!(h->version & FEATURE_COMBINED) || s == NULL
+            || s->offset % 8 != 0) {
+        goto fail;
+    }
+    const struct header *x = (const struct header *)(h->data + s->offset);
+    // Files stored in combined files are always normal files; group files
+    // with implicit user private groups (see gr.c) are only permitted here
+    // as the passwd file is guaranteed to be of the same update
+    if (!check_header(x, s->length, FEATURES_KNOWN | FEATURE_IMPLICIT_UPG)) {
+        goto fail;
+    }
+
+    f->header = x;
+    f->size = s->length;
+    f->shared = m;
+    return true;
+
+fail:
+    pthread_mutex_lock(&shared_lock);
+    shared_map_release(m);
+    pthread_mutex_unlock(&shared_lock);
+    errno = EINVAL;
+    return false;
+}
+
+// map_file_section maps the file stored in the section of the given type of
+// the combined file path (FEATURE_COMBINED). The combined file is mapped
+// only once per process (see shared_map_get()), unmap_file() releases f.
+bool map_file_section(const char *path, uint32_t type, struct file *f) {
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+
+    struct shared_map *m = shared_map_get(path, &f->fresh);
+    if (m == NULL) {
+        return false;
+    }
+    return shared_map_section(m, type, f);
+}
+
+// map_file_sibling maps the section of the given type of the same combined
+// file as f (mapped by map_file_section()), even if it was replaced on disk
+// in the meantime.
+bool map_file_sibling(const struct file *f, uint32_t type, struct file *sibling) {
+    memset(sibling, 0, sizeof(*sibling));
+    sibling->fd = -1;
+
+    struct shared_map *m = f->shared;
+    if (m == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    pthread_mutex_lock(&shared_lock);
+    m->refs++;
+    pthread_mutex_unlock(&shared_lock);
+    return shared_map_section(m, type, sibling);
+}
+
 void unmap_file(struct file *f) {
+    free(f->shard_hashes);
+    f->shard_hashes = NULL;
+
+    if (f->shared != NULL) {
+        pthread_mutex_lock(&shared_lock);
+        shared_map_release(f->shared);
+        pthread_mutex_unlock(&shared_lock);
+        f->shared = NULL;
+        f->header = NULL;
+        return;
+    }
     if (f->header != NULL) {
         munmap((void *)f->header, f->size);
         f->header = NULL;
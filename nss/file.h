@@ -36,7 +36,96 @@
 #ifndef NSSCASH_GROUP_FILE
 # define NSSCASH_GROUP_FILE "/etc/group.nsscash"
 #endif
+#ifndef NSSCASH_SERVICES_FILE
+# define NSSCASH_SERVICES_FILE "/etc/services.nsscash"
+#endif
+#ifndef NSSCASH_PROTOCOLS_FILE
+# define NSSCASH_PROTOCOLS_FILE "/etc/protocols.nsscash"
+#endif
+#ifndef NSSCASH_AUTHORIZED_KEYS_FILE
+# define NSSCASH_AUTHORIZED_KEYS_FILE "/etc/ssh/authorized_keys.nsscash"
+#endif
+// Optional, if defined passwd and group are read from this combined file
+// instead of NSSCASH_PASSWD_FILE and NSSCASH_GROUP_FILE
+//#define NSSCASH_COMBINED_FILE "/etc/nsscash.combined"
+// Optional, if defined lookups of passwd/group entries are counted in these
+// files (path.<euid> created with "nsscash counters", see counter.c) and used
+// by nsscash to store frequently used entries together
+//#define NSSCASH_PASSWD_COUNTER_FILE "/var/lib/nsscash/passwd.counts"
+//#define NSSCASH_GROUP_COUNTER_FILE "/var/lib/nsscash/group.counts"
+// Optional, if defined statistics of passwd/group lookups (results, mapped
+// files, time spent mapping) are counted in this counter file (per effective
+// uid like the counter files above), see "nsscash stats"
+//#define NSSCASH_STATS_FILE "/var/lib/nsscash/stats.counts"
+// Optional, if defined passwd/group ids are translated with the uid_map and
+// gid_map of the current user namespace in this directory: the files store
+// the ids of the parent namespace (e.g. the host) so one bind-mounted file
+// serves all (rootless) containers, see idmap.c
+//#define NSSCASH_IDMAP_DIR "/proc/self"
+// Optional hints for mappings which are used for many lookups (currently
+// only NSSCASH_COMBINED_FILE which is mapped once per process):
+// - prefault all pages with MAP_POPULATE when mapping the file
+//#define NSSCASH_MAP_POPULATE
+// - MADV_RANDOM for the file and MADV_WILLNEED for its indices
+//#define NSSCASH_MADVISE
+// - MADV_HUGEPAGE (transparent huge pages) for files at least this large
+//#define NSSCASH_HUGEPAGE_MIN_SIZE (2 * 1024 * 1024)
+
+
+// The lower 32 bits of header.version contain the format version, the upper
+// 32 bits flag optional format features. map_file() rejects files with
+// unknown features.
+#define VERSION_MASK UINT64_C(0xffffffff)
+// passwd: all strings except the name are stored in a string table at the
+// beginning of the data section (struct passwd_entry_compact)
+#define FEATURE_STRING_TABLE (UINT64_C(1) << 32)
+// group: members are references into a table of member names at the
+// beginning of the data section (struct group_entry_compact)
+#define FEATURE_MEMBER_TABLE (UINT64_C(1) << 33)
+// group: entries use 32 bit offsets and counts (struct group_entry_large);
+// only set if a group doesn't fit struct group_entry
+#define FEATURE_LARGE_GROUPS (UINT64_C(1) << 34)
+// passwd, group: index slots are uint32_t offsets in units of 8 bytes (see
+// index_offset() in search.h)
+#define FEATURE_INDEX32 (UINT64_C(1) << 35)
+#define FEATURES_KNOWN (FEATURE_STRING_TABLE | FEATURE_MEMBER_TABLE \
+                        | FEATURE_LARGE_GROUPS | FEATURE_INDEX32)
+// passwd, group: root of a sharded file (struct shard_root in shard.h); only
+// accepted by map_file_root(), map_file() rejects it
+#define FEATURE_SHARDED (UINT64_C(1) << 36)
+// passwd+group: combined file storing a passwd and a group file in sections
+// (SECTION_PASSWD, SECTION_GROUP); only accepted by map_file_section()
+#define FEATURE_COMBINED (UINT64_C(1) << 37)
+// group: the file omits the user private groups of the passwd file, the NSS
+// module synthesizes them (see gr.c); only accepted in combined files by
+// map_file_section() to use a passwd file of the same update
+#define FEATURE_IMPLICIT_UPG (UINT64_C(1) << 38)
+// table: table file (struct table_schema in table.h); only accepted by
+// map_file_table() which requires it, map_file() rejects it
+#define FEATURE_TABLE (UINT64_C(1) << 39)
+
+// Version 2 files start their data with a section table (struct
+// section_table) which lists optional sections; the offsets in the header
+// account for the table. Readers ignore sections with unknown types unless
+// they are flagged with SECTION_REQUIRED.
+#define SECTION_REQUIRED UINT32_C(1)
+
+// Section types
+#define SECTION_PASSWD UINT32_C(1) // passwd file in a combined file
+#define SECTION_GROUP  UINT32_C(2) // group file in a combined file
+#define SECTION_HOT    UINT32_C(3) // hot-entry table (struct hot_table)
 
+struct section {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset; // relative to header.data
+    uint64_t length;
+} __attribute__((packed));
+
+struct section_table {
+    uint64_t count;
+    struct section sections[];
+} __attribute__((packed));
 
 // header describes the on-disk (and, after loading via mmap, in-memory)
 // structure of nsscash files.
@@ -55,16 +144,32 @@ struct header {
     char data[];
 } __attribute__((packed));
 
+struct shared_map;
+
 // file represents an open nsscash file.
 struct file {
     int fd;
     size_t size;
 
     const struct header *header;
-    uint64_t next_index; // used by getpwent (pw.c)
+    uint64_t next_index; // used by getpwent (pw.c) and similar
+
+    // Used by getpwent (pw.c) and getgrent (gr.c) to iterate over shards
+    uint64_t shard;
+    uint64_t shard_count;
+    uint64_t *shard_hashes; // of the id shards, freed by unmap_file()
+
+    struct shared_map *shared; // set by map_file_section()
+    bool fresh; // set by map_file_section() if shared was mapped by this call
 };
 
 bool map_file(const char *path, struct file *f) __attribute__((visibility("hidden")));
+bool map_file_root(const char *path, struct file *f) __attribute__((visibility("hidden")));
+bool map_file_table(const char *path, struct file *f) __attribute__((visibility("hidden")));
+bool map_file_section(const char *path, uint32_t type, struct file *f) __attribute__((visibility("hidden")));
+bool map_file_sibling(const struct file *f, uint32_t type, struct file *sibling) __attribute__((visibility("hidden")));
 void unmap_file(struct file *f) __attribute__((visibility("hidden")));
 
+const struct section *find_section(const struct header *h, uint32_t type) __attribute__((visibility("hidden")));
+
 #endif
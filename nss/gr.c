@@ -26,37 +26,20 @@
 #include <pthread.h>
 
 #include "cash_nss.h"
+#include "counter.h"
+#include "entry.h"
 #include "file.h"
+#include "hot.h"
+#include "idmap.h"
+#include "probe.h"
+#include "pw.h"
 #include "search.h"
+#include "shard.h"
+#include "stats.h"
 
 
 // NOTE: This file is very similar to pw.c, keep in sync!
 
-// TODO: adapt offsets to 32 bit to fit more than 5000 users per group (for 9
-// byte user names)
-struct group_entry {
-    uint64_t gid;
-
-    //       off_name = 0, not stored on disk
-    uint16_t off_passwd;
-    uint16_t off_mem_off;
-
-    uint16_t mem_count; // group member count
-
-    /*
-     * Data contains all strings (name, passwd) concatenated, with their
-     * trailing NUL. The off_* variables point to beginning of each string.
-     *
-     * After that the offsets of the members of the group are stored as
-     * mem_count uint16_t values, followed by the member names concatenated as
-     * with the strings above.
-     *
-     * All offsets are relative to the beginning of data.
-     */
-    uint16_t data_size; // size of data in bytes
-    const char data[];
-} __attribute__((packed));
-
 static bool entry_to_group(const struct group_entry *e, struct group *g, char *tmp, size_t space) {
     // Space required for the gr_mem array
     const size_t mem_size = (size_t)(e->mem_count + 1) * sizeof(char *);
@@ -84,16 +67,244 @@ static bool entry_to_group(const struct group_entry *e, struct group *g, char *t
 
     return true;
 }
+static bool entry_large_to_group(const struct group_entry_large *e, struct group *g, char *tmp, size_t space) {
+    // Space required for the gr_mem array
+    const size_t mem_size = ((size_t)e->mem_count + 1) * sizeof(char *);
+
+    if (space < e->data_size + mem_size) {
+        return false;
+    }
+
+    char **groups = (char **)tmp;
+
+    const uint32_t *offs_mem = (const uint32_t *)(e->data + e->off_mem_off);
+    for (uint32_t i = 0; i < e->mem_count; i++) {
+        groups[i] = tmp + mem_size + offs_mem[i];
+    }
+    groups[e->mem_count] = NULL;
+
+    memcpy(tmp + mem_size, e->data, e->data_size);
+
+    g->gr_gid = (gid_t)e->gid;
+    g->gr_name = tmp + mem_size + 0;
+    g->gr_passwd = tmp + mem_size + e->off_passwd;
+    g->gr_mem = groups;
+
+    return true;
+}
+
+static bool entry_compact_to_group(const struct header *h, const struct group_entry_compact *e, struct group *g, char *tmp, size_t space) {
+    const char *table = h->data + h->off_data;
+    const uint32_t *offs_mem = (const uint32_t *)(e->data + e->off_mem_off);
+
+    // Space required for the gr_mem array
+    const size_t mem_size = ((size_t)e->mem_count + 1) * sizeof(char *);
+
+    // Strings (name, passwd) are copied from data, the member names from
+    // the member table
+    size_t size = mem_size + e->off_mem_off;
+    for (uint32_t i = 0; i < e->mem_count; i++) {
+        size += strlen(table + offs_mem[i]) + 1;
+    }
+    if (space < size) {
+        return false;
+    }
+
+    char **groups = (char **)tmp;
+    char *x = tmp + mem_size;
+
+    memcpy(x, e->data, e->off_mem_off);
+    g->gr_gid = (gid_t)e->gid;
+    g->gr_name = x + 0;
+    g->gr_passwd = x + e->off_passwd;
+    g->gr_mem = groups;
+    x += e->off_mem_off;
+
+    for (uint32_t i = 0; i < e->mem_count; i++) {
+        const char *m = table + offs_mem[i];
+        size_t len = strlen(m) + 1;
+        memcpy(x, m, len);
+        groups[i] = x;
+        x += len;
+    }
+    groups[e->mem_count] = NULL;
+
+    return true;
+}
+
+static bool header_entry_to_group(const struct header *h, const char *e, struct group *g, char *tmp, size_t space) {
+    if (h->version & FEATURE_MEMBER_TABLE) {
+        return entry_compact_to_group(h,
+                (const struct group_entry_compact *)e, g, tmp, space);
+    }
+    if (h->version & FEATURE_LARGE_GROUPS) {
+        return entry_large_to_group(
+                (const struct group_entry_large *)e, g, tmp, space);
+    }
+    return entry_to_group((const struct group_entry *)e, g, tmp, space);
+}
+
+
+// map_group maps the file containing the entry with the given name (if not
+// NULL) or id; or the first file to iterate over all entries if all is true.
+static bool map_group(bool all, const char *name, uint64_t id, struct file *f) {
+    bool ok;
+#ifdef NSSCASH_COMBINED_FILE
+    (void)all;
+    (void)name;
+    (void)id;
+    ok = map_file_section(NSSCASH_COMBINED_FILE, SECTION_GROUP, f);
+#else
+    if (all) {
+        ok = map_file_first(NSSCASH_GROUP_FILE, f);
+    } else {
+        ok = map_file_key(NSSCASH_GROUP_FILE, name, id, f);
+    }
+#endif
+    // The user namespace is checked only when the file was (re)mapped
+    if (ok && (f->shared == NULL || f->fresh) && !idmap_recheck()) {
+        int err = errno;
+        unmap_file(f);
+        errno = err;
+        return false;
+    }
+    return ok;
+}
+
+
+#ifdef NSSCASH_GROUP_COUNTER_FILE
+static struct counter lookup_counter = COUNTER_INITIALIZER;
+#endif
+
+
+// find_group returns the entry with the given name (if not NULL) or gid or
+// NULL if h contains no such entry. hot is set if the entry was found in the
+// hot-entry section and is therefore a struct group_entry.
+static const char *find_group(const struct header *h, const char *name, uint64_t gid, bool *hot) {
+    // Frequently used entries are stored completely in the hot-entry section
+    // (in the basic format) to touch as few pages as possible
+    const char *e = hot_lookup(h, name, gid,
+            sizeof(struct group_entry), offsetof(struct group_entry, gid));
+    if (e != NULL) {
+        *hot = true;
+        return e;
+    }
+    *hot = false;
+
+    struct search_key key = {
+        .name = name,
+        .id = gid,
+        .data = h->data + h->off_data,
+    };
+    if (name != NULL) {
+        // name is first value in data[]
+        if (h->version & FEATURE_MEMBER_TABLE) {
+            key.offset = sizeof(struct group_entry_compact);
+        } else if (h->version & FEATURE_LARGE_GROUPS) {
+            key.offset = sizeof(struct group_entry_large);
+        } else {
+            key.offset = sizeof(struct group_entry);
+        }
+    } else {
+        key.offset = offsetof(struct group_entry, gid);
+    }
+    uint64_t off_index = (key.name != NULL)
+                       ? h->off_name_index
+                       : h->off_id_index;
+    uint64_t off;
+    if (!search_index(&key, h, off_index, &off)) {
+        return NULL;
+    }
+    return key.data + off;
+}
+
+
+// Files with FEATURE_IMPLICIT_UPG omit the user private group of each user
+// whose uid equals its primary gid unless a group with the same name or gid
+// exists. These groups are synthesized from the passwd file stored in the
+// same combined file (see map_file_sibling()) so both are always of the
+// same update. Its lookups are not counted as passwd lookups.
+
+// is_upg returns true if p's user private group is implicit in h.
+static bool is_upg(const struct header *h, const struct passwd *p) {
+    bool hot;
+    return p->pw_uid == p->pw_gid
+        && find_group(h, p->pw_name, 0, &hot) == NULL
+        && find_group(h, NULL, p->pw_gid, &hot) == NULL;
+}
+
+// passwd_to_upg stores the user private group of p in g. The strings of p
+// must be stored at the beginning of tmp (as done by passwd_search() and
+// passwd_next()).
+static bool passwd_to_upg(const struct passwd *p, struct group *g, char *tmp, size_t space) {
+    // Space required for the (empty) gr_mem array
+    const size_t mem_size = sizeof(char *);
+    const size_t name_size = strlen(p->pw_name) + 1;
+
+    if (space < mem_size + name_size + sizeof("x")) {
+        return false;
+    }
+
+    char **groups = (char **)tmp;
+    char *x = tmp + mem_size;
+
+    // p->pw_name is at the beginning of tmp, see entry_to_passwd()
+    memmove(x, p->pw_name, name_size);
+    memcpy(x + name_size, "x", sizeof("x"));
+    g->gr_gid = p->pw_gid;
+    g->gr_name = x;
+    g->gr_passwd = x + name_size;
+    g->gr_mem = groups;
+    groups[0] = NULL;
+
+    return true;
+}
+
+// lookup_upg looks up the implicit user private group with the given name (if
+// not NULL) or gid in the group file f.
+static enum nss_status lookup_upg(const struct file *f, const char *name, uint64_t gid, struct group *result, char *buffer, size_t buflen, int *errnop) {
+    const struct header *h = f->header;
+
+    struct file pf;
+    if (!map_file_sibling(f, SECTION_PASSWD, &pf)) {
+        *errnop = errno;
+        return NSS_STATUS_UNAVAIL;
+    }
+    struct passwd p;
+    enum nss_status s =
+        passwd_search(pf.header, name, gid, &p, buffer, buflen, errnop);
+    unmap_file(&pf);
+    if (s != NSS_STATUS_SUCCESS) {
+        return s;
+    }
+    if (!is_upg(h, &p)) {
+        errno = ENOENT;
+        *errnop = errno;
+        return NSS_STATUS_NOTFOUND;
+    }
+    if (!passwd_to_upg(&p, result, buffer, buflen)) {
+        errno = ERANGE;
+        *errnop = errno;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    return NSS_STATUS_SUCCESS;
+}
 
 
 static struct file static_file = {
     .fd = -1,
 };
+// Iteration over the passwd file for the implicit user private groups after
+// all entries of static_file were returned
+static struct file static_passwd = {
+    .fd = -1,
+};
 static pthread_mutex_t static_file_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void internal_unmap_static_file(void) {
     pthread_mutex_lock(&static_file_lock);
     unmap_file(&static_file);
+    unmap_file(&static_passwd);
     pthread_mutex_unlock(&static_file_lock);
 }
 
@@ -111,24 +322,60 @@ enum nss_status _nss_cash_endgrent(void) {
     return NSS_STATUS_SUCCESS;
 }
 
+static enum nss_status internal_getgrent_upg(struct group *result, char *buffer, size_t buflen) {
+    const struct header *h = static_file.header;
+    if (!(h->version & FEATURE_IMPLICIT_UPG)) {
+        errno = ENOENT;
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    if (static_passwd.header == NULL) {
+        if (!map_file_sibling(&static_file, SECTION_PASSWD, &static_passwd)) {
+            return NSS_STATUS_UNAVAIL;
+        }
+    }
+    for (;;) {
+        struct passwd p;
+        enum nss_status s = passwd_next(&static_passwd, &p, buffer, buflen);
+        if (s != NSS_STATUS_SUCCESS) {
+            return s;
+        }
+        if (!is_upg(h, &p)) {
+            continue;
+        }
+        if (!passwd_to_upg(&p, result, buffer, buflen)) {
+            // Return this entry again on the next call
+            static_passwd.next_index--;
+            errno = ERANGE;
+            return NSS_STATUS_TRYAGAIN;
+        }
+        return NSS_STATUS_SUCCESS;
+    }
+}
 static enum nss_status internal_getgrent_r(struct group *result, char *buffer, size_t buflen) {
     // First call to getgrent_r, load file from disk
     if (static_file.header == NULL) {
-        if (!map_file(NSSCASH_GROUP_FILE, &static_file)) {
+        if (!map_group(true, NULL, 0, &static_file)) {
             return NSS_STATUS_UNAVAIL;
         }
     }
 
-    const struct header *h = static_file.header;
-    // End of "file", stop
-    if (static_file.next_index >= h->count) {
-        errno = ENOENT;
-        return NSS_STATUS_NOTFOUND;
+    // End of "file" (or the current shard), continue with the next shard
+    while (static_file.next_index >= static_file.header->count) {
+        if (!map_file_next(NSSCASH_GROUP_FILE, &static_file)) {
+            // No more shards, continue with the implicit user private
+            // groups (if any) or stop
+            if (errno == ENOENT) {
+                return internal_getgrent_upg(result, buffer, buflen);
+            }
+            return NSS_STATUS_UNAVAIL;
+        }
     }
+    const struct header *h = static_file.header;
 
-    uint64_t *off_orig = (uint64_t *)(h->data + h->off_orig_index);
-    const char *e = h->data + h->off_data + off_orig[static_file.next_index];
-    if (!entry_to_group((struct group_entry *)e, result, buffer, buflen)) {
+    const char *e = h->data + h->off_data
+        + index_offset(h, h->off_orig_index, static_file.next_index);
+    if (!header_entry_to_group(h, e, result, buffer, buflen)) {
         errno = ERANGE;
         return NSS_STATUS_TRYAGAIN;
     }
@@ -140,6 +387,10 @@ enum nss_status _nss_cash_getgrent_r(struct group *result, char *buffer, size_t
     pthread_mutex_lock(&static_file_lock);
     enum nss_status s = internal_getgrent_r(result, buffer, buflen);
     pthread_mutex_unlock(&static_file_lock);
+    if (s == NSS_STATUS_SUCCESS && !idmap_group_from_file(result)) {
+        s = NSS_STATUS_UNAVAIL;
+    }
+    PROBE(getent, "group", (int)s);
     if (s != NSS_STATUS_SUCCESS) {
         *errnop = errno;
     }
@@ -147,50 +398,109 @@ enum nss_status _nss_cash_getgrent_r(struct group *result, char *buffer, size_t
 }
 
 
-static enum nss_status internal_getgr(struct search_key *key, struct group *result, char *buffer, size_t buflen, int *errnop) {
+static enum nss_status group_lookup(const char *name, uint64_t gid, struct group *result, char *buffer, size_t buflen, int *errnop) {
     struct file f;
-    if (!map_file(NSSCASH_GROUP_FILE, &f)) {
+    uint64_t start = stats_now();
+    bool mapped = map_group(false, name, gid, &f);
+    stats_map(mapped && (f.shared == NULL || f.fresh), start);
+    if (!mapped) {
         *errnop = errno;
         return NSS_STATUS_UNAVAIL;
     }
     const struct header *h = f.header;
 
-    key->data = h->data + h->off_data;
-    uint64_t off_index = (key->name != NULL)
-                       ? h->off_name_index
-                       : h->off_id_index;
-    uint64_t *off = search(key, h->data + off_index, h->count);
-    if (off == NULL) {
+    bool hot;
+    const char *e = find_group(h, name, gid, &hot);
+    if (e == NULL) {
+        if (h->version & FEATURE_IMPLICIT_UPG) {
+            enum nss_status s =
+                lookup_upg(&f, name, gid, result, buffer, buflen, errnop);
+            unmap_file(&f);
+            return s;
+        }
         unmap_file(&f);
         errno = ENOENT;
         *errnop = errno;
         return NSS_STATUS_NOTFOUND;
     }
 
-    const char *e = key->data + *off;
-    if (!entry_to_group((struct group_entry *)e, result, buffer, buflen)) {
+    bool ok = hot
+            ? entry_to_group((const struct group_entry *)e, result, buffer, buflen)
+            : header_entry_to_group(h, e, result, buffer, buflen);
+    if (!ok) {
         unmap_file(&f);
         errno = ERANGE;
         *errnop = errno;
         return NSS_STATUS_TRYAGAIN;
     }
 
+#ifdef NSSCASH_GROUP_COUNTER_FILE
+    // Count by name so lookups by name and id are both counted
+    counter_hit(&lookup_counter, NSSCASH_GROUP_COUNTER_FILE, result->gr_name);
+#endif
+
     unmap_file(&f);
     return NSS_STATUS_SUCCESS;
 }
 
+// internal_getgr is like group_lookup() but uses the ids of the current user
+// namespace, see idmap.c.
+static enum nss_status internal_getgr(const char *name, uint64_t gid, struct group *result, char *buffer, size_t buflen, int *errnop) {
+    enum nss_status s;
+    // Look up again if the maps were replaced while mapping the file (see
+    // idmap_recheck()) as gid was translated with the old ones
+    for (int tries = 0; tries < 2; tries++) {
+        uint64_t generation = idmap_generation();
+        uint64_t file_gid = gid;
+        if (name == NULL && !idmap_id_to_file(IDMAP_GID, gid, &file_gid)) {
+            *errnop = errno;
+            return (errno == ENOENT) ? NSS_STATUS_NOTFOUND : NSS_STATUS_UNAVAIL;
+        }
+        s = group_lookup(name, file_gid, result, buffer, buflen, errnop);
+        if (name != NULL || generation == idmap_generation()) {
+            break;
+        }
+    }
+    if (s == NSS_STATUS_SUCCESS && !idmap_group_from_file(result)) {
+        *errnop = errno;
+        return NSS_STATUS_UNAVAIL;
+    }
+    return s;
+}
+
+#ifdef NSSCASH_PROBES
+// entry_size returns the size of the entry stored in buffer by a successful
+// lookup (the smallest buflen sufficient for it) for lookup__done.
+static size_t entry_size(enum nss_status s, const struct group *g) {
+    if (s != NSS_STATUS_SUCCESS) {
+        return 0;
+    }
+    size_t size = strlen(g->gr_name) + 1 + strlen(g->gr_passwd) + 1
+                + sizeof(char *);
+    for (char **m = g->gr_mem; *m != NULL; m++) {
+        size += sizeof(char *) + strlen(*m) + 1;
+    }
+    return size;
+}
+#endif
+
 enum nss_status _nss_cash_getgrgid_r(gid_t gid, struct group *result, char *buffer, size_t buflen, int *errnop) {
-    struct search_key key = {
-        .id = (uint64_t)gid,
-        .offset = offsetof(struct group_entry, gid),
-    };
-    return internal_getgr(&key, result, buffer, buflen, errnop);
+    PROBE(lookup__start, "group", NULL, (uint64_t)gid);
+    enum nss_status s = internal_getgr(NULL, (uint64_t)gid, result, buffer, buflen, errnop);
+    // *errnop is not set on success and might contain a stale value
+    int err = s == NSS_STATUS_SUCCESS ? 0 : *errnop;
+    PROBE(lookup__done, "group", NULL, (uint64_t)gid, (int)s, err, buflen,
+            entry_size(s, result));
+    stats_lookup(STAT_GROUP_LOOKUPS, s, err);
+    return s;
 }
 
 enum nss_status _nss_cash_getgrnam_r(const char *name, struct group *result, char *buffer, size_t buflen, int *errnop) {
-    struct search_key key = {
-        .name = name,
-        .offset = sizeof(struct group_entry), // name is first value in data[]
-    };
-    return internal_getgr(&key, result, buffer, buflen, errnop);
+    PROBE(lookup__start, "group", name, 0);
+    enum nss_status s = internal_getgr(name, 0, result, buffer, buflen, errnop);
+    int err = s == NSS_STATUS_SUCCESS ? 0 : *errnop;
+    PROBE(lookup__done, "group", name, 0, (int)s, err, buflen,
+            entry_size(s, result));
+    stats_lookup(STAT_GROUP_LOOKUPS, s, err);
+    return s;
 }
@@ -0,0 +1,78 @@
+/*
+ * Lookups in the hot-entry section
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hot.h"
+
+#include <string.h>
+
+#include "shard.h"
+
+
+// hot_id_hash hashes ids, see hotIdHash() in hot.go.
+static uint64_t hot_id_hash(uint64_t id) {
+    return (id * UINT64_C(0x9e3779b97f4a7c15)) >> 32;
+}
+
+// hot_lookup returns the entry with the given name (if not NULL) or id from
+// the hot-entry section of h or NULL if the file has no such section or the
+// entry is not stored in it. name_offset and id_offset are the offsets of the
+// name and id in the entry.
+const char *hot_lookup(const struct header *h, const char *name, uint64_t id, size_t name_offset, size_t id_offset) {
+    const struct section *s = find_section(h, SECTION_HOT);
+    if (s == NULL) {
+        return NULL;
+    }
+    const char *base = h->data + s->offset;
+    const struct hot_table *t = (const struct hot_table *)base;
+    // Ignore invalid tables, the normal lookup still works
+    if (s->offset % 8 != 0 || s->length < sizeof(*t)
+            || t->slots == 0 || (t->slots & (t->slots - 1)) != 0
+            || t->slots > (s->length - sizeof(*t)) / (2 * sizeof(uint64_t))) {
+        return NULL;
+    }
+
+    const uint64_t mask = t->slots - 1;
+    const uint64_t *index = (const uint64_t *)(base + sizeof(*t));
+    uint64_t i;
+    if (name != NULL) {
+        i = shard_hash(name) & mask; // same hash as for shards
+    } else {
+        index += t->slots;
+        i = hot_id_hash(id) & mask;
+    }
+
+    for (uint64_t n = 0; n < t->slots; n++, i = (i + 1) & mask) {
+        uint64_t off = index[i];
+        if (off == 0) {
+            break;
+        }
+        if (off >= s->length || s->length - off <= name_offset) {
+            break;
+        }
+        const char *e = base + off;
+        if (name != NULL) {
+            if (!strcmp(e + name_offset, name)) {
+                return e;
+            }
+        } else if (*(const uint64_t *)(e + id_offset) == id) {
+            return e;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,44 @@
+/*
+ * Lookups in the hot-entry section (header)
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOT_H
+#define HOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "file.h"
+
+
+// hot_table is the content of the optional SECTION_HOT section of passwd and
+// group files. It's stored directly after the header and contains complete
+// copies of frequently used entries in the basic format (struct
+// passwd_entry, struct group_entry) so lookups of these entries only touch
+// the first page(s) of the file. Both tables are direct-probe hash tables
+// with linear probing.
+struct hot_table {
+    uint64_t slots; // power of two
+    // slots name slots followed by slots id slots; each is the offset of the
+    // entry relative to the beginning of the section or 0 if empty
+    uint64_t index[];
+} __attribute__((packed));
+
+const char *hot_lookup(const struct header *h, const char *name, uint64_t id, size_t name_offset, size_t id_offset) __attribute__((visibility("hidden")));
+
+#endif
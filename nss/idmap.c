@@ -0,0 +1,246 @@
+/*
+ * Translate ids between the current user namespace and nsscash files
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "idmap.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+
+
+#ifdef NSSCASH_IDMAP_DIR
+
+// The files store the ids of the parent user namespace (usually the host)
+// and are translated with the maps of the current user namespace (see
+// user_namespaces(7)) so a single file can be bind-mounted into all (rootless)
+// containers. Each line of uid_map/gid_map maps the range [inside, inside +
+// count) of the current namespace to [outside, outside + count) of the
+// parent namespace.
+struct idmap_range {
+    uint64_t inside;
+    uint64_t outside;
+    uint64_t count;
+};
+
+// Maximum number of lines per map permitted by the kernel
+#define IDMAP_MAX_RANGES 340
+
+// Ids without mapping are shown as the overflow id (the default of
+// /proc/sys/kernel/overflowuid and overflowgid), like the kernel does
+#define IDMAP_OVERFLOW_ID 65534
+
+struct idmap {
+    size_t count;
+    struct idmap_range ranges[IDMAP_MAX_RANGES];
+};
+
+// The maps of the current user namespace. They can only be written once per
+// user namespace; therefore, they are read only again when the file was
+// (re)mapped and the process has changed its user namespace (the inode of
+// ns/user differs) or they were still empty. Published maps are never
+// modified so translations only need an atomic load and no lock; replaced
+// maps are never freed as concurrent lookups might still use them (a process
+// changes its user namespace only rarely).
+struct idmaps {
+    dev_t dev;
+    ino_t ino;
+    bool complete; // both maps were written
+    struct idmap maps[2]; // indexed by enum idmap_type
+    struct idmaps *older; // previously allocated maps
+};
+static struct idmaps *current;
+// All allocated maps (linked by older), protected by current_lock
+static struct idmaps *allocated;
+// Incremented whenever current is replaced, see idmap_generation()
+static uint64_t current_generation;
+// Serializes updates of current
+static pthread_mutex_t current_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool read_map(const char *path, struct idmap *m) {
+    FILE *fh = fopen(path, "re");
+    if (fh == NULL) {
+        return false;
+    }
+
+    m->count = 0;
+    struct idmap_range r;
+    int n;
+    while ((n = fscanf(fh, "%" SCNu64 " %" SCNu64 " %" SCNu64,
+                    &r.inside, &r.outside, &r.count)) == 3) {
+        if (m->count == IDMAP_MAX_RANGES) {
+            break;
+        }
+        m->ranges[m->count++] = r;
+    }
+    bool ok = n == EOF && !ferror(fh);
+    fclose(fh);
+    if (!ok) {
+        errno = EINVAL;
+    }
+    return ok;
+}
+
+static void publish_maps(struct idmaps *m) {
+    __atomic_store_n(&current, m, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&current_generation, 1, __ATOMIC_RELEASE);
+}
+
+// update_maps reads the maps again if the user namespace has changed or
+// they were empty; must be called with current_lock held.
+static bool update_maps(void) {
+    struct stat s;
+    if (stat(NSSCASH_IDMAP_DIR "/ns/user", &s) != 0) {
+        return false;
+    }
+    struct idmaps *old = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    bool same = old != NULL && old->dev == s.st_dev && old->ino == s.st_ino;
+    if (same && old->complete) {
+        return true;
+    }
+
+    struct idmaps *m = malloc(sizeof(*m));
+    if (m == NULL) {
+        return false;
+    }
+    if (!read_map(NSSCASH_IDMAP_DIR "/uid_map", &m->maps[IDMAP_UID])
+            || !read_map(NSSCASH_IDMAP_DIR "/gid_map",
+                         &m->maps[IDMAP_GID])) {
+        int err = errno;
+        free(m);
+        // Lookups fail until the maps of the new namespace can be read
+        if (!same) {
+            publish_maps(NULL);
+        }
+        errno = err;
+        return false;
+    }
+    m->dev = s.st_dev;
+    m->ino = s.st_ino;
+    // The maps of a new user namespace are empty until they are written by
+    // a process in the parent namespace, read them again on the next call
+    m->complete = m->maps[IDMAP_UID].count > 0
+               && m->maps[IDMAP_GID].count > 0;
+    if (same && !m->complete) {
+        // Still empty, keep the published maps to prevent unbounded leaks
+        free(m);
+        return true;
+    }
+    m->older = allocated;
+    allocated = m;
+    publish_maps(m);
+    return true;
+}
+
+// get_maps returns the current maps, reading them on the first call or if
+// they were still empty.
+static const struct idmaps *get_maps(void) {
+    const struct idmaps *m = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (m != NULL && m->complete) {
+        return m;
+    }
+    pthread_mutex_lock(&current_lock);
+    bool ok = update_maps();
+    m = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    pthread_mutex_unlock(&current_lock);
+    if (!ok) {
+        return NULL;
+    }
+    return m;
+}
+
+// idmap_recheck reads the maps again if the user namespace has changed; it
+// is called when the file was (re)mapped so lookups with a mapped file cost
+// no syscall.
+bool idmap_recheck(void) {
+    pthread_mutex_lock(&current_lock);
+    bool ok = update_maps();
+    pthread_mutex_unlock(&current_lock);
+    return ok;
+}
+
+// idmap_generation returns a value which changes whenever the maps were
+// replaced, e.g. by idmap_recheck() during a lookup which used the old maps.
+uint64_t idmap_generation(void) {
+    return __atomic_load_n(&current_generation, __ATOMIC_ACQUIRE);
+}
+
+static bool map_id(const struct idmap *m, bool to_file, uint64_t id, uint64_t *result) {
+    for (size_t i = 0; i < m->count; i++) {
+        const struct idmap_range *r = &m->ranges[i];
+        uint64_t from = to_file ? r->inside : r->outside;
+        uint64_t to = to_file ? r->outside : r->inside;
+        if (id >= from && id - from < r->count) {
+            *result = to + (id - from);
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t map_from_file(const struct idmaps *m, enum idmap_type type, uint64_t id) {
+    uint64_t x;
+    if (!map_id(&m->maps[type], false, id, &x)) {
+        return IDMAP_OVERFLOW_ID;
+    }
+    return x;
+}
+
+// idmap_id_to_file translates id of the current user namespace to the id
+// stored in the files. If id is not mapped false is returned and errno is
+// set to ENOENT.
+bool idmap_id_to_file(enum idmap_type type, uint64_t id, uint64_t *result) {
+    const struct idmaps *m = get_maps();
+    if (m == NULL) {
+        return false;
+    }
+    if (!map_id(&m->maps[type], true, id, result)) {
+        errno = ENOENT;
+        return false;
+    }
+    return true;
+}
+
+// idmap_passwd_from_file translates the ids of p (as stored in the file) to
+// the current user namespace.
+bool idmap_passwd_from_file(struct passwd *p) {
+    const struct idmaps *m = get_maps();
+    if (m == NULL) {
+        return false;
+    }
+    p->pw_uid = (uid_t)map_from_file(m, IDMAP_UID, p->pw_uid);
+    p->pw_gid = (gid_t)map_from_file(m, IDMAP_GID, p->pw_gid);
+    return true;
+}
+
+// idmap_group_from_file translates the gid of g (as stored in the file) to
+// the current user namespace.
+bool idmap_group_from_file(struct group *g) {
+    const struct idmaps *m = get_maps();
+    if (m == NULL) {
+        return false;
+    }
+    g->gr_gid = (gid_t)map_from_file(m, IDMAP_GID, g->gr_gid);
+    return true;
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Translate ids between the current user namespace and nsscash files
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <grp.h>
+#include <pwd.h>
+
+#include "file.h"
+
+
+enum idmap_type {
+    IDMAP_UID,
+    IDMAP_GID,
+};
+
+#ifdef NSSCASH_IDMAP_DIR
+bool idmap_id_to_file(enum idmap_type type, uint64_t id, uint64_t *result) __attribute__((visibility("hidden")));
+bool idmap_passwd_from_file(struct passwd *p) __attribute__((visibility("hidden")));
+bool idmap_group_from_file(struct group *g) __attribute__((visibility("hidden")));
+bool idmap_recheck(void) __attribute__((visibility("hidden")));
+uint64_t idmap_generation(void) __attribute__((visibility("hidden")));
+#else
+// Without id translation all calls are optimized away
+static inline bool idmap_id_to_file(enum idmap_type type, uint64_t id, uint64_t *result) {
+    (void)type;
+    *result = id;
+    return true;
+}
+static inline bool idmap_passwd_from_file(struct passwd *p) {
+    (void)p;
+    return true;
+}
+static inline bool idmap_group_from_file(struct group *g) {
+    (void)g;
+    return true;
+}
+static inline bool idmap_recheck(void) {
+    return true;
+}
+static inline uint64_t idmap_generation(void) {
+    return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * Public API to read nsscash files (libnsscash)
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "nsscash.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "entry.h"
+#include "file.h"
+#include "search.h"
+
+
+struct nsscash_file {
+    struct file file;
+};
+
+nsscash_file *nsscash_open(const char *path) {
+    nsscash_file *f = malloc(sizeof(*f));
+    if (f == NULL) {
+        return NULL;
+    }
+    if (!map_file(path, &f->file)) {
+        int save_errno = errno;
+        free(f);
+        errno = save_errno;
+        return NULL;
+    }
+    return f;
+}
+
+void nsscash_close(nsscash_file *f) {
+    if (f == NULL) {
+        return;
+    }
+    unmap_file(&f->file);
+    free(f);
+}
+
+uint64_t nsscash_count(const nsscash_file *f) {
+    return f->file.header->count;
+}
+
+
+static const char *entry_at_index(const nsscash_file *f, uint64_t off_index, uint64_t index) {
+    const struct header *h = f->file.header;
+    return h->data + h->off_data + index_offset(h, off_index, index);
+}
+
+static const char *entry_by_key(const nsscash_file *f, struct search_key *key) {
+    const struct header *h = f->file.header;
+
+    key->data = h->data + h->off_data;
+    uint64_t off_index = (key->name != NULL)
+                       ? h->off_name_index
+                       : h->off_id_index;
+    uint64_t off;
+    if (!search_index(key, h, off_index, &off)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    return (const char *)key->data + off;
+}
+
+// lookup_ids searches all (sorted) ids in the id index with a single merge
+// pass. The position in the index only moves forward: an exponential search
+// starting at the last position finds the next candidate range which is then
+// searched with a binary search. found() is called for each found id.
+static size_t lookup_ids(const nsscash_file *f, const uint64_t *ids, size_t n, void (*found)(const struct header *h, const char *entry, size_t i, void *results), void (*missing)(size_t i, void *results), void *results) {
+    const struct header *h = f->file.header;
+    const char *data = h->data + h->off_data;
+#define ENTRY_AT(i) (data + index_offset(h, h->off_id_index, (i)))
+    // The id is the first member of all passwd and group entries
+#define ID_AT(i) (*(const uint64_t *)ENTRY_AT(i))
+
+    size_t count = 0;
+    uint64_t pos = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t id = ids[i];
+
+        // Exponential search for an upper bound
+        uint64_t step = 1;
+        uint64_t right = pos;
+        while (right < h->count && ID_AT(right) < id) {
+            pos = right + 1;
+            right = pos + step;
+            step *= 2;
+        }
+        if (right > h->count) {
+            right = h->count;
+        }
+        // Binary search in [pos, right) for the first entry >= id
+        while (pos < right) {
+            uint64_t middle = pos + (right - pos) / 2;
+            if (ID_AT(middle) < id) {
+                pos = middle + 1;
+            } else {
+                right = middle;
+            }
+        }
+
+        if (pos < h->count && ID_AT(pos) == id) {
+            found(h, ENTRY_AT(pos), i, results);
+            count++;
+        } else {
+            missing(i, results);
+        }
+    }
+
+#undef ID_AT
+#undef ENTRY_AT
+    return count;
+}
+
+
+static void entry_to_passwd(const struct header *h, const char *x, struct nsscash_passwd *p) {
+    if (h->version & FEATURE_STRING_TABLE) {
+        const struct passwd_entry_compact *e = (const void *)x;
+        const char *table = h->data + h->off_data;
+        p->uid = e->uid;
+        p->gid = e->gid;
+        p->name = e->data + 0;
+        p->passwd = table + e->off_passwd;
+        p->gecos = table + e->off_gecos;
+        p->dir = table + e->off_dir;
+        p->shell = table + e->off_shell;
+        return;
+    }
+
+    const struct passwd_entry *e = (const void *)x;
+    p->uid = e->uid;
+    p->gid = e->gid;
+    p->name = e->data + 0;
+    p->passwd = e->data + e->off_passwd;
+    p->gecos = e->data + e->off_gecos;
+    p->dir = e->data + e->off_dir;
+    p->shell = e->data + e->off_shell;
+}
+
+bool nsscash_passwd_get(const nsscash_file *f, uint64_t index, struct nsscash_passwd *result) {
+    const struct header *h = f->file.header;
+    if (index >= h->count) {
+        errno = ENOENT;
+        return false;
+    }
+    const char *e = entry_at_index(f, h->off_orig_index, index);
+    entry_to_passwd(f->file.header, e, result);
+    return true;
+}
+
+bool nsscash_passwd_by_uid(const nsscash_file *f, uint64_t uid, struct nsscash_passwd *result) {
+    struct search_key key = {
+        .id = uid,
+        .offset = offsetof(struct passwd_entry, uid),
+    };
+    const char *e = entry_by_key(f, &key);
+    if (e == NULL) {
+        return false;
+    }
+    entry_to_passwd(f->file.header, e, result);
+    return true;
+}
+
+bool nsscash_passwd_by_name(const nsscash_file *f, const char *name, struct nsscash_passwd *result) {
+    struct search_key key = {
+        .name = name,
+        // name is first value in data[]
+        .offset = (f->file.header->version & FEATURE_STRING_TABLE)
+                ? sizeof(struct passwd_entry_compact)
+                : sizeof(struct passwd_entry),
+    };
+    const char *e = entry_by_key(f, &key);
+    if (e == NULL) {
+        return false;
+    }
+    entry_to_passwd(f->file.header, e, result);
+    return true;
+}
+
+static void passwd_found(const struct header *h, const char *e, size_t i, void *results) {
+    struct nsscash_passwd *x = results;
+    entry_to_passwd(h, e, x + i);
+}
+static void passwd_missing(size_t i, void *results) {
+    struct nsscash_passwd *x = results;
+    memset(x + i, 0, sizeof(*x));
+}
+
+size_t nsscash_passwd_by_uids(const nsscash_file *f, const uint64_t *uids, size_t n, struct nsscash_passwd *results) {
+    return lookup_ids(f, uids, n, passwd_found, passwd_missing, results);
+}
+
+
+// priv[0] is the entry. priv[1] is NULL for struct group_entry (uint16_t
+// member offsets relative to data[]), otherwise the member offsets are
+// uint32_t and relative to priv[1] (the member table for
+// FEATURE_MEMBER_TABLE, data[] for FEATURE_LARGE_GROUPS).
+static void entry_to_group(const struct header *h, const char *x, struct nsscash_group *g) {
+    g->priv[0] = x;
+    if (h->version & (FEATURE_MEMBER_TABLE | FEATURE_LARGE_GROUPS)) {
+        // Both use the same layout
+        const struct group_entry_large *e = (const void *)x;
+        g->gid = e->gid;
+        g->name = e->data + 0;
+        g->passwd = e->data + e->off_passwd;
+        g->mem_count = e->mem_count;
+        g->priv[1] = (h->version & FEATURE_MEMBER_TABLE)
+                   ? h->data + h->off_data
+                   : e->data;
+        return;
+    }
+
+    const struct group_entry *e = (const void *)x;
+    g->gid = e->gid;
+    g->name = e->data + 0;
+    g->passwd = e->data + e->off_passwd;
+    g->mem_count = e->mem_count;
+    g->priv[1] = NULL;
+}
+
+const char *nsscash_group_member(const struct nsscash_group *g, uint64_t index) {
+    if (index >= g->mem_count) {
+        return NULL;
+    }
+    if (g->priv[1] != NULL) {
+        const struct group_entry_large *e = g->priv[0];
+        const char *base = g->priv[1];
+        const uint32_t *offs_mem = (const uint32_t *)(e->data + e->off_mem_off);
+        return base + offs_mem[index];
+    }
+    const struct group_entry *e = g->priv[0];
+    const uint16_t *offs_mem = (const uint16_t *)(e->data + e->off_mem_off);
+    return e->data + offs_mem[index];
+}
+
+bool nsscash_group_get(const nsscash_file *f, uint64_t index, struct nsscash_group *result) {
+    const struct header *h = f->file.header;
+    if (index >= h->count) {
+        errno = ENOENT;
+        return false;
+    }
+    const char *e = entry_at_index(f, h->off_orig_index, index);
+    entry_to_group(f->file.header, e, result);
+    return true;
+}
+
+bool nsscash_group_by_gid(const nsscash_file *f, uint64_t gid, struct nsscash_group *result) {
+    struct search_key key = {
+        .id = gid,
+        .offset = offsetof(struct group_entry, gid),
+    };
+    const char *e = entry_by_key(f, &key);
+    if (e == NULL) {
+        return false;
+    }
+    entry_to_group(f->file.header, e, result);
+    return true;
+}
+
+bool nsscash_group_by_name(const nsscash_file *f, const char *name, struct nsscash_group *result) {
+    struct search_key key = {
+        .name = name,
+        // name is first value in data[]
+        .offset = (f->file.header->version
+                        & (FEATURE_MEMBER_TABLE | FEATURE_LARGE_GROUPS))
+                ? sizeof(struct group_entry_large)
+                : sizeof(struct group_entry),
+    };
+    const char *e = entry_by_key(f, &key);
+    if (e == NULL) {
+        return false;
+    }
+    entry_to_group(f->file.header, e, result);
+    return true;
+}
+
+static void group_found(const struct header *h, const char *e, size_t i, void *results) {
+    struct nsscash_group *x = results;
+    entry_to_group(h, e, x + i);
+}
+static void group_missing(size_t i, void *results) {
+    struct nsscash_group *x = results;
+    memset(x + i, 0, sizeof(*x));
+}
+
+size_t nsscash_group_by_gids(const nsscash_file *f, const uint64_t *gids, size_t n, struct nsscash_group *results) {
+    return lookup_ids(f, gids, n, group_found, group_missing, results);
+}
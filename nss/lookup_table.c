@@ -0,0 +1,93 @@
+/*
+ * Print rows of an nsscash table file matching a key
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "table.h"
+
+
+// Exit status if no row was found, like getent(1)
+#define EXIT_NOTFOUND 2
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <path> <column> <value>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[1];
+
+    struct file f;
+    if (!map_file_table(path, &f)) {
+        fprintf(stderr, "%s: failed to load %s: %s\n",
+                argv[0], path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const struct header *h = f.header;
+    const struct table_schema *s = table_schema(&f);
+    if (s == NULL) {
+        fprintf(stderr, "%s: invalid table %s: %s\n",
+                argv[0], path, strerror(errno));
+        unmap_file(&f);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t column;
+    if (!table_column(h, argv[2], &column)) {
+        fprintf(stderr, "%s: unknown column %s\n", argv[0], argv[2]);
+        unmap_file(&f);
+        return EXIT_FAILURE;
+    }
+
+    const struct table_index *x = table_column_index(h, column);
+    if (x == NULL) {
+        fprintf(stderr, "%s: column %s is not indexed\n", argv[0], argv[2]);
+        unmap_file(&f);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t count;
+    const uint64_t *key = table_lookup(h, x, argv[3], &count);
+    if (key == NULL) {
+        unmap_file(&f);
+        return EXIT_NOTFOUND;
+    }
+
+    // Print the rows in the input format
+    uint64_t columns = s->column_count;
+    for (uint64_t i = 0; i < count; i++) {
+        const struct table_row *row = table_key_row(h, key + i);
+        for (uint64_t j = 0; j < columns; j++) {
+            if (j != 0) {
+                putchar(':');
+            }
+            fputs(table_value(row, j), stdout);
+        }
+        putchar('\n');
+    }
+
+    unmap_file(&f);
+    if (fflush(stdout)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
+ * Public API to read nsscash files (libnsscash)
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef NSSCASH_H
+#define NSSCASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * An open nsscash file (passwd or group). All returned strings point
+ * directly into the mapping of the file (no copies) and stay valid until
+ * nsscash_close() is called. An open file is never modified and can be used
+ * by multiple threads concurrently.
+ */
+typedef struct nsscash_file nsscash_file;
+
+// nsscash_open maps the nsscash file at path. Returns NULL and sets errno on
+// error.
+nsscash_file *nsscash_open(const char *path);
+void nsscash_close(nsscash_file *f);
+
+// nsscash_count returns the number of entries in the file.
+uint64_t nsscash_count(const nsscash_file *f);
+
+
+struct nsscash_passwd {
+    const char *name;
+    const char *passwd;
+    uint64_t uid;
+    uint64_t gid;
+    const char *gecos;
+    const char *dir;
+    const char *shell;
+};
+
+/*
+ * Lookup functions return true if an entry was found and false otherwise
+ * (errno is set to ENOENT).
+ *
+ * nsscash_passwd_get returns the entry at index (0 <= index < count) in the
+ * order of the original file and can be used to iterate over all entries.
+ */
+bool nsscash_passwd_get(const nsscash_file *f, uint64_t index, struct nsscash_passwd *result);
+bool nsscash_passwd_by_uid(const nsscash_file *f, uint64_t uid, struct nsscash_passwd *result);
+bool nsscash_passwd_by_name(const nsscash_file *f, const char *name, struct nsscash_passwd *result);
+/*
+ * nsscash_passwd_by_uids looks up all n uids, which must be sorted in
+ * ascending order, with a single pass over the id index. results[i] receives
+ * the entry for uids[i]; its name is NULL if the uid was not found. Returns
+ * the number of found entries.
+ */
+size_t nsscash_passwd_by_uids(const nsscash_file *f, const uint64_t *uids, size_t n, struct nsscash_passwd *results);
+
+
+struct nsscash_group {
+    const char *name;
+    const char *passwd;
+    uint64_t gid;
+    uint64_t mem_count; // see nsscash_group_member()
+
+    const void *priv[2]; // internal, do not use
+};
+
+// nsscash_group_member returns member index (0 <= index < mem_count) of the
+// group.
+const char *nsscash_group_member(const struct nsscash_group *g, uint64_t index);
+
+// See the passwd functions above
+bool nsscash_group_get(const nsscash_file *f, uint64_t index, struct nsscash_group *result);
+bool nsscash_group_by_gid(const nsscash_file *f, uint64_t gid, struct nsscash_group *result);
+bool nsscash_group_by_name(const nsscash_file *f, const char *name, struct nsscash_group *result);
+size_t nsscash_group_by_gids(const nsscash_file *f, const uint64_t *gids, size_t n, struct nsscash_group *results);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
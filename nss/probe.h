@@ -0,0 +1,50 @@
+/*
+ * Static tracepoints (USDT) for tracing with e.g. bpftrace
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+// The tracepoints are only available if <sys/sdt.h> (systemtap-sdt-dev on
+// Debian) is installed when building the module, define NSSCASH_NO_PROBES to
+// disable them. Each one is a single nop instruction unless it's traced.
+//
+// Tracepoints of provider "nsscash" (see bpftrace/ for examples):
+// - lookup__start(db, name, id): start of a lookup in db ("passwd" or
+//   "group") by name (if not NULL) or id
+// - lookup__done(db, name, id, status, errno, buflen, size): end of a
+//   lookup, status is the enum nss_status and errno is 0 on success; status
+//   NSS_STATUS_TRYAGAIN with errno ERANGE means buflen was too small and the
+//   caller retries; size is the size of the returned entry in buffer (0
+//   unless successful)
+// - getent(db, status): end of getpwent_r()/getgrent_r()
+// - map__file(path, ok, size): path was mapped (ok = 1) or the mapping failed
+#if defined(__has_include) && !defined(NSSCASH_NO_PROBES)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define NSSCASH_PROBES
+# endif
+#endif
+
+#ifdef NSSCASH_PROBES
+# define PROBE(...) STAP_PROBEV(nsscash, __VA_ARGS__)
+#else
+# define PROBE(...) do { } while (0)
+#endif
+
+#endif
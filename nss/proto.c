@@ -0,0 +1,221 @@
+/*
+ * Handle protocols entries via struct protoent
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "cash_nss.h"
+#include "file.h"
+#include "search.h"
+
+
+// NOTE: This file is very similar to serv.c, keep in sync!
+
+struct protocol_entry {
+    uint64_t number;
+
+    //       off_name = 0, not stored on disk
+    uint16_t off_aliases_off;
+
+    uint16_t aliases_count; // alias count
+
+    /*
+     * Data contains the name with its trailing NUL.
+     *
+     * After that the offsets of the aliases are stored as aliases_count
+     * uint16_t values, followed by the aliases concatenated as with the
+     * name above.
+     *
+     * All offsets are relative to the beginning of data.
+     */
+    uint16_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+static bool entry_to_protoent(const struct protocol_entry *e, struct protoent *p, char *tmp, size_t space) {
+    // Space required for the p_aliases array
+    const size_t aliases_size = (size_t)(e->aliases_count + 1) * sizeof(char *);
+
+    if (space < e->data_size + aliases_size) {
+        return false;
+    }
+
+    char **aliases = (char **)tmp;
+
+    const uint16_t *offs_aliases = (const uint16_t *)(e->data + e->off_aliases_off);
+    for (uint16_t i = 0; i < e->aliases_count; i++) {
+        aliases[i] = tmp + aliases_size + offs_aliases[i];
+    }
+    aliases[e->aliases_count] = NULL;
+
+    // This unnecessarily copies offs_aliases[] as well but keeps the code
+    // simpler and the meaning of variables consistent with gr.c
+    memcpy(tmp + aliases_size, e->data, e->data_size);
+
+    p->p_proto = (int)e->number;
+    p->p_name = tmp + aliases_size + 0;
+    p->p_aliases = aliases;
+
+    return true;
+}
+
+
+static struct file static_file = {
+    .fd = -1,
+};
+static pthread_mutex_t static_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void internal_unmap_static_file(void) {
+    pthread_mutex_lock(&static_file_lock);
+    unmap_file(&static_file);
+    pthread_mutex_unlock(&static_file_lock);
+}
+
+enum nss_status _nss_cash_setprotoent(int x) {
+    (void)x;
+
+    // Unmap is necessary to detect changes when the file was replaced on
+    // disk; getprotoent_r will open the file if necessary when called
+    internal_unmap_static_file();
+    return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status _nss_cash_endprotoent(void) {
+    internal_unmap_static_file();
+    return NSS_STATUS_SUCCESS;
+}
+
+static enum nss_status internal_getprotoent_r(struct protoent *result, char *buffer, size_t buflen) {
+    // First call to getprotoent_r, load file from disk
+    if (static_file.header == NULL) {
+        if (!map_file(NSSCASH_PROTOCOLS_FILE, &static_file)) {
+            return NSS_STATUS_UNAVAIL;
+        }
+    }
+
+    const struct header *h = static_file.header;
+    // End of "file", stop
+    if (static_file.next_index >= h->count) {
+        errno = ENOENT;
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    uint64_t *off_orig = (uint64_t *)(h->data + h->off_orig_index);
+    const char *e = h->data + h->off_data + off_orig[static_file.next_index];
+    if (!entry_to_protoent((struct protocol_entry *)e, result, buffer, buflen)) {
+        errno = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    static_file.next_index++;
+
+    return NSS_STATUS_SUCCESS;
+}
+enum nss_status _nss_cash_getprotoent_r(struct protoent *result, char *buffer, size_t buflen, int *errnop) {
+    pthread_mutex_lock(&static_file_lock);
+    enum nss_status s = internal_getprotoent_r(result, buffer, buflen);
+    pthread_mutex_unlock(&static_file_lock);
+    if (s != NSS_STATUS_SUCCESS) {
+        *errnop = errno;
+    }
+    return s;
+}
+
+
+// find_by_name returns the entry which has name as name or alias.
+static const struct protocol_entry *find_by_name(const struct header *h, const char *name) {
+    const char *data = h->data + h->off_data;
+    const uint64_t *index = (const uint64_t *)(h->data + h->off_name_index);
+
+    const struct search_key key = {
+        .name = name,
+        .data = data,
+        .offset = offsetof(struct name_key, name),
+    };
+    // The first key record is the first in input order (like the "files"
+    // NSS module)
+    const uint64_t *off = search_first(&key, index + 1, index[0]);
+    if (off == NULL) {
+        return NULL;
+    }
+    const struct name_key *k = (const struct name_key *)(data + *off);
+    return (const struct protocol_entry *)(data + k->off_entry);
+}
+
+// find_by_number returns the first entry with the given number.
+static const struct protocol_entry *find_by_number(const struct header *h, uint64_t number) {
+    const char *data = h->data + h->off_data;
+
+    const struct search_key key = {
+        .id = number,
+        .data = data,
+        .offset = offsetof(struct protocol_entry, number),
+    };
+    const uint64_t *off = search_first(&key, h->data + h->off_id_index, h->count);
+    if (off == NULL) {
+        return NULL;
+    }
+    return (const struct protocol_entry *)(data + *off);
+}
+
+static enum nss_status internal_getproto(const char *name, uint64_t number, struct protoent *result, char *buffer, size_t buflen, int *errnop) {
+    struct file f;
+    if (!map_file(NSSCASH_PROTOCOLS_FILE, &f)) {
+        *errnop = errno;
+        return NSS_STATUS_UNAVAIL;
+    }
+    const struct header *h = f.header;
+
+    const struct protocol_entry *e = (name != NULL)
+                                   ? find_by_name(h, name)
+                                   : find_by_number(h, number);
+    if (e == NULL) {
+        unmap_file(&f);
+        errno = ENOENT;
+        *errnop = errno;
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    if (!entry_to_protoent(e, result, buffer, buflen)) {
+        unmap_file(&f);
+        errno = ERANGE;
+        *errnop = errno;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    unmap_file(&f);
+    return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status _nss_cash_getprotobyname_r(const char *name, struct protoent *result, char *buffer, size_t buflen, int *errnop) {
+    return internal_getproto(name, 0, result, buffer, buflen, errnop);
+}
+
+enum nss_status _nss_cash_getprotobynumber_r(int number, struct protoent *result, char *buffer, size_t buflen, int *errnop) {
+    if (number < 0) {
+        errno = ENOENT;
+        *errnop = errno;
+        return NSS_STATUS_NOTFOUND;
+    }
+    return internal_getproto(NULL, (uint64_t)number, result, buffer, buflen, errnop);
+}
@@ -26,31 +26,20 @@
 #include <pthread.h>
 
 #include "cash_nss.h"
+#include "counter.h"
+#include "entry.h"
 #include "file.h"
+#include "hot.h"
+#include "idmap.h"
+#include "probe.h"
+#include "pw.h"
 #include "search.h"
+#include "shard.h"
+#include "stats.h"
 
 
 // NOTE: This file is very similar to gr.c, keep in sync!
 
-struct passwd_entry {
-    uint64_t uid;
-    uint64_t gid;
-
-    //       off_name = 0, not stored on disk
-    uint16_t off_passwd;
-    uint16_t off_gecos;
-    uint16_t off_dir;
-    uint16_t off_shell;
-
-    /*
-     * Data contains all strings (name, passwd, gecos, dir, shell)
-     * concatenated, with their trailing NUL. The off_* variables point to
-     * beginning of each string.
-     */
-    uint16_t data_size; // size of data in bytes
-    const char data[];
-} __attribute__((packed));
-
 static bool entry_to_passwd(const struct passwd_entry *e, struct passwd *p, char *tmp, size_t space) {
     if (space < e->data_size) {
         return false;
@@ -68,6 +57,85 @@ static bool entry_to_passwd(const struct passwd_entry *e, struct passwd *p, char
     return true;
 }
 
+static bool entry_compact_to_passwd(const struct header *h, const struct passwd_entry_compact *e, struct passwd *p, char *tmp, size_t space) {
+    const char *table = h->data + h->off_data;
+    const char *strs[] = {
+        table + e->off_passwd,
+        table + e->off_gecos,
+        table + e->off_dir,
+        table + e->off_shell,
+    };
+    char **fields[] = {
+        &p->pw_passwd,
+        &p->pw_gecos,
+        &p->pw_dir,
+        &p->pw_shell,
+    };
+
+    size_t lens[4];
+    size_t size = e->data_size;
+    for (size_t i = 0; i < 4; i++) {
+        lens[i] = strlen(strs[i]) + 1;
+        size += lens[i];
+    }
+    if (space < size) {
+        return false;
+    }
+
+    memcpy(tmp, e->data, e->data_size);
+    p->pw_name = tmp + 0;
+    tmp += e->data_size;
+    for (size_t i = 0; i < 4; i++) {
+        memcpy(tmp, strs[i], lens[i]);
+        *fields[i] = tmp;
+        tmp += lens[i];
+    }
+    p->pw_uid = (uid_t)e->uid;
+    p->pw_gid = (gid_t)e->gid;
+
+    return true;
+}
+
+static bool header_entry_to_passwd(const struct header *h, const char *e, struct passwd *p, char *tmp, size_t space) {
+    if (h->version & FEATURE_STRING_TABLE) {
+        return entry_compact_to_passwd(h,
+                (const struct passwd_entry_compact *)e, p, tmp, space);
+    }
+    return entry_to_passwd((const struct passwd_entry *)e, p, tmp, space);
+}
+
+
+// map_passwd maps the file containing the entry with the given name (if not
+// NULL) or id; or the first file to iterate over all entries if all is true.
+static bool map_passwd(bool all, const char *name, uint64_t id, struct file *f) {
+    bool ok;
+#ifdef NSSCASH_COMBINED_FILE
+    (void)all;
+    (void)name;
+    (void)id;
+    ok = map_file_section(NSSCASH_COMBINED_FILE, SECTION_PASSWD, f);
+#else
+    if (all) {
+        ok = map_file_first(NSSCASH_PASSWD_FILE, f);
+    } else {
+        ok = map_file_key(NSSCASH_PASSWD_FILE, name, id, f);
+    }
+#endif
+    // The user namespace is checked only when the file was (re)mapped
+    if (ok && (f->shared == NULL || f->fresh) && !idmap_recheck()) {
+        int err = errno;
+        unmap_file(f);
+        errno = err;
+        return false;
+    }
+    return ok;
+}
+
+
+#ifdef NSSCASH_PASSWD_COUNTER_FILE
+static struct counter lookup_counter = COUNTER_INITIALIZER;
+#endif
+
 
 static struct file static_file = {
     .fd = -1,
@@ -94,35 +162,47 @@ enum nss_status _nss_cash_endpwent(void) {
     return NSS_STATUS_SUCCESS;
 }
 
-static enum nss_status internal_getpwent_r(struct passwd *result, char *buffer, size_t buflen) {
+// passwd_next stores the next entry of the iteration f in result; f is
+// mapped on the first call (f->header == NULL) and must be unmapped by the
+// caller. Also used by gr.c.
+enum nss_status passwd_next(struct file *f, struct passwd *result, char *buffer, size_t buflen) {
     // First call to getpwent_r, load file from disk
-    if (static_file.header == NULL) {
-        if (!map_file(NSSCASH_PASSWD_FILE, &static_file)) {
+    if (f->header == NULL) {
+        if (!map_passwd(true, NULL, 0, f)) {
             return NSS_STATUS_UNAVAIL;
         }
     }
 
-    const struct header *h = static_file.header;
-    // End of "file", stop
-    if (static_file.next_index >= h->count) {
-        errno = ENOENT;
-        return NSS_STATUS_NOTFOUND;
+    // End of "file" (or the current shard), continue with the next shard
+    while (f->next_index >= f->header->count) {
+        if (!map_file_next(NSSCASH_PASSWD_FILE, f)) {
+            // No more shards, stop
+            if (errno == ENOENT) {
+                return NSS_STATUS_NOTFOUND;
+            }
+            return NSS_STATUS_UNAVAIL;
+        }
     }
+    const struct header *h = f->header;
 
-    uint64_t *off_orig = (uint64_t *)(h->data + h->off_orig_index);
-    const char *e = h->data + h->off_data + off_orig[static_file.next_index];
-    if (!entry_to_passwd((struct passwd_entry *)e, result, buffer, buflen)) {
+    const char *e = h->data + h->off_data
+        + index_offset(h, h->off_orig_index, f->next_index);
+    if (!header_entry_to_passwd(h, e, result, buffer, buflen)) {
         errno = ERANGE;
         return NSS_STATUS_TRYAGAIN;
     }
-    static_file.next_index++;
+    f->next_index++;
 
     return NSS_STATUS_SUCCESS;
 }
 enum nss_status _nss_cash_getpwent_r(struct passwd *result, char *buffer, size_t buflen, int *errnop) {
     pthread_mutex_lock(&static_file_lock);
-    enum nss_status s = internal_getpwent_r(result, buffer, buflen);
+    enum nss_status s = passwd_next(&static_file, result, buffer, buflen);
     pthread_mutex_unlock(&static_file_lock);
+    if (s == NSS_STATUS_SUCCESS && !idmap_passwd_from_file(result)) {
+        s = NSS_STATUS_UNAVAIL;
+    }
+    PROBE(getent, "passwd", (int)s);
     if (s != NSS_STATUS_SUCCESS) {
         *errnop = errno;
     }
@@ -130,50 +210,141 @@ enum nss_status _nss_cash_getpwent_r(struct passwd *result, char *buffer, size_t
 }
 
 
-static enum nss_status internal_getpw(struct search_key *key, struct passwd *result, char *buffer, size_t buflen, int *errnop) {
+// passwd_search looks up the entry with the given name (if not NULL) or uid
+// in the mapped file h without counting the lookup. Also used by gr.c.
+enum nss_status passwd_search(const struct header *h, const char *name, uint64_t uid, struct passwd *result, char *buffer, size_t buflen, int *errnop) {
+    // Frequently used entries are stored completely in the hot-entry section
+    // (in the basic format) to touch as few pages as possible
+    bool ok;
+    const char *e = hot_lookup(h, name, uid,
+            sizeof(struct passwd_entry), offsetof(struct passwd_entry, uid));
+    if (e != NULL) {
+        ok = entry_to_passwd((const struct passwd_entry *)e, result, buffer, buflen);
+    } else {
+        struct search_key key = {
+            .name = name,
+            .id = uid,
+            .data = h->data + h->off_data,
+        };
+        if (name != NULL) {
+            // name is first value in data[]
+            key.offset = (h->version & FEATURE_STRING_TABLE)
+                       ? sizeof(struct passwd_entry_compact)
+                       : sizeof(struct passwd_entry);
+        } else {
+            key.offset = offsetof(struct passwd_entry, uid);
+        }
+        uint64_t off_index = (key.name != NULL)
+                           ? h->off_name_index
+                           : h->off_id_index;
+        uint64_t off;
+        if (!search_index(&key, h, off_index, &off)) {
+            errno = ENOENT;
+            *errnop = errno;
+            return NSS_STATUS_NOTFOUND;
+        }
+
+        e = key.data + off;
+        ok = header_entry_to_passwd(h, e, result, buffer, buflen);
+    }
+    if (!ok) {
+        errno = ERANGE;
+        *errnop = errno;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    return NSS_STATUS_SUCCESS;
+}
+
+// passwd_lookup looks up the entry with the given name (if not NULL) or uid,
+// like getpwnam_r/getpwuid_r but without tracing and statistics.
+static enum nss_status passwd_lookup(const char *name, uint64_t uid, struct passwd *result, char *buffer, size_t buflen, int *errnop) {
     struct file f;
-    if (!map_file(NSSCASH_PASSWD_FILE, &f)) {
+    uint64_t start = stats_now();
+    bool mapped = map_passwd(false, name, uid, &f);
+    stats_map(mapped && (f.shared == NULL || f.fresh), start);
+    if (!mapped) {
         *errnop = errno;
         return NSS_STATUS_UNAVAIL;
     }
-    const struct header *h = f.header;
 
-    key->data = h->data + h->off_data;
-    uint64_t off_index = (key->name != NULL)
-                       ? h->off_name_index
-                       : h->off_id_index;
-    uint64_t *off = search(key, h->data + off_index, h->count);
-    if (off == NULL) {
-        unmap_file(&f);
-        errno = ENOENT;
-        *errnop = errno;
-        return NSS_STATUS_NOTFOUND;
+    enum nss_status s =
+        passwd_search(f.header, name, uid, result, buffer, buflen, errnop);
+#ifdef NSSCASH_PASSWD_COUNTER_FILE
+    if (s == NSS_STATUS_SUCCESS) {
+        // Count by name so lookups by name and id are both counted
+        counter_hit(&lookup_counter, NSSCASH_PASSWD_COUNTER_FILE,
+                result->pw_name);
     }
+#endif
 
-    const char *e = key->data + *off;
-    if (!entry_to_passwd((struct passwd_entry *)e, result, buffer, buflen)) {
-        unmap_file(&f);
-        errno = ERANGE;
+    unmap_file(&f);
+    return s;
+}
+
+// internal_getpw is like passwd_lookup() but uses the ids of the current user
+// namespace, see idmap.c.
+static enum nss_status internal_getpw(const char *name, uint64_t uid, struct passwd *result, char *buffer, size_t buflen, int *errnop) {
+    enum nss_status s;
+    // Look up again if the maps were replaced while mapping the file (see
+    // idmap_recheck()) as uid was translated with the old ones
+    for (int tries = 0; tries < 2; tries++) {
+        uint64_t generation = idmap_generation();
+        uint64_t file_uid = uid;
+        if (name == NULL && !idmap_id_to_file(IDMAP_UID, uid, &file_uid)) {
+            *errnop = errno;
+            return (errno == ENOENT) ? NSS_STATUS_NOTFOUND : NSS_STATUS_UNAVAIL;
+        }
+        s = passwd_lookup(name, file_uid, result, buffer, buflen, errnop);
+        if (name != NULL || generation == idmap_generation()) {
+            break;
+        }
+    }
+    if (s == NSS_STATUS_SUCCESS && !idmap_passwd_from_file(result)) {
         *errnop = errno;
-        return NSS_STATUS_TRYAGAIN;
+        return NSS_STATUS_UNAVAIL;
     }
+    return s;
+}
 
-    unmap_file(&f);
-    return NSS_STATUS_SUCCESS;
+#ifdef NSSCASH_PROBES
+// entry_size returns the size of the entry stored in buffer by a successful
+// lookup (the smallest buflen sufficient for it) for lookup__done.
+static size_t entry_size(enum nss_status s, const struct passwd *p) {
+    if (s != NSS_STATUS_SUCCESS) {
+        return 0;
+    }
+    const char *strs[] = {
+        p->pw_name,
+        p->pw_passwd,
+        p->pw_gecos,
+        p->pw_dir,
+        p->pw_shell,
+    };
+    size_t size = 0;
+    for (size_t i = 0; i < 5; i++) {
+        size += strlen(strs[i]) + 1;
+    }
+    return size;
 }
+#endif
 
 enum nss_status _nss_cash_getpwuid_r(uid_t uid, struct passwd *result, char *buffer, size_t buflen, int *errnop) {
-    struct search_key key = {
-        .id = (uint64_t)uid,
-        .offset = offsetof(struct passwd_entry, uid),
-    };
-    return internal_getpw(&key, result, buffer, buflen, errnop);
+    PROBE(lookup__start, "passwd", NULL, (uint64_t)uid);
+    enum nss_status s = internal_getpw(NULL, (uint64_t)uid, result, buffer, buflen, errnop);
+    // *errnop is not set on success and might contain a stale value
+    int err = s == NSS_STATUS_SUCCESS ? 0 : *errnop;
+    PROBE(lookup__done, "passwd", NULL, (uint64_t)uid, (int)s, err, buflen,
+            entry_size(s, result));
+    stats_lookup(STAT_PASSWD_LOOKUPS, s, err);
+    return s;
 }
 
 enum nss_status _nss_cash_getpwnam_r(const char *name, struct passwd *result, char *buffer, size_t buflen, int *errnop) {
-    struct search_key key = {
-        .name = name,
-        .offset = sizeof(struct passwd_entry), // name is first value in data[]
-    };
-    return internal_getpw(&key, result, buffer, buflen, errnop);
+    PROBE(lookup__start, "passwd", name, 0);
+    enum nss_status s = internal_getpw(name, 0, result, buffer, buflen, errnop);
+    int err = s == NSS_STATUS_SUCCESS ? 0 : *errnop;
+    PROBE(lookup__done, "passwd", name, 0, (int)s, err, buflen,
+            entry_size(s, result));
+    stats_lookup(STAT_PASSWD_LOOKUPS, s, err);
+    return s;
 }
@@ -0,0 +1,34 @@
+/*
+ * Functions of pw.c used by other files
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PW_H
+#define PW_H
+
+#include <nss.h>
+#include <pwd.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "file.h"
+
+
+enum nss_status passwd_search(const struct header *h, const char *name, uint64_t uid, struct passwd *result, char *buffer, size_t buflen, int *errnop) __attribute__((visibility("hidden")));
+enum nss_status passwd_next(struct file *f, struct passwd *result, char *buffer, size_t buflen) __attribute__((visibility("hidden")));
+
+#endif
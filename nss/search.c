@@ -22,32 +22,294 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__)
+# include <immintrin.h>
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+#endif
 
-static int bsearch_callback(const void *x, const void *y) {
-    const struct search_key *key = x;
 
-    uint64_t offset = *(const uint64_t *)y; // from index
-    const void *member = (const char *)key->data + offset + key->offset;
+// Names (including the trailing NUL) up to this size are copied into a
+// buffer padded with NULs so they can be compared in blocks of 16 or 32
+// bytes, see name_compare(); longer names use strcmp()
+#define NAME_PADDED_SIZE 256
+// Number of remaining candidates which are compared linearly at the end of
+// a binary search, see DEFINE_LOWER_BOUND()
+#define LINEAR_COUNT 4
 
-    // Lookup by name (char *)
-    if (key->name != NULL) {
-        const char *name = member;
-        return strcmp(key->name, name);
 
-    // Lookup by ID (uint64_t)
-    } else {
-        const uint64_t *id = member;
-        if (key->id < *id) {
-            return -1;
-        } else if (key->id == *id) {
-            return 0;
+// block_crosses_page returns true if reading size bytes at x touches the
+// next page. Entries are only padded to 8 bytes so the name in the entry can
+// end at the end of the mapping and the following page might not exist.
+static inline bool block_crosses_page(const char *x, size_t size) {
+    return ((uintptr_t)x & 4095) > 4096 - size;
+}
+
+// name_compare_*() compare the padded key (see pad_name()) with name like
+// strcmp(). They read past the end of name (but not into the next page)
+// which AddressSanitizer would report, like the optimized functions in libc.
+#if defined(__x86_64__)
+// SSE2 is always available on x86_64
+__attribute__((no_sanitize_address))
+static int name_compare_sse2(const char *key, const char *name) {
+    for (size_t i = 0;; i += 16) {
+        if (block_crosses_page(name + i, 16)) {
+            return strcmp(key + i, name + i);
+        }
+        __m128i k = _mm_load_si128((const __m128i *)(key + i));
+        __m128i n = _mm_loadu_si128((const __m128i *)(name + i));
+        // Bit set for each byte which differs or is the end of the key
+        unsigned int neq = ~(unsigned int)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(k, n));
+        unsigned int nul = (unsigned int)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(k, _mm_setzero_si128()));
+        unsigned int m = (neq | nul) & 0xffff;
+        if (m != 0) {
+            size_t j = i + (size_t)__builtin_ctz(m);
+            return (unsigned char)key[j] - (unsigned char)name[j];
+        }
+    }
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static int name_compare_avx2(const char *key, const char *name) {
+    for (size_t i = 0;; i += 32) {
+        if (block_crosses_page(name + i, 32)) {
+            return strcmp(key + i, name + i);
+        }
+        __m256i k = _mm256_load_si256((const __m256i *)(key + i));
+        __m256i n = _mm256_loadu_si256((const __m256i *)(name + i));
+        unsigned int neq = ~(unsigned int)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(k, n));
+        unsigned int nul = (unsigned int)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(k, _mm256_setzero_si256()));
+        unsigned int m = neq | nul;
+        if (m != 0) {
+            size_t j = i + (size_t)__builtin_ctz(m);
+            return (unsigned char)key[j] - (unsigned char)name[j];
+        }
+    }
+}
+
+// The resolver runs during relocation before the sanitizers are initialized
+typedef int name_compare_fn(const char *, const char *);
+__attribute__((no_sanitize_address, no_sanitize_undefined))
+static name_compare_fn *resolve_name_compare(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return name_compare_avx2;
+    }
+    return name_compare_sse2;
+}
+static int name_compare(const char *key, const char *name)
+    __attribute__((ifunc("resolve_name_compare")));
+
+#elif defined(__aarch64__)
+// NEON is always available on aarch64
+__attribute__((no_sanitize_address))
+static int name_compare(const char *key, const char *name) {
+    for (size_t i = 0;; i += 16) {
+        if (block_crosses_page(name + i, 16)) {
+            return strcmp(key + i, name + i);
+        }
+        uint8x16_t k = vld1q_u8((const uint8_t *)key + i);
+        uint8x16_t n = vld1q_u8((const uint8_t *)name + i);
+        // 0xff for each byte which differs or is the end of the key
+        uint8x16_t x = vorrq_u8(vmvnq_u8(vceqq_u8(k, n)), vceqzq_u8(k));
+        // Narrow to 4 bits per byte to get a scalar mask
+        uint64_t m = vget_lane_u64(vreinterpret_u64_u8(
+                vshrn_n_u16(vreinterpretq_u16_u8(x), 4)), 0);
+        if (m != 0) {
+            size_t j = i + (size_t)(__builtin_ctzll(m) / 4);
+            return (unsigned char)key[j] - (unsigned char)name[j];
+        }
+    }
+}
+
+#else
+static int name_compare(const char *key, const char *name) {
+    return strcmp(key, name);
+}
+#endif
+
+// pad_name copies the name of key into buf (NAME_PADDED_SIZE bytes, 32 byte
+// aligned) and pads it with NULs to a multiple of 32 bytes. It returns NULL
+// if key is not a name or the name is too long.
+static const char *pad_name(const struct search_key *key, char *buf) {
+    if (key->name == NULL) {
+        return NULL;
+    }
+    size_t len = strlen(key->name) + 1;
+    if (len > NAME_PADDED_SIZE) {
+        return NULL;
+    }
+    memcpy(buf, key->name, len);
+    memset(buf + len, 0, ((len + 31) & ~(size_t)31) - len);
+    return buf;
+}
+
+
+static inline const char *member(const struct search_key *key, uint64_t offset) {
+    return (const char *)key->data + offset + key->offset;
+}
+
+// compare_name compares key with the name of the entry at offset; padded is
+// the result of pad_name().
+static inline int compare_name(const struct search_key *key, const char *padded, uint64_t offset) {
+    const char *name = member(key, offset);
+    if (padded != NULL) {
+        return name_compare(padded, name);
+    }
+    return strcmp(key->name, name);
+}
+
+// less_id and less_name return 1 if the entry at offset is less than key, 0
+// otherwise.
+static inline uint64_t less_id(const struct search_key *key, const char *padded, uint64_t offset) {
+    (void)padded;
+    return *(const uint64_t *)member(key, offset) < key->id;
+}
+static inline uint64_t less_name(const struct search_key *key, const char *padded, uint64_t offset) {
+    return compare_name(key, padded, offset) > 0;
+}
+
+// SLOT64 and SLOT32 return the offset stored in slot i of an index with
+// uint64_t or uint32_t (FEATURE_INDEX32) slots, see index_offset().
+#define SLOT64(index, i) (((const uint64_t *)(index))[i])
+#define SLOT32(index, i) ((uint64_t)((const uint32_t *)(index))[i] * 8)
+#define SLOTP64(index, i) (&((const uint64_t *)(index))[i])
+#define SLOTP32(index, i) (&((const uint32_t *)(index))[i])
+
+// DEFINE_LOWER_BOUND defines a function fn which returns the first slot of
+// index whose entry is not less than key (or count if there is none). The
+// comparison (less) and the index format (slot, slotp returns the address of
+// a slot) are specialized so each function is a tight loop without indirect
+// calls.
+//
+// The search is pipelined so no prefetch waits for a cache miss: the index
+// slots of the possible probes two iterations ahead are prefetched by
+// address, the slots of both possible probes of the next iteration (which
+// were prefetched by the previous iteration) are loaded and their entries
+// prefetched; the loaded slot becomes the next probe. So the cache misses
+// overlap with the current comparison. With branchless the range is halved
+// by a conditional add instead of a branch the CPU can't predict. This is
+// only faster for ids: a name comparison takes so long that speculating past
+// it (and mispredicting half of the time) still wins, see "make bench". The
+// last LINEAR_COUNT candidates are adjacent slots: they are loaded together,
+// their entries prefetched and all compared, the position is the number of
+// smaller ones.
+#define DEFINE_LOWER_BOUND(fn, less, slot, slotp, branchless) \
+static uint64_t fn(const struct search_key *key, const char *padded, const void *index, uint64_t count) { \
+    uint64_t base = 0; \
+    uint64_t len = count; \
+    uint64_t probe = len > LINEAR_COUNT ? slot(index, len / 2) : 0; \
+    while (len > LINEAR_COUNT) { \
+        uint64_t half = len / 2; \
+        uint64_t next = (len - half) / 2; \
+        uint64_t next2 = (len - half - next) / 2; \
+        __builtin_prefetch(slotp(index, base + next2)); \
+        __builtin_prefetch(slotp(index, base + next + next2)); \
+        __builtin_prefetch(slotp(index, base + half + next2)); \
+        __builtin_prefetch(slotp(index, base + half + next + next2)); \
+        /* prefetched by the previous iteration */ \
+        uint64_t lo = slot(index, base + next); \
+        uint64_t hi = slot(index, base + half + next); \
+        __builtin_prefetch(member(key, lo)); \
+        __builtin_prefetch(member(key, hi)); \
+        if (branchless) { \
+            uint64_t l = less(key, padded, probe); \
+            base += l * half; \
+            probe = l ? hi : lo; \
+        } else if (less(key, padded, probe)) { \
+            base += half; \
+            probe = hi; \
+            /* prevent conversion to a conditional move */ \
+            __asm__ volatile(""); \
+        } else { \
+            probe = lo; \
+        } \
+        len -= half; \
+    } \
+    uint64_t slots[LINEAR_COUNT]; \
+    for (uint64_t i = 0; i < len; i++) { \
+        slots[i] = slot(index, base + i); \
+    } \
+    for (uint64_t i = 0; i < len; i++) { \
+        __builtin_prefetch(member(key, slots[i])); \
+    } \
+    uint64_t smaller = 0; \
+    for (uint64_t i = 0; i < len; i++) { \
+        smaller += less(key, padded, slots[i]); \
+    } \
+    return base + smaller; \
+}
+
+DEFINE_LOWER_BOUND(lower_bound_id64, less_id, SLOT64, SLOTP64, 1)
+DEFINE_LOWER_BOUND(lower_bound_id32, less_id, SLOT32, SLOTP32, 1)
+DEFINE_LOWER_BOUND(lower_bound_name64, less_name, SLOT64, SLOTP64, 0)
+DEFINE_LOWER_BOUND(lower_bound_name32, less_name, SLOT32, SLOTP32, 0)
+
+// search_slot returns the first slot of index matching key or count if no
+// entry matches.
+static uint64_t search_slot(const struct search_key *key, const void *index, bool index32, uint64_t count) {
+    uint64_t i;
+
+    if (key->name == NULL) {
+        if (index32) {
+            i = lower_bound_id32(key, NULL, index, count);
+            if (i == count || *(const uint64_t *)member(key, SLOT32(index, i)) != key->id) {
+                return count;
+            }
         } else {
-            return +1;
+            i = lower_bound_id64(key, NULL, index, count);
+            if (i == count || *(const uint64_t *)member(key, SLOT64(index, i)) != key->id) {
+                return count;
+            }
         }
+        return i;
     }
+
+    char buf[NAME_PADDED_SIZE] __attribute__((aligned(32)));
+    const char *padded = pad_name(key, buf);
+    if (index32) {
+        i = lower_bound_name32(key, padded, index, count);
+        if (i == count || compare_name(key, padded, SLOT32(index, i)) != 0) {
+            return count;
+        }
+    } else {
+        i = lower_bound_name64(key, padded, index, count);
+        if (i == count || compare_name(key, padded, SLOT64(index, i)) != 0) {
+            return count;
+        }
+    }
+    return i;
 }
 
 // search performs a binary search on an index, described by key and index.
 uint64_t *search(const struct search_key *key, const void *index, uint64_t count) {
-    return bsearch(key, index, count, sizeof(uint64_t), bsearch_callback);
+    return search_first(key, index, count);
+}
+
+// search_first is like search but returns the first matching entry of the
+// index if multiple entries match key.
+uint64_t *search_first(const struct search_key *key, const void *index, uint64_t count) {
+    uint64_t i = search_slot(key, index, false, count);
+    if (i == count) {
+        return NULL;
+    }
+    return (uint64_t *)index + i;
+}
+
+// search_index is like search but supports all index formats (see
+// index_offset()). On success the offset of the entry is stored in offset.
+bool search_index(const struct search_key *key, const struct header *h, uint64_t off_index, uint64_t *offset) {
+    const void *index = h->data + off_index;
+    bool index32 = (h->version & FEATURE_INDEX32) != 0;
+
+    uint64_t i = search_slot(key, index, index32, h->count);
+    if (i == h->count) {
+        return false;
+    }
+    *offset = index32 ? SLOT32(index, i) : SLOT64(index, i);
+    return true;
 }
@@ -20,8 +20,11 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "file.h"
+
 
 struct search_key {
     const char *name; // if name != NULL search for a string
@@ -36,6 +39,28 @@ struct search_key {
     uint64_t offset;
 };
 
+// Key record in data referenced by the name index of files whose entries can
+// be found by multiple names (services, protocols). The name index starts
+// with the number of key records (uint64_t) followed by the offsets.
+struct name_key {
+    uint64_t off_entry; // offset of the entry in data
+    const char name[];
+} __attribute__((packed));
+
 uint64_t *search(const struct search_key *key, const void *index, uint64_t count) __attribute__((visibility("hidden")));
+uint64_t *search_first(const struct search_key *key, const void *index, uint64_t count) __attribute__((visibility("hidden")));
+bool search_index(const struct search_key *key, const struct header *h, uint64_t off_index, uint64_t *offset) __attribute__((visibility("hidden")));
+
+// index_offset returns the offset (relative to the data section) of the entry
+// in slot i of the index at off_index (relative to h->data). Index slots are
+// uint64_t or, with FEATURE_INDEX32, uint32_t in units of 8 bytes.
+static inline uint64_t index_offset(const struct header *h, uint64_t off_index, uint64_t i) {
+    if (h->version & FEATURE_INDEX32) {
+        const uint32_t *x = (const uint32_t *)(h->data + off_index);
+        return (uint64_t)x[i] * 8;
+    }
+    const uint64_t *x = (const uint64_t *)(h->data + off_index);
+    return x[i];
+}
 
 #endif
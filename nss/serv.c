@@ -0,0 +1,253 @@
+/*
+ * Handle services entries via struct servent
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "cash_nss.h"
+#include "file.h"
+#include "search.h"
+
+
+// NOTE: This file is very similar to proto.c, keep in sync!
+
+struct service_entry {
+    uint64_t port; // in host byte order
+
+    //       off_name = 0, not stored on disk
+    uint16_t off_proto;
+    uint16_t off_aliases_off;
+
+    uint16_t aliases_count; // alias count
+
+    /*
+     * Data contains all strings (name, proto) concatenated, with their
+     * trailing NUL. The off_* variables point to beginning of each string.
+     *
+     * After that the offsets of the aliases are stored as aliases_count
+     * uint16_t values, followed by the aliases concatenated as with the
+     * strings above.
+     *
+     * All offsets are relative to the beginning of data.
+     */
+    uint16_t data_size; // size of data in bytes
+    const char data[];
+} __attribute__((packed));
+
+static bool entry_to_servent(const struct service_entry *e, struct servent *s, char *tmp, size_t space) {
+    // Space required for the s_aliases array
+    const size_t aliases_size = (size_t)(e->aliases_count + 1) * sizeof(char *);
+
+    if (space < e->data_size + aliases_size) {
+        return false;
+    }
+
+    char **aliases = (char **)tmp;
+
+    const uint16_t *offs_aliases = (const uint16_t *)(e->data + e->off_aliases_off);
+    for (uint16_t i = 0; i < e->aliases_count; i++) {
+        aliases[i] = tmp + aliases_size + offs_aliases[i];
+    }
+    aliases[e->aliases_count] = NULL;
+
+    // This unnecessarily copies offs_aliases[] as well but keeps the code
+    // simpler and the meaning of variables consistent with gr.c
+    memcpy(tmp + aliases_size, e->data, e->data_size);
+
+    s->s_port = htons((uint16_t)e->port);
+    s->s_name = tmp + aliases_size + 0;
+    s->s_proto = tmp + aliases_size + e->off_proto;
+    s->s_aliases = aliases;
+
+    return true;
+}
+
+static bool entry_matches_proto(const struct service_entry *e, const char *proto) {
+    return proto == NULL || !strcmp(e->data + e->off_proto, proto);
+}
+
+
+static struct file static_file = {
+    .fd = -1,
+};
+static pthread_mutex_t static_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void internal_unmap_static_file(void) {
+    pthread_mutex_lock(&static_file_lock);
+    unmap_file(&static_file);
+    pthread_mutex_unlock(&static_file_lock);
+}
+
+enum nss_status _nss_cash_setservent(int x) {
+    (void)x;
+
+    // Unmap is necessary to detect changes when the file was replaced on
+    // disk; getservent_r will open the file if necessary when called
+    internal_unmap_static_file();
+    return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status _nss_cash_endservent(void) {
+    internal_unmap_static_file();
+    return NSS_STATUS_SUCCESS;
+}
+
+static enum nss_status internal_getservent_r(struct servent *result, char *buffer, size_t buflen) {
+    // First call to getservent_r, load file from disk
+    if (static_file.header == NULL) {
+        if (!map_file(NSSCASH_SERVICES_FILE, &static_file)) {
+            return NSS_STATUS_UNAVAIL;
+        }
+    }
+
+    const struct header *h = static_file.header;
+    // End of "file", stop
+    if (static_file.next_index >= h->count) {
+        errno = ENOENT;
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    uint64_t *off_orig = (uint64_t *)(h->data + h->off_orig_index);
+    const char *e = h->data + h->off_data + off_orig[static_file.next_index];
+    if (!entry_to_servent((struct service_entry *)e, result, buffer, buflen)) {
+        errno = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    static_file.next_index++;
+
+    return NSS_STATUS_SUCCESS;
+}
+enum nss_status _nss_cash_getservent_r(struct servent *result, char *buffer, size_t buflen, int *errnop) {
+    pthread_mutex_lock(&static_file_lock);
+    enum nss_status s = internal_getservent_r(result, buffer, buflen);
+    pthread_mutex_unlock(&static_file_lock);
+    if (s != NSS_STATUS_SUCCESS) {
+        *errnop = errno;
+    }
+    return s;
+}
+
+
+// find_by_name returns the first entry which has name as name or alias and
+// matches proto (if not NULL).
+static const struct service_entry *find_by_name(const struct header *h, const char *name, const char *proto) {
+    const char *data = h->data + h->off_data;
+    const uint64_t *index = (const uint64_t *)(h->data + h->off_name_index);
+    uint64_t count = index[0];
+    const uint64_t *start = index + 1;
+
+    const struct search_key key = {
+        .name = name,
+        .data = data,
+        .offset = offsetof(struct name_key, name),
+    };
+    const uint64_t *off = search_first(&key, start, count);
+    if (off == NULL) {
+        return NULL;
+    }
+
+    // Multiple services can use the same name (e.g. for tcp and udp)
+    for (; off < start + count; off++) {
+        const struct name_key *k = (const struct name_key *)(data + *off);
+        if (strcmp(k->name, name)) {
+            break;
+        }
+        const struct service_entry *e =
+            (const struct service_entry *)(data + k->off_entry);
+        if (entry_matches_proto(e, proto)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// find_by_port returns the first entry with the given port which matches
+// proto (if not NULL).
+static const struct service_entry *find_by_port(const struct header *h, uint64_t port, const char *proto) {
+    const char *data = h->data + h->off_data;
+    const uint64_t *start = (const uint64_t *)(h->data + h->off_id_index);
+
+    const struct search_key key = {
+        .id = port,
+        .data = data,
+        .offset = offsetof(struct service_entry, port),
+    };
+    const uint64_t *off = search_first(&key, start, h->count);
+    if (off == NULL) {
+        return NULL;
+    }
+
+    // Multiple services can use the same port (e.g. for tcp and udp)
+    for (; off < start + h->count; off++) {
+        const struct service_entry *e =
+            (const struct service_entry *)(data + *off);
+        if (e->port != port) {
+            break;
+        }
+        if (entry_matches_proto(e, proto)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static enum nss_status internal_getserv(const char *name, uint64_t port, const char *proto, struct servent *result, char *buffer, size_t buflen, int *errnop) {
+    struct file f;
+    if (!map_file(NSSCASH_SERVICES_FILE, &f)) {
+        *errnop = errno;
+        return NSS_STATUS_UNAVAIL;
+    }
+    const struct header *h = f.header;
+
+    const struct service_entry *e = (name != NULL)
+                                  ? find_by_name(h, name, proto)
+                                  : find_by_port(h, port, proto);
+    if (e == NULL) {
+        unmap_file(&f);
+        errno = ENOENT;
+        *errnop = errno;
+        return NSS_STATUS_NOTFOUND;
+    }
+
+    if (!entry_to_servent(e, result, buffer, buflen)) {
+        unmap_file(&f);
+        errno = ERANGE;
+        *errnop = errno;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    unmap_file(&f);
+    return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status _nss_cash_getservbyname_r(const char *name, const char *proto, struct servent *result, char *buffer, size_t buflen, int *errnop) {
+    return internal_getserv(name, 0, proto, result, buffer, buflen, errnop);
+}
+
+enum nss_status _nss_cash_getservbyport_r(int port, const char *proto, struct servent *result, char *buffer, size_t buflen, int *errnop) {
+    // port is passed in network byte order
+    uint64_t x = ntohs((uint16_t)port);
+    return internal_getserv(NULL, x, proto, result, buffer, buflen, errnop);
+}
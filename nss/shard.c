@@ -0,0 +1,209 @@
+/*
+ * Map shards of sharded nsscash files
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "shard.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// shard_hash is the 64-bit FNV-1a hash of name, see shardHash() in shard.go.
+uint64_t shard_hash(const char *name) {
+    uint64_t h = UINT64_C(14695981039346656037);
+    for (const unsigned char *x = (const unsigned char *)name; *x; x++) {
+        h ^= *x;
+        h *= UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+static const struct shard_root *get_root(const struct file *f) {
+    const struct header *h = f->header;
+    const struct shard_root *r =
+        (const struct shard_root *)(h->data + h->off_data);
+
+    // Guard against corrupt files, the divisions below must not fail
+    if (f->size < sizeof(*h) + h->off_data + sizeof(*r)
+            || r->name_shards == 0 || r->id_shards == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    // Space for id_start[] and the hashes
+    uint64_t space = (f->size - sizeof(*h) - h->off_data - sizeof(*r))
+                   / sizeof(r->id_start[0]);
+    if (space / 2 < r->id_shards
+            || space - 2 * r->id_shards < r->name_shards) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return r;
+}
+
+// name_hashes returns the content hashes of the name shards of r.
+static const uint64_t *name_hashes(const struct shard_root *r) {
+    return r->id_start + r->id_shards;
+}
+// id_hashes returns the content hashes of the id shards of r.
+static const uint64_t *id_hashes(const struct shard_root *r) {
+    return name_hashes(r) + r->name_shards;
+}
+
+// id_shard returns the id shard containing id.
+static uint64_t id_shard(const struct shard_root *r, uint64_t id) {
+    uint64_t lo = 0;
+    uint64_t hi = r->id_shards; // id_start[hi] > id
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (r->id_start[mid] <= id) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// map_shard maps shard i of the given kind ("name" or "id") with the given
+// content hash of path.
+static bool map_shard(const char *path, uint64_t hash, const char *kind, uint64_t i, struct file *f) {
+    char buf[PATH_MAX];
+    int n = snprintf(buf, sizeof(buf), "%s.%016" PRIx64 ".%s.%" PRIu64,
+                     path, hash, kind, i);
+    if (n < 0 || (size_t)n >= sizeof(buf)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    return map_file(buf, f);
+}
+
+// Number of attempts of map_file_key() if the shard was removed after the
+// root was read
+#define MAP_SHARD_TRIES 3
+
+// map_file_key maps path or, if path is sharded, the shard of path which
+// contains the entry with the given name (if not NULL) or id.
+bool map_file_key(const char *path, const char *name, uint64_t id, struct file *f) {
+    for (int try = 1;; try++) {
+        if (!map_file_root(path, f)) {
+            return false;
+        }
+        if (!(f->header->version & FEATURE_SHARDED)) {
+            return true;
+        }
+
+        const struct shard_root *r = get_root(f);
+        if (r == NULL) {
+            unmap_file(f);
+            return false;
+        }
+        const char *kind;
+        uint64_t i, hash;
+        if (name != NULL) {
+            kind = "name";
+            i = shard_hash(name) % r->name_shards;
+            hash = name_hashes(r)[i];
+        } else {
+            kind = "id";
+            i = id_shard(r, id);
+            hash = id_hashes(r)[i];
+        }
+        unmap_file(f);
+
+        if (map_shard(path, hash, kind, i, f)) {
+            return true;
+        }
+        // An update replaced the root and removed the changed shard
+        // after we've read the root, retry with the new root
+        if (errno != ENOENT || try == MAP_SHARD_TRIES) {
+            return false;
+        }
+    }
+}
+
+// map_file_first maps path or, if path is sharded, its first id shard for
+// iteration with map_file_next().
+bool map_file_first(const char *path, struct file *f) {
+    if (!map_file_root(path, f)) {
+        return false;
+    }
+    if (!(f->header->version & FEATURE_SHARDED)) {
+        f->shard_count = 1;
+        return true;
+    }
+
+    const struct shard_root *r = get_root(f);
+    if (r == NULL) {
+        unmap_file(f);
+        return false;
+    }
+    // The iteration must use the id shards of this root even if it's
+    // replaced in the meantime
+    uint64_t count = r->id_shards;
+    uint64_t *hashes = malloc(count * sizeof(*hashes));
+    if (hashes == NULL) {
+        unmap_file(f);
+        return false;
+    }
+    memcpy(hashes, id_hashes(r), count * sizeof(*hashes));
+    unmap_file(f);
+
+    if (!map_shard(path, hashes[0], "id", 0, f)) {
+        int save_errno = errno;
+        free(hashes);
+        errno = save_errno;
+        return false;
+    }
+    f->shard_count = count;
+    f->shard_hashes = hashes;
+    return true;
+}
+
+// map_file_next replaces the shard mapped by map_file_first() (or a previous
+// call to map_file_next()) with the next id shard of the same root. If
+// no shard is left (errno is ENOENT) or the next shard cannot be mapped,
+// false is returned and f is not modified.
+bool map_file_next(const char *path, struct file *f) {
+    if (f->shard + 1 >= f->shard_count) {
+        errno = ENOENT;
+        return false;
+    }
+
+    struct file x;
+    if (!map_shard(path, f->shard_hashes[f->shard + 1], "id", f->shard + 1,
+                &x)) {
+        // An update removed this shard, this must not look like the end of
+        // the iteration
+        if (errno == ENOENT) {
+            errno = ESTALE;
+        }
+        return false;
+    }
+    x.shard = f->shard + 1;
+    x.shard_count = f->shard_count;
+    x.shard_hashes = f->shard_hashes;
+
+    f->shard_hashes = NULL; // moved to x
+    unmap_file(f);
+    *f = x;
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+ * Map shards of sharded nsscash files (header)
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "file.h"
+
+
+// shard_root is stored in the data section of the root file of a sharded
+// passwd/group file (FEATURE_SHARDED). Each entry is stored in one name
+// shard ("<path>.<hash>.name.<i>", selected by shard_hash() of the name) and
+// one id shard ("<path>.<hash>.id.<i>", selected by id range); hash is the
+// content hash of the shard formatted as 16 hex digits. Shards are normal
+// nsscash files. An update writes the changed shards (under new paths)
+// before it replaces the root file so the root always references a
+// complete set of shards; unchanged shards keep their files.
+struct shard_root {
+    uint64_t name_shards;
+    uint64_t id_shards;
+    // First id of each id shard, sorted; id_start[0] is always 0. Followed
+    // by the hashes of the name_shards name shards and of the id_shards id
+    // shards.
+    uint64_t id_start[];
+} __attribute__((packed));
+
+uint64_t shard_hash(const char *name) __attribute__((visibility("hidden")));
+
+bool map_file_key(const char *path, const char *name, uint64_t id, struct file *f) __attribute__((visibility("hidden")));
+bool map_file_first(const char *path, struct file *f) __attribute__((visibility("hidden")));
+bool map_file_next(const char *path, struct file *f) __attribute__((visibility("hidden")));
+
+#endif
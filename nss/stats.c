@@ -0,0 +1,85 @@
+/*
+ * Record lookup statistics of the NSS module in a shared file
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <errno.h>
+#include <time.h>
+
+#include "counter.h"
+
+
+#ifdef NSSCASH_STATS_FILE
+
+// The statistics file is shared by all processes with the same effective uid
+// (it's mapped with MAP_SHARED, see counter.c) and updated with atomic
+// additions; per-process numbers are available via the USDT probes (see
+// probe.h).
+static struct counter stats = COUNTER_INITIALIZER;
+
+// stats_now returns a monotonic timestamp in nanoseconds. clock_gettime(2)
+// is handled by the vDSO and doesn't require a syscall.
+uint64_t stats_now(void) {
+    struct timespec t;
+    if (clock_gettime(CLOCK_MONOTONIC, &t)) {
+        return 0;
+    }
+    return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+// stats_lookup counts a lookup with result s; lookups is STAT_PASSWD_LOOKUPS
+// or STAT_GROUP_LOOKUPS.
+void stats_lookup(enum stat_slot lookups, enum nss_status s, int errnop) {
+    enum stat_slot result;
+    switch (s) {
+        case NSS_STATUS_SUCCESS:
+            result = lookups + 1;
+            break;
+        case NSS_STATUS_NOTFOUND:
+            result = lookups + 2;
+            break;
+        case NSS_STATUS_TRYAGAIN:
+            if (errnop == ERANGE) {
+                result = lookups + 3;
+                break;
+            }
+            // fallthrough
+        default:
+            result = lookups + 4;
+            break;
+    }
+    counter_add(&stats, NSSCASH_STATS_FILE, lookups, 1);
+    counter_add(&stats, NSSCASH_STATS_FILE, result, 1);
+}
+
+// stats_map records the time since start spent mapping a file and counts it
+// if a new mapping was created.
+void stats_map(bool mapped, uint64_t start) {
+    int saved_errno = errno;
+    uint64_t now = stats_now();
+    if (mapped) {
+        counter_add(&stats, NSSCASH_STATS_FILE, STAT_MAPS, 1);
+    }
+    if (now > start) {
+        counter_add(&stats, NSSCASH_STATS_FILE, STAT_MAP_NSEC, now - start);
+    }
+    errno = saved_errno;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Lookup statistics of the NSS module
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <nss.h>
+
+#include "file.h"
+
+
+// Slots in the statistics file (a counter file, see counter.h), keep in sync
+// with statNames in stats.go. The *_LOOKUPS to *_UNAVAIL slots must stay in
+// this order, see stats_lookup().
+enum stat_slot {
+    STAT_PASSWD_LOOKUPS,
+    STAT_PASSWD_FOUND,
+    STAT_PASSWD_NOTFOUND,
+    STAT_PASSWD_ERANGE, // buffer too small, caller retries with larger one
+    STAT_PASSWD_UNAVAIL,
+    STAT_GROUP_LOOKUPS,
+    STAT_GROUP_FOUND,
+    STAT_GROUP_NOTFOUND,
+    STAT_GROUP_ERANGE,
+    STAT_GROUP_UNAVAIL,
+    STAT_MAPS, // files mapped, the combined file only when it changed
+    STAT_MAP_NSEC, // time spent mapping files (including cached mappings)
+    STAT_COUNT,
+};
+
+#ifdef NSSCASH_STATS_FILE
+uint64_t stats_now(void) __attribute__((visibility("hidden")));
+void stats_lookup(enum stat_slot lookups, enum nss_status s, int errnop) __attribute__((visibility("hidden")));
+void stats_map(bool mapped, uint64_t start) __attribute__((visibility("hidden")));
+#else
+// Without a statistics file all calls are optimized away
+static inline uint64_t stats_now(void) {
+    return 0;
+}
+static inline void stats_lookup(enum stat_slot lookups, enum nss_status s, int errnop) {
+    (void)lookups;
+    (void)s;
+    (void)errnop;
+}
+static inline void stats_map(bool mapped, uint64_t start) {
+    (void)mapped;
+    (void)start;
+}
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Lookups in schema-driven nsscash table files
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "table.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "search.h"
+
+
+static const struct table_schema *header_schema(const struct header *h) {
+    return (const struct table_schema *)(h->data + h->off_name_index);
+}
+
+static const struct table_index *table_indices(const struct table_schema *s) {
+    return (const struct table_index *)(s->off_column_names + s->column_count);
+}
+
+// table_schema returns the schema of the table file f. The schema, the
+// column names and the indices are checked against the size of f, the other
+// functions rely on this. Returns NULL and sets errno to EINVAL if the file
+// is invalid.
+const struct table_schema *table_schema(const struct file *f) {
+    const struct header *h = f->header;
+    // Size of data, check_header() verified the header fits
+    const uint64_t size = f->size - sizeof(*h);
+
+    if (h->off_data > size || h->off_name_index > size
+            || size - h->off_name_index < sizeof(struct table_schema)) {
+        goto invalid;
+    }
+    const struct table_schema *s = header_schema(h);
+    // Space for off_column_names[] and the indices in uint64_t
+    const uint64_t space = (size - h->off_name_index
+            - sizeof(struct table_schema)) / sizeof(uint64_t);
+    const uint64_t index_size = sizeof(struct table_index) / sizeof(uint64_t);
+    if (space < s->column_count
+            || (space - s->column_count) / index_size < s->index_count) {
+        goto invalid;
+    }
+
+    const char *data = h->data + h->off_data;
+    const uint64_t data_size = size - h->off_data;
+    for (uint64_t i = 0; i < s->column_count; i++) {
+        uint64_t off = s->off_column_names[i];
+        if (off >= data_size
+                || memchr(data + off, '\0', data_size - off) == NULL) {
+            goto invalid;
+        }
+    }
+
+    const struct table_index *indices = table_indices(s);
+    for (uint64_t i = 0; i < s->index_count; i++) {
+        const struct table_index *x = indices + i;
+        if (x->column >= s->column_count || x->off_index > size
+                || size - x->off_index < sizeof(uint64_t)) {
+            goto invalid;
+        }
+        // Number of keys, followed by their offsets
+        uint64_t count = *(const uint64_t *)(h->data + x->off_index);
+        if ((size - x->off_index) / sizeof(uint64_t) - 1 < count) {
+            goto invalid;
+        }
+    }
+    return s;
+
+invalid:
+    errno = EINVAL;
+    return NULL;
+}
+
+// table_column stores the number of the column name in column. Returns false
+// if there's no such column.
+bool table_column(const struct header *h, const char *name, uint64_t *column) {
+    const struct table_schema *s = header_schema(h);
+    const char *data = h->data + h->off_data;
+
+    for (uint64_t i = 0; i < s->column_count; i++) {
+        if (!strcmp(data + s->off_column_names[i], name)) {
+            *column = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// table_column_index returns the index of column or NULL if the column is
+// not indexed.
+const struct table_index *table_column_index(const struct header *h, uint64_t column) {
+    const struct table_schema *s = header_schema(h);
+    const struct table_index *indices = table_indices(s);
+
+    for (uint64_t i = 0; i < s->index_count; i++) {
+        if (indices[i].column == column) {
+            return indices + i;
+        }
+    }
+    return NULL;
+}
+
+// table_lookup searches index x for value. It returns the first matching key
+// of the index (see table_key_row()) and stores the number of matching keys
+// in count. Returns NULL if nothing was found.
+const uint64_t *table_lookup(const struct header *h, const struct table_index *x, const char *value, uint64_t *count) {
+    const char *data = h->data + h->off_data;
+
+    *count = 0;
+
+    const uint64_t *index = (const uint64_t *)(h->data + x->off_index);
+    const uint64_t *start = index + 1;
+    const uint64_t *end = start + index[0];
+
+    const struct search_key key = {
+        .name = value,
+        .data = data,
+        .offset = offsetof(struct name_key, name),
+    };
+    const uint64_t *first = search_first(&key, start, index[0]);
+    if (first == NULL) {
+        return NULL;
+    }
+    const uint64_t *off = first;
+    for (; off < end; off++) {
+        const struct name_key *k = (const struct name_key *)(data + *off);
+        if (strcmp(k->name, value)) {
+            break;
+        }
+    }
+    *count = (uint64_t)(off - first);
+    return first;
+}
+
+// table_key_row returns the row of a key returned by table_lookup().
+const struct table_row *table_key_row(const struct header *h, const uint64_t *key) {
+    const char *data = h->data + h->off_data;
+    const struct name_key *k = (const struct name_key *)(data + *key);
+    return (const struct table_row *)(data + k->off_entry);
+}
+
+const char *table_value(const struct table_row *row, uint64_t column) {
+    return (const char *)row + row->off[column];
+}
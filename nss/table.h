@@ -0,0 +1,68 @@
+/*
+ * Lookups in schema-driven nsscash table files (header)
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "file.h"
+
+
+// Flags of struct table_index
+#define TABLE_INDEX_UNIQUE 1
+
+// table_schema describes the columns and indices of a table; it's stored
+// at off_name_index of the header (table files have no id index).
+struct table_schema {
+    uint64_t column_count;
+    uint64_t index_count;
+
+    // column_count offsets (relative to the data section) of the
+    // NUL-terminated column names, followed by index_count struct
+    // table_index
+    uint64_t off_column_names[];
+} __attribute__((packed));
+
+struct table_index {
+    uint64_t column;
+    uint64_t flags;
+    // Offset relative to the header's data like the offsets in the header;
+    // the index references key records (struct name_key) and starts with
+    // their number
+    uint64_t off_index;
+} __attribute__((packed));
+
+struct table_row {
+    uint32_t data_size; // size of the strings in bytes
+
+    // column_count offsets (relative to the beginning of the row) of the
+    // NUL-terminated values, followed by the values
+    uint32_t off[];
+} __attribute__((packed));
+
+const struct table_schema *table_schema(const struct file *f) __attribute__((visibility("hidden")));
+bool table_column(const struct header *h, const char *name, uint64_t *column) __attribute__((visibility("hidden")));
+const struct table_index *table_column_index(const struct header *h, uint64_t column) __attribute__((visibility("hidden")));
+const uint64_t *table_lookup(const struct header *h, const struct table_index *x, const char *value, uint64_t *count) __attribute__((visibility("hidden")));
+const struct table_row *table_key_row(const struct header *h, const uint64_t *key) __attribute__((visibility("hidden")));
+const char *table_value(const struct table_row *row, uint64_t column) __attribute__((visibility("hidden")));
+
+#endif
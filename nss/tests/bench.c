@@ -0,0 +1,181 @@
+/*
+ * Benchmark of the search functions
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../entry.h"
+#include "../file.h"
+// Include the implementation to compare it with the reference below
+#include "../search.c"
+
+
+// Number of lookups per file and kind
+#define LOOKUPS 1000000
+// Number of runs of each implementation
+#define RUNS 3
+
+
+// Reference implementation with bsearch(), the previous implementation of
+// search_index()
+
+static int ref_compare(const struct search_key *key, uint64_t offset) {
+    const char *x = member(key, offset);
+    if (key->name != NULL) {
+        return strcmp(key->name, x);
+    }
+    uint64_t id = *(const uint64_t *)x;
+    return (key->id > id) - (key->id < id);
+}
+static int ref_callback(const void *x, const void *y) {
+    return ref_compare(x, *(const uint64_t *)y);
+}
+static int ref_callback32(const void *x, const void *y) {
+    return ref_compare(x, (uint64_t)*(const uint32_t *)y * 8);
+}
+
+static bool ref_search_index(const struct search_key *key, const struct header *h, uint64_t off_index, uint64_t *offset) {
+    const void *index = h->data + off_index;
+    if (h->version & FEATURE_INDEX32) {
+        const uint32_t *x = bsearch(key, index, h->count, sizeof(uint32_t),
+                                    ref_callback32);
+        if (x == NULL) {
+            return false;
+        }
+        *offset = (uint64_t)*x * 8;
+        return true;
+    }
+    const uint64_t *x = bsearch(key, index, h->count, sizeof(uint64_t),
+                                ref_callback);
+    if (x == NULL) {
+        return false;
+    }
+    *offset = *x;
+    return true;
+}
+
+
+static double now(void) {
+    struct timespec t;
+    assert(clock_gettime(CLOCK_MONOTONIC, &t) == 0);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+typedef bool search_fn(const struct search_key *, const struct header *, uint64_t, uint64_t *);
+
+struct lookup {
+    char name[16];
+    uint64_t id;
+};
+
+// make_lookups returns LOOKUPS deterministic pseudo-random lookups of the
+// users in the generated file (see Makefile), including missing ones.
+static struct lookup *make_lookups(uint64_t count) {
+    struct lookup *res = calloc(LOOKUPS, sizeof(*res));
+    assert(res != NULL);
+
+    uint64_t x = 42;
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        x = x * 6364136223846793005 + 1442695040888963407;
+        uint64_t user = (x >> 33) % (count + count / 10);
+
+        snprintf(res[i].name, sizeof(res[i].name), "user%" PRIu64, user);
+        res[i].id = 1000 + user;
+    }
+    return res;
+}
+
+// run performs all lookups by name or id with fn and returns the found
+// offsets in offsets.
+static double run(search_fn *fn, const struct header *h, const struct lookup *lookups, bool by_name, uint64_t *offsets) {
+    uint64_t key_offset;
+    if (by_name) {
+        key_offset = (h->version & FEATURE_STRING_TABLE)
+                   ? sizeof(struct passwd_entry_compact)
+                   : sizeof(struct passwd_entry);
+    } else {
+        key_offset = offsetof(struct passwd_entry, uid);
+    }
+
+    double start = now();
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        struct search_key key = {
+            .name = by_name ? lookups[i].name : NULL,
+            .id = lookups[i].id,
+            .data = h->data + h->off_data,
+            .offset = key_offset,
+        };
+        uint64_t off;
+        if (!fn(&key, h, by_name ? h->off_name_index : h->off_id_index,
+                &off)) {
+            off = UINT64_MAX;
+        }
+        offsets[i] = off;
+    }
+    return (now() - start) / LOOKUPS * 1e9;
+}
+
+int main(int argc, char **argv) {
+    uint64_t *offsets = calloc(LOOKUPS, sizeof(*offsets));
+    uint64_t *ref_offsets = calloc(LOOKUPS, sizeof(*ref_offsets));
+    assert(offsets != NULL && ref_offsets != NULL);
+
+    for (int i = 1; i < argc; i++) {
+        struct file f;
+        if (!map_file(argv[i], &f)) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+        struct lookup *lookups = make_lookups(f.header->count);
+
+        for (int by_name = 0; by_name < 2; by_name++) {
+            // Best of a few alternating runs to reduce noise
+            double ref = 0, new = 0;
+            for (int j = 0; j < RUNS; j++) {
+                double x = run(ref_search_index, f.header, lookups,
+                               by_name, ref_offsets);
+                double y = run(search_index, f.header, lookups, by_name,
+                               offsets);
+                if (j == 0 || x < ref) {
+                    ref = x;
+                }
+                if (j == 0 || y < new) {
+                    new = y;
+                }
+            }
+            // Both implementations must find the same entries
+            assert(!memcmp(offsets, ref_offsets,
+                           LOOKUPS * sizeof(*offsets)));
+
+            printf("%s: by %s: bsearch %.1f ns, search_index %.1f ns\n",
+                   argv[i], by_name ? "name" : "id  ", ref, new);
+        }
+
+        free(lookups);
+        unmap_file(&f);
+    }
+
+    free(offsets);
+    free(ref_offsets);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/*
+ * Tests for the NSS cash module with a combined passwd and group file
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../cash_nss.h"
+
+
+static void test_lookups(void) {
+    struct passwd p;
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 0);
+    assert(!strcmp(p.pw_shell, "/bin/bash"));
+    s = _nss_cash_getpwuid_r(65534, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "nobody"));
+    s = _nss_cash_getpwnam_r("nope", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_getgrnam_r("daemon", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(g.gr_gid == 1);
+    assert(!strcmp(g.gr_mem[0], "andariel"));
+    assert(!strcmp(g.gr_mem[4], "baal"));
+    assert(g.gr_mem[5] == NULL);
+    s = _nss_cash_getgrgid_r(33, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "www-data"));
+    assert(!strcmp(g.gr_mem[0], "nobody"));
+    s = _nss_cash_getgrgid_r(14, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    int count = 0;
+    s = _nss_cash_setpwent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    while (_nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop)
+            == NSS_STATUS_SUCCESS) {
+        count++;
+    }
+    assert(errnop == ENOENT);
+    assert(count == 27);
+    s = _nss_cash_endpwent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+    count = 0;
+    s = _nss_cash_setgrent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    while (_nss_cash_getgrent_r(&g, tmp, sizeof(tmp), &errnop)
+            == NSS_STATUS_SUCCESS) {
+        count++;
+    }
+    assert(errnop == ENOENT);
+    assert(count == 55);
+    s = _nss_cash_endgrent();
+    assert(s == NSS_STATUS_SUCCESS);
+}
+
+static void test_replace(void) {
+    struct passwd p;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+    int r;
+
+    FILE *fh = fopen("tests/combined-passwd", "w");
+    assert(fh != NULL);
+    r = fprintf(fh, "new:x:4242:4242::/:/bin/sh\n");
+    assert(r > 0);
+    r = fclose(fh);
+    assert(r == 0);
+    r = system("../nsscash convert passwd "
+               "tests/combined-passwd tests/combined-passwd.nsscash "
+               "2> /dev/null");
+    assert(r != -1);
+    assert(WIFEXITED(r) && WEXITSTATUS(r) == 0);
+    r = system("../nsscash combine "
+               "tests/combined-passwd.nsscash tests/group.nsscash "
+               "tests/combined-new.nsscash 2> /dev/null");
+    assert(r != -1);
+    assert(WIFEXITED(r) && WEXITSTATUS(r) == 0);
+
+    // Start enumeration with the old file
+    s = _nss_cash_setpwent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "root"));
+
+    r = rename(NSSCASH_COMBINED_FILE, NSSCASH_COMBINED_FILE ".tmp");
+    assert(r == 0);
+    r = rename("tests/combined-new.nsscash", NSSCASH_COMBINED_FILE);
+    assert(r == 0);
+
+    // Lookups see the replaced file
+    s = _nss_cash_getpwnam_r("new", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 4242);
+    s = _nss_cash_getpwnam_r("daemon", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+
+    // But the running enumeration still uses the old mapping
+    s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "daemon"));
+    s = _nss_cash_endpwent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+    r = rename(NSSCASH_COMBINED_FILE ".tmp", NSSCASH_COMBINED_FILE);
+    assert(r == 0);
+    s = _nss_cash_getpwnam_r("daemon", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 1);
+
+    // Missing file
+    r = rename(NSSCASH_COMBINED_FILE, NSSCASH_COMBINED_FILE ".tmp");
+    assert(r == 0);
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+
+    // Normal files are rejected
+    r = symlink("passwd.nsscash", NSSCASH_COMBINED_FILE);
+    assert(r == 0);
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == EINVAL);
+    r = unlink(NSSCASH_COMBINED_FILE);
+    assert(r == 0);
+
+    r = rename(NSSCASH_COMBINED_FILE ".tmp", NSSCASH_COMBINED_FILE);
+    assert(r == 0);
+    r = unlink("tests/combined-passwd");
+    assert(r == 0);
+    r = unlink("tests/combined-passwd.nsscash");
+    assert(r == 0);
+}
+
+int main(void) {
+    test_lookups();
+    test_replace();
+    test_lookups();
+
+    return EXIT_SUCCESS;
+}
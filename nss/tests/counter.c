@@ -0,0 +1,179 @@
+/*
+ * Tests for the NSS cash module with lookup counters
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../cash_nss.h"
+#include "../stats.h"
+
+
+// counter_path returns the path of the counter file of this process (see
+// map_counter() in ../counter.c) in a static buffer.
+static const char *counter_path(const char *path) {
+    static char buf[4096];
+    int n = snprintf(buf, sizeof(buf), "%s.%lu",
+                     path, (unsigned long)geteuid());
+    assert(n > 0 && (size_t)n < sizeof(buf));
+    return buf;
+}
+
+// read_counters reads the first n counters of the counter file at path into
+// x (all counters if n is 0) and returns their sum.
+static uint64_t read_counters(const char *path, uint64_t *x, uint64_t n) {
+    FILE *fh = fopen(counter_path(path), "rb");
+    assert(fh != NULL);
+
+    char magic[8];
+    uint64_t slots;
+    assert(fread(magic, sizeof(magic), 1, fh) == 1);
+    assert(!memcmp(magic, "NSS-CNT1", sizeof(magic)));
+    assert(fread(&slots, sizeof(slots), 1, fh) == 1);
+    if (n != 0) {
+        assert(n <= slots);
+        slots = n;
+    }
+
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < slots; i++) {
+        uint64_t v;
+        assert(fread(&v, sizeof(v), 1, fh) == 1);
+        if (x != NULL) {
+            x[i] = v;
+        }
+        sum += v;
+    }
+    fclose(fh);
+    return sum;
+}
+
+// sum_counters returns the sum of all counters in the counter file at path.
+static uint64_t sum_counters(const char *path) {
+    return read_counters(path, NULL, 0);
+}
+
+static void test_counters_writable(void) {
+    const char *path = counter_path(NSSCASH_GROUP_COUNTER_FILE);
+    uint64_t gr = sum_counters(NSSCASH_GROUP_COUNTER_FILE);
+
+    // The file is mapped only once per process, use a child to test before
+    // it's mapped
+    assert(chmod(path, 0664) == 0);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        struct group g;
+        char tmp[1024];
+        int errnop = 0;
+
+        enum nss_status s = _nss_cash_getgrgid_r(33, &g, tmp, sizeof(tmp),
+                                                 &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+        assert(!strcmp(g.gr_name, "www-data"));
+        // Files writable by other users are ignored
+        assert(sum_counters(NSSCASH_GROUP_COUNTER_FILE) == gr);
+        exit(EXIT_SUCCESS);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    assert(chmod(path, 0644) == 0);
+}
+
+static void test_counters(void) {
+    struct passwd p;
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    uint64_t pw = sum_counters(NSSCASH_PASSWD_COUNTER_FILE);
+    uint64_t gr = sum_counters(NSSCASH_GROUP_COUNTER_FILE);
+
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getpwuid_r(65534, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "nobody"));
+    // Failed lookups are not counted
+    s = _nss_cash_getpwnam_r("nope", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_getgrgid_r(33, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "www-data"));
+
+    assert(sum_counters(NSSCASH_PASSWD_COUNTER_FILE) == pw + 2);
+    assert(sum_counters(NSSCASH_GROUP_COUNTER_FILE) == gr + 1);
+}
+
+static void test_stats(void) {
+    struct passwd p;
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    uint64_t old[STAT_COUNT], new[STAT_COUNT];
+    read_counters(NSSCASH_STATS_FILE, old, STAT_COUNT);
+
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getpwuid_r(0, &p, tmp, 1, &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getpwnam_r("nope", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+
+    s = _nss_cash_getgrnam_r("root", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getgrgid_r(12345, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+
+    read_counters(NSSCASH_STATS_FILE, new, STAT_COUNT);
+    assert(new[STAT_PASSWD_LOOKUPS] == old[STAT_PASSWD_LOOKUPS] + 3);
+    assert(new[STAT_PASSWD_FOUND] == old[STAT_PASSWD_FOUND] + 1);
+    assert(new[STAT_PASSWD_NOTFOUND] == old[STAT_PASSWD_NOTFOUND] + 1);
+    assert(new[STAT_PASSWD_ERANGE] == old[STAT_PASSWD_ERANGE] + 1);
+    assert(new[STAT_PASSWD_UNAVAIL] == old[STAT_PASSWD_UNAVAIL]);
+    assert(new[STAT_GROUP_LOOKUPS] == old[STAT_GROUP_LOOKUPS] + 2);
+    assert(new[STAT_GROUP_FOUND] == old[STAT_GROUP_FOUND] + 1);
+    assert(new[STAT_GROUP_NOTFOUND] == old[STAT_GROUP_NOTFOUND] + 1);
+    assert(new[STAT_GROUP_ERANGE] == old[STAT_GROUP_ERANGE]);
+    assert(new[STAT_GROUP_UNAVAIL] == old[STAT_GROUP_UNAVAIL]);
+    // Without a combined file each lookup maps the file
+    assert(new[STAT_MAPS] == old[STAT_MAPS] + 5);
+    assert(new[STAT_MAP_NSEC] > old[STAT_MAP_NSEC]);
+}
+
+int main(void) {
+    test_counters_writable();
+    test_counters();
+    test_stats();
+
+    return EXIT_SUCCESS;
+}
@@ -152,7 +152,7 @@ static void test_getgrent(void) {
 
     // Test with cash file is not present
 
-    assert(rename("tests/group.nsscash", "tests/group.nsscash.tmp") == 0);
+    assert(rename(NSSCASH_GROUP_FILE, NSSCASH_GROUP_FILE ".tmp") == 0);
     s = _nss_cash_setgrent(0);
     assert(s == NSS_STATUS_SUCCESS);
     s = _nss_cash_getgrent_r(&g, tmp, sizeof(tmp), &errnop);
@@ -163,7 +163,7 @@ static void test_getgrent(void) {
     assert(errnop == ENOENT);
     s = _nss_cash_endgrent();
     assert(s == NSS_STATUS_SUCCESS);
-    assert(rename("tests/group.nsscash.tmp", "tests/group.nsscash") == 0);
+    assert(rename(NSSCASH_GROUP_FILE ".tmp", NSSCASH_GROUP_FILE) == 0);
 }
 
 static void test_getgrgid(void) {
@@ -238,14 +238,14 @@ static void test_getgrgid(void) {
 
     // Test with cash file is not present
 
-    assert(rename("tests/group.nsscash", "tests/group.nsscash.tmp") == 0);
+    assert(rename(NSSCASH_GROUP_FILE, NSSCASH_GROUP_FILE ".tmp") == 0);
     s = _nss_cash_getgrgid_r(0, &g, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
     s = _nss_cash_getgrgid_r(14, &g, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
-    assert(rename("tests/group.nsscash.tmp", "tests/group.nsscash") == 0);
+    assert(rename(NSSCASH_GROUP_FILE ".tmp", NSSCASH_GROUP_FILE) == 0);
 }
 
 static void test_getgrnam(void) {
@@ -312,14 +312,14 @@ static void test_getgrnam(void) {
 
     // Test with cash file is not present
 
-    assert(rename("tests/group.nsscash", "tests/group.nsscash.tmp") == 0);
+    assert(rename(NSSCASH_GROUP_FILE, NSSCASH_GROUP_FILE ".tmp") == 0);
     s = _nss_cash_getgrnam_r("root", &g, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
     s = _nss_cash_getgrnam_r("nope", &g, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
-    assert(rename("tests/group.nsscash.tmp", "tests/group.nsscash") == 0);
+    assert(rename(NSSCASH_GROUP_FILE ".tmp", NSSCASH_GROUP_FILE) == 0);
 }
 
 static void test_limits(void) {
@@ -341,30 +341,6 @@ static void test_limits(void) {
     const char *nsscash_cmd = "../nsscash convert group "
         "tests/limits tests/limits.nsscash 2> /dev/null";
 
-    // Entries which will not fit in uint16_t, nsscash must abort
-
-    fh = fopen("tests/limits", "w");
-    assert(fh != NULL);
-    r = fprintf(fh, "test:x:42:A%s\n", large_member);
-    assert(r == 65536);
-    r = fclose(fh);
-    assert(r == 0);
-
-    r = system(nsscash_cmd);
-    assert(r != -1);
-    assert(WIFEXITED(r) && WEXITSTATUS(r) == 1);
-
-    fh = fopen("tests/limits", "w");
-    assert(fh != NULL);
-    r = fprintf(fh, "many:x:4711:%s%s\n", many_members, many_members);
-    assert(r == 109217);
-    r = fclose(fh);
-    assert(r == 0);
-
-    r = system(nsscash_cmd);
-    assert(r != -1);
-    assert(WIFEXITED(r) && WEXITSTATUS(r) == 1);
-
     // Largest entries which will fit
 
     fh = fopen("tests/limits", "w");
@@ -380,9 +356,9 @@ static void test_limits(void) {
     assert(r != -1);
     assert(WIFEXITED(r) && WEXITSTATUS(r) == 0);
 
-    r = rename("tests/group.nsscash", "tests/group.nsscash.tmp");
+    r = rename(NSSCASH_GROUP_FILE, NSSCASH_GROUP_FILE ".tmp");
     assert(r == 0);
-    r = rename("tests/limits.nsscash", "tests/group.nsscash");
+    r = rename("tests/limits.nsscash", NSSCASH_GROUP_FILE);
     assert(r == 0);
 
     // Check if the entry can be retrieved
@@ -418,7 +394,72 @@ static void test_limits(void) {
     assert(!strcmp(g.gr_mem[5461-1], "XX"));
     assert(g.gr_mem[5461] == NULL);
 
-    r = rename("tests/group.nsscash.tmp", "tests/group.nsscash");
+    r = rename(NSSCASH_GROUP_FILE ".tmp", NSSCASH_GROUP_FILE);
+    assert(r == 0);
+
+    // Entries which don't fit in uint16_t use 32 bit offsets
+
+    fh = fopen("tests/limits", "w");
+    assert(fh != NULL);
+    r = fprintf(fh, "test:x:42:A%s\n", large_member);
+    assert(r == 65536);
+    r = fprintf(fh, "many:x:4711:%s,%s\n", many_members, many_members);
+    assert(r == 109218);
+    r = fclose(fh);
+    assert(r == 0);
+
+    r = system(nsscash_cmd);
+    assert(r != -1);
+    assert(WIFEXITED(r) && WEXITSTATUS(r) == 0);
+
+    r = rename(NSSCASH_GROUP_FILE, NSSCASH_GROUP_FILE ".tmp");
+    assert(r == 0);
+    r = rename("tests/limits.nsscash", NSSCASH_GROUP_FILE);
+    assert(r == 0);
+
+    size_t large_size = 2 * sizeof(char *) + 4+1 + 1+1 + 1 + 4 + 1 + 65525;
+    char *large_tmp = malloc(large_size);
+    assert(large_tmp != NULL);
+    size_t many_size = 10923 * sizeof(char *) + 4+1 + 1+1 + 1 + 10922 * 4 +
+        2 * (54602 + 1);
+    char *many_tmp = malloc(many_size);
+    assert(many_tmp != NULL);
+
+    s = _nss_cash_getgrgid_r(42, &g, large_tmp, large_size - 1, &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getgrgid_r(42, &g, large_tmp, large_size, &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "test"));
+    assert(g.gr_gid == 42);
+    assert(g.gr_mem[0][0] == 'A');
+    assert(!strcmp(g.gr_mem[0] + 1, large_member));
+    assert(g.gr_mem[1] == NULL);
+
+    s = _nss_cash_getgrnam_r("many", &g, many_tmp, many_size - 1, &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getgrnam_r("many", &g, many_tmp, many_size, &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "many"));
+    assert(g.gr_gid == 4711);
+    for (int i = 0; i < 2 * 5461; i++) {
+        if (i % 5461 == 5461-1) {
+            assert(!strcmp(g.gr_mem[i], "XX"));
+            continue;
+        }
+        char x[9+1];
+        memset(x, 'X', sizeof(x));
+        x[8] = (char)('A' + ((i % 5461) * 10 + 9) % ('Z' - 'A'));
+        x[9] = '\0';
+        assert(!strcmp(g.gr_mem[i], x));
+    }
+    assert(g.gr_mem[2 * 5461] == NULL);
+
+    free(large_tmp);
+    free(many_tmp);
+
+    r = rename(NSSCASH_GROUP_FILE ".tmp", NSSCASH_GROUP_FILE);
     assert(r == 0);
 
     r = unlink("tests/limits");
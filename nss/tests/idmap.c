@@ -0,0 +1,219 @@
+/*
+ * Tests for the NSS cash module with ids translated by user namespace maps
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../cash_nss.h"
+
+
+static void write_file(const char *path, const char *content) {
+    FILE *fh = fopen(path, "w");
+    assert(fh != NULL);
+    int r = fputs(content, fh);
+    assert(r >= 0);
+    r = fclose(fh);
+    assert(r == 0);
+}
+
+// new_namespace simulates a new user namespace with the given maps; the
+// replaced ns/user has a different inode as both exist at the same time
+static void new_namespace(const char *uid_map, const char *gid_map) {
+    write_file(NSSCASH_IDMAP_DIR "/uid_map", uid_map);
+    write_file(NSSCASH_IDMAP_DIR "/gid_map", gid_map);
+    write_file(NSSCASH_IDMAP_DIR "/ns/user.tmp", "");
+    int r = rename(NSSCASH_IDMAP_DIR "/ns/user.tmp",
+                   NSSCASH_IDMAP_DIR "/ns/user");
+    assert(r == 0);
+}
+
+static void test_lookups(void) {
+    struct passwd p;
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    // uid/gid 0 is www-data (33), 1000+/2000+ are the file's 0+
+    new_namespace("0 33 1\n1000 0 10\n", "0 33 1\n2000 0 100\n");
+
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 1000);
+    assert(p.pw_gid == 2000);
+    s = _nss_cash_getpwnam_r("www-data", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 0);
+    assert(p.pw_gid == 0);
+    s = _nss_cash_getpwnam_r("games", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 1005);
+    assert(p.pw_gid == 2060);
+    // Ids without mapping are shown as overflow id
+    s = _nss_cash_getpwnam_r("systemd-coredump", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 65534);
+    assert(p.pw_gid == 65534);
+
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "www-data"));
+    s = _nss_cash_getpwuid_r(1001, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "daemon"));
+    assert(p.pw_uid == 1001);
+    assert(p.pw_gid == 2001);
+    // Not mapped
+    s = _nss_cash_getpwuid_r(33, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getpwuid_r(1010, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_getgrnam_r("root", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(g.gr_gid == 2000);
+    s = _nss_cash_getgrnam_r("nogroup", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(g.gr_gid == 65534);
+    s = _nss_cash_getgrgid_r(0, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "www-data"));
+    assert(!strcmp(g.gr_mem[0], "nobody"));
+    s = _nss_cash_getgrgid_r(2060, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "games"));
+    s = _nss_cash_getgrgid_r(60, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getgrgid_r(2014, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    int count = 0;
+    s = _nss_cash_setpwent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    while (_nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop)
+            == NSS_STATUS_SUCCESS) {
+        if (count == 0) {
+            assert(!strcmp(p.pw_name, "root"));
+            assert(p.pw_uid == 1000);
+        }
+        count++;
+    }
+    assert(errnop == ENOENT);
+    assert(count == 27);
+    s = _nss_cash_endpwent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+    count = 0;
+    s = _nss_cash_setgrent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    while (_nss_cash_getgrent_r(&g, tmp, sizeof(tmp), &errnop)
+            == NSS_STATUS_SUCCESS) {
+        if (count == 0) {
+            assert(!strcmp(g.gr_name, "root"));
+            assert(g.gr_gid == 2000);
+        }
+        count++;
+    }
+    assert(errnop == ENOENT);
+    assert(count == 55);
+    s = _nss_cash_endgrent();
+    assert(s == NSS_STATUS_SUCCESS);
+}
+
+static void test_generations(void) {
+    struct passwd p;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    new_namespace("0 0 4294967295\n", "0 0 4294967295\n");
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "root"));
+
+    // The maps are read only once per user namespace
+    write_file(NSSCASH_IDMAP_DIR "/uid_map", "0 1 1\n");
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "root"));
+
+    new_namespace("0 1 1\n", "0 1 1\n");
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "daemon"));
+    assert(p.pw_uid == 0);
+
+    // Empty maps (not yet written) are read again
+    new_namespace("", "");
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 65534);
+    write_file(NSSCASH_IDMAP_DIR "/uid_map", "0 2 1\n");
+    write_file(NSSCASH_IDMAP_DIR "/gid_map", "0 2 1\n");
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "bin"));
+
+    // Invalid maps
+    new_namespace("0 1\n", "0 1 1\n");
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == EINVAL);
+
+    // Missing maps
+    new_namespace("0 0 1\n", "");
+    int r = unlink(NSSCASH_IDMAP_DIR "/gid_map");
+    assert(r == 0);
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+}
+
+int main(void) {
+    int r = mkdir(NSSCASH_IDMAP_DIR, 0755);
+    assert(r == 0 || errno == EEXIST);
+    r = mkdir(NSSCASH_IDMAP_DIR "/ns", 0755);
+    assert(r == 0 || errno == EEXIST);
+
+    test_lookups();
+    test_generations();
+
+    r = unlink(NSSCASH_IDMAP_DIR "/uid_map");
+    assert(r == 0);
+    r = unlink(NSSCASH_IDMAP_DIR "/ns/user");
+    assert(r == 0);
+    r = rmdir(NSSCASH_IDMAP_DIR "/ns");
+    assert(r == 0);
+    r = rmdir(NSSCASH_IDMAP_DIR);
+    assert(r == 0);
+
+    return EXIT_SUCCESS;
+}
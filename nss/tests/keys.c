@@ -0,0 +1,87 @@
+/*
+ * Tests for nsscash-authorized-keys
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+// run executes cmd and stores its output in buf. Returns the exit status.
+static int run(const char *cmd, char *buf, size_t size) {
+    FILE *fh = popen(cmd, "r");
+    assert(fh != NULL);
+    size_t n = fread(buf, 1, size - 1, fh);
+    buf[n] = '\0';
+    int r = pclose(fh);
+    assert(r != -1);
+    assert(WIFEXITED(r));
+    return WEXITSTATUS(r);
+}
+
+static void test_lookup(void) {
+    char buf[4096];
+    int r;
+
+    r = run("./nsscash-authorized-keys root tests/authorized_keys.nsscash",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf, "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIGRvb3Qgcm9vdCBrZXkgZm9yIHRlc3Rpbmc root@example.org\n"));
+
+    // Multiple keys of the same user in input order
+    r = run("./nsscash-authorized-keys alice tests/authorized_keys.nsscash",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf,
+        "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIGFsaWNlIGtleSBvbmUgZm9yIHRlc3RpbmcA alice@laptop\n"
+        "ecdsa-sha2-nistp256 AAAAE2VjZHNhLXNoYTItbmlzdHAyNTYAAAAIbmlzdHAyNTY= alice@desktop\n"));
+
+    // Key options are kept
+    r = run("./nsscash-authorized-keys bob tests/authorized_keys.nsscash",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf, "from=\"10.0.0.0/8\",no-agent-forwarding ssh-rsa AAAAB3NzaC1yc2EAAAADAQABAAAAgQC7 bob@example.org\n"));
+
+    // Unknown users have no keys
+    r = run("./nsscash-authorized-keys nope tests/authorized_keys.nsscash",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf, ""));
+    r = run("./nsscash-authorized-keys '' tests/authorized_keys.nsscash",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf, ""));
+
+    // Missing file or invalid arguments are errors
+    r = run("./nsscash-authorized-keys root tests/does-not-exist 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+    r = run("./nsscash-authorized-keys 2> /dev/null", buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+}
+
+int main(void) {
+    test_lookup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/*
+ * Tests for libnsscash
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../nsscash.h"
+
+
+// write_with_sections converts the version 1 file src to a version 2 file
+// dst with a single section of an unknown type (see AddSections() in
+// section.go).
+static void write_with_sections(const char *src, const char *dst, uint32_t flags) {
+    FILE *fh = fopen(src, "rb");
+    assert(fh != NULL);
+    assert(fseek(fh, 0, SEEK_END) == 0);
+    long size = ftell(fh);
+    assert(size >= 56);
+    assert(fseek(fh, 0, SEEK_SET) == 0);
+    char *x = malloc((size_t)size);
+    assert(x != NULL);
+    assert(fread(x, 1, (size_t)size, fh) == (size_t)size);
+    assert(fclose(fh) == 0);
+
+    const char content[8] = "section";
+    // Section table: count and one struct section
+    const uint64_t table_size = 8 + 24;
+    const uint64_t data_size = (uint64_t)size - 56;
+
+    uint64_t *h = (uint64_t *)x;
+    assert(h[1] & 1);
+    h[1] = (h[1] & ~UINT64_C(0xffffffff)) | 2; // version
+    for (size_t i = 3; i < 7; i++) {
+        h[i] += table_size; // off_*
+    }
+
+    struct {
+        uint64_t count;
+        uint32_t type;
+        uint32_t flags;
+        uint64_t offset;
+        uint64_t length;
+    } __attribute__((packed)) table = {
+        .count = 1,
+        .type = 0x4242,
+        .flags = flags,
+        .offset = table_size + data_size,
+        .length = sizeof(content),
+    };
+    assert(data_size % 8 == 0);
+
+    fh = fopen(dst, "wb");
+    assert(fh != NULL);
+    assert(fwrite(x, 1, 56, fh) == 56);
+    assert(fwrite(&table, 1, sizeof(table), fh) == sizeof(table));
+    assert(fwrite(x + 56, 1, data_size, fh) == data_size);
+    assert(fwrite(content, 1, sizeof(content), fh) == sizeof(content));
+    assert(fclose(fh) == 0);
+
+    free(x);
+}
+
+
+static void test_open(void) {
+    errno = 0;
+    assert(nsscash_open("./tests/does-not-exist") == NULL);
+    assert(errno == ENOENT);
+}
+
+static void test_passwd(const char *path) {
+    struct nsscash_passwd p;
+
+    nsscash_file *f = nsscash_open(path);
+    assert(f != NULL);
+    assert(nsscash_count(f) == 27);
+
+    // Iteration in original order
+    assert(nsscash_passwd_get(f, 0, &p));
+    assert(!strcmp(p.name, "root"));
+    assert(!strcmp(p.passwd, "x"));
+    assert(p.uid == 0);
+    assert(p.gid == 0);
+    assert(!strcmp(p.gecos, "root"));
+    assert(!strcmp(p.dir, "/root"));
+    assert(!strcmp(p.shell, "/bin/bash"));
+    assert(nsscash_passwd_get(f, 26, &p));
+    assert(!strcmp(p.name, "postfix"));
+    errno = 0;
+    assert(!nsscash_passwd_get(f, 27, &p));
+    assert(errno == ENOENT);
+
+    assert(nsscash_passwd_by_uid(f, 999, &p));
+    assert(!strcmp(p.name, "systemd-coredump"));
+    assert(!strcmp(p.gecos, "systemd Core Dumper"));
+    assert(!strcmp(p.shell, "/sbin/nologin"));
+    errno = 0;
+    assert(!nsscash_passwd_by_uid(f, 12, &p));
+    assert(errno == ENOENT);
+
+    assert(nsscash_passwd_by_name(f, "www-data", &p));
+    assert(p.uid == 33);
+    assert(!strcmp(p.dir, "/var/www"));
+    errno = 0;
+    assert(!nsscash_passwd_by_name(f, "does-not-exist", &p));
+    assert(errno == ENOENT);
+
+    // Batch lookup
+    uint64_t uids[] = { 0, 2, 3, 12, 33, 33, 106, 999, 1000, 65534, 70000 };
+    struct nsscash_passwd res[sizeof(uids) / sizeof(*uids)];
+    size_t n = nsscash_passwd_by_uids(f, uids, sizeof(uids) / sizeof(*uids), res);
+    assert(n == 8);
+    assert(!strcmp(res[0].name, "root"));
+    assert(!strcmp(res[1].name, "bin"));
+    assert(!strcmp(res[2].name, "sys"));
+    assert(res[3].name == NULL);
+    assert(!strcmp(res[4].name, "www-data"));
+    assert(!strcmp(res[5].name, "www-data"));
+    assert(!strcmp(res[6].name, "_rpc"));
+    assert(!strcmp(res[7].name, "systemd-coredump"));
+    assert(res[8].name == NULL);
+    assert(!strcmp(res[9].name, "nobody"));
+    assert(res[10].name == NULL);
+
+    // Batch lookup of all entries
+    uint64_t all[27];
+    for (uint64_t i = 0; i < 27; i++) {
+        assert(nsscash_passwd_get(f, i, &p));
+        all[i] = p.uid;
+    }
+    for (size_t i = 1; i < 27; i++) { // insertion sort
+        for (size_t j = i; j > 0 && all[j - 1] > all[j]; j--) {
+            uint64_t x = all[j];
+            all[j] = all[j - 1];
+            all[j - 1] = x;
+        }
+    }
+    struct nsscash_passwd res_all[27];
+    assert(nsscash_passwd_by_uids(f, all, 27, res_all) == 27);
+    for (size_t i = 0; i < 27; i++) {
+        assert(res_all[i].uid == all[i]);
+    }
+
+    assert(nsscash_passwd_by_uids(f, uids, 0, res) == 0);
+
+    nsscash_close(f);
+}
+
+static void test_group(const char *path) {
+    struct nsscash_group g;
+
+    nsscash_file *f = nsscash_open(path);
+    assert(f != NULL);
+    assert(nsscash_count(f) == 55);
+
+    assert(nsscash_group_get(f, 1, &g));
+    assert(!strcmp(g.name, "daemon"));
+    assert(!strcmp(g.passwd, "x"));
+    assert(g.gid == 1);
+    assert(g.mem_count == 5);
+    assert(!strcmp(nsscash_group_member(&g, 0), "andariel"));
+    assert(!strcmp(nsscash_group_member(&g, 4), "baal"));
+    assert(nsscash_group_member(&g, 5) == NULL);
+
+    assert(nsscash_group_by_gid(f, 0, &g));
+    assert(!strcmp(g.name, "root"));
+    assert(g.mem_count == 0);
+    assert(nsscash_group_member(&g, 0) == NULL);
+    errno = 0;
+    assert(!nsscash_group_by_gid(f, 14, &g));
+    assert(errno == ENOENT);
+
+    assert(nsscash_group_by_name(f, "daemon", &g));
+    assert(g.gid == 1);
+    assert(!strcmp(nsscash_group_member(&g, 3), "diablo"));
+    errno = 0;
+    assert(!nsscash_group_by_name(f, "does-not-exist", &g));
+    assert(errno == ENOENT);
+
+    uint64_t gids[] = { 1, 14, 15 };
+    struct nsscash_group res[3];
+    assert(nsscash_group_by_gids(f, gids, 3, res) == 2);
+    assert(!strcmp(res[0].name, "daemon"));
+    assert(res[1].name == NULL);
+    assert(!strcmp(res[2].name, "kmem"));
+
+    nsscash_close(f);
+}
+
+int main(void) {
+    test_open();
+    test_passwd("./tests/passwd.nsscash");
+    test_passwd("./tests/passwd-compact.nsscash");
+    test_group("./tests/group.nsscash");
+    test_group("./tests/group-compact.nsscash");
+
+    // Unknown optional sections are ignored
+    write_with_sections("./tests/passwd-compact.nsscash",
+                        "./tests/passwd-sections.nsscash", 0);
+    test_passwd("./tests/passwd-sections.nsscash");
+    write_with_sections("./tests/group.nsscash",
+                        "./tests/group-sections.nsscash", 0);
+    test_group("./tests/group-sections.nsscash");
+    // Unknown required sections are rejected
+    write_with_sections("./tests/passwd.nsscash",
+                        "./tests/passwd-sections.nsscash", 1);
+    errno = 0;
+    assert(nsscash_open("./tests/passwd-sections.nsscash") == NULL);
+    assert(errno == EINVAL);
+    assert(remove("./tests/passwd-sections.nsscash") == 0);
+    assert(remove("./tests/group-sections.nsscash") == 0);
+
+    return EXIT_SUCCESS;
+}
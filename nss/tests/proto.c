@@ -0,0 +1,184 @@
+/*
+ * Tests for the NSS cash module
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cash_nss.h"
+
+
+static void test_getprotoent(void) {
+    struct protoent p;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp_small[10];
+    int errnop = 0;
+
+    s = _nss_cash_setprotoent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+
+    // Multiple calls with too small buffer don't advance any internal indices
+    s = _nss_cash_getprotoent_r(&p, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getprotoent_r(&p, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+
+    s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "ip"));
+    assert(p.p_proto == 0);
+    assert(!strcmp(p.p_aliases[0], "IP"));
+    assert(p.p_aliases[1] == NULL);
+
+    s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "hopopt"));
+    assert(p.p_proto == 0);
+    for (int i = 0; i < 18; i++) {
+        s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+    }
+    s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "ipv6"));
+    assert(p.p_proto == 41);
+    s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "ipv6-route"));
+    s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_endprotoent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+
+    // Test with cash file is not present
+
+    assert(rename("tests/protocols.nsscash", "tests/protocols.nsscash.tmp") == 0);
+    s = _nss_cash_setprotoent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getprotoent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    s = _nss_cash_endprotoent();
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(rename("tests/protocols.nsscash.tmp", "tests/protocols.nsscash") == 0);
+}
+
+static void test_getprotobyname(void) {
+    struct protoent p;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp_small[10];
+    int errnop = 0;
+
+    s = _nss_cash_getprotobyname_r("tcp", &p, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getprotobyname_r("nope", &p, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND); // does not exist
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_getprotobyname_r("tcp", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "tcp"));
+    assert(p.p_proto == 6);
+    assert(!strcmp(p.p_aliases[0], "TCP"));
+    assert(p.p_aliases[1] == NULL);
+
+    // Lookup by alias
+    s = _nss_cash_getprotobyname_r("IPv6-Route", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "ipv6-route"));
+    assert(p.p_proto == 43);
+
+    s = _nss_cash_getprotobyname_r("ipv7", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+
+    // Test with cash file is not present
+
+    assert(rename("tests/protocols.nsscash", "tests/protocols.nsscash.tmp") == 0);
+    s = _nss_cash_getprotobyname_r("tcp", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    assert(rename("tests/protocols.nsscash.tmp", "tests/protocols.nsscash") == 0);
+}
+
+static void test_getprotobynumber(void) {
+    struct protoent p;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp_small[10];
+    int errnop = 0;
+
+    s = _nss_cash_getprotobynumber_r(6, &p, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getprotobynumber_r(7, &p, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND); // does not exist
+    assert(errnop == ENOENT);
+
+    // Duplicate numbers return the first entry in input order
+    s = _nss_cash_getprotobynumber_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "ip"));
+    assert(p.p_proto == 0);
+
+    s = _nss_cash_getprotobynumber_r(17, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "udp"));
+    assert(!strcmp(p.p_aliases[0], "UDP"));
+    assert(p.p_aliases[1] == NULL);
+
+    s = _nss_cash_getprotobynumber_r(43, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.p_name, "ipv6-route"));
+
+    s = _nss_cash_getprotobynumber_r(255, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getprotobynumber_r(-1, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+
+    // Test with cash file is not present
+
+    assert(rename("tests/protocols.nsscash", "tests/protocols.nsscash.tmp") == 0);
+    s = _nss_cash_getprotobynumber_r(6, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    assert(rename("tests/protocols.nsscash.tmp", "tests/protocols.nsscash") == 0);
+}
+
+int main(void) {
+    test_getprotoent();
+    test_getprotobyname();
+    test_getprotobynumber();
+
+    return EXIT_SUCCESS;
+}
@@ -145,7 +145,7 @@ static void test_getpwent(void) {
 
     // Test with cash file is not present
 
-    assert(rename("tests/passwd.nsscash", "tests/passwd.nsscash.tmp") == 0);
+    assert(rename(NSSCASH_PASSWD_FILE, NSSCASH_PASSWD_FILE ".tmp") == 0);
     s = _nss_cash_setpwent(0);
     assert(s == NSS_STATUS_SUCCESS);
     s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop);
@@ -156,7 +156,7 @@ static void test_getpwent(void) {
     assert(errnop == ENOENT);
     s = _nss_cash_endpwent();
     assert(s == NSS_STATUS_SUCCESS);
-    assert(rename("tests/passwd.nsscash.tmp", "tests/passwd.nsscash") == 0);
+    assert(rename(NSSCASH_PASSWD_FILE ".tmp", NSSCASH_PASSWD_FILE) == 0);
 }
 
 static void test_getpwuid(void) {
@@ -227,14 +227,14 @@ static void test_getpwuid(void) {
 
     // Test with cash file is not present
 
-    assert(rename("tests/passwd.nsscash", "tests/passwd.nsscash.tmp") == 0);
+    assert(rename(NSSCASH_PASSWD_FILE, NSSCASH_PASSWD_FILE ".tmp") == 0);
     s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
     s = _nss_cash_getpwuid_r(42, &p, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
-    assert(rename("tests/passwd.nsscash.tmp", "tests/passwd.nsscash") == 0);
+    assert(rename(NSSCASH_PASSWD_FILE ".tmp", NSSCASH_PASSWD_FILE) == 0);
 }
 
 static void test_getpwnam(void) {
@@ -305,14 +305,14 @@ static void test_getpwnam(void) {
 
     // Test with cash file is not present
 
-    assert(rename("tests/passwd.nsscash", "tests/passwd.nsscash.tmp") == 0);
+    assert(rename(NSSCASH_PASSWD_FILE, NSSCASH_PASSWD_FILE ".tmp") == 0);
     s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
     s = _nss_cash_getpwnam_r("nope", &p, tmp, sizeof(tmp), &errnop);
     assert(s == NSS_STATUS_UNAVAIL);
     assert(errnop == ENOENT);
-    assert(rename("tests/passwd.nsscash.tmp", "tests/passwd.nsscash") == 0);
+    assert(rename(NSSCASH_PASSWD_FILE ".tmp", NSSCASH_PASSWD_FILE) == 0);
 }
 
 static void test_limits(void) {
@@ -363,9 +363,9 @@ static void test_limits(void) {
     assert(r != -1);
     assert(WIFEXITED(r) && WEXITSTATUS(r) == 0);
 
-    r = rename("tests/passwd.nsscash", "tests/passwd.nsscash.tmp");
+    r = rename(NSSCASH_PASSWD_FILE, NSSCASH_PASSWD_FILE ".tmp");
     assert(r == 0);
-    r = rename("tests/limits.nsscash", "tests/passwd.nsscash");
+    r = rename("tests/limits.nsscash", NSSCASH_PASSWD_FILE);
     assert(r == 0);
 
     // Check if the entry can be retrieved
@@ -385,7 +385,7 @@ static void test_limits(void) {
     assert(!strcmp(p.pw_dir, "/home/test"));
     assert(!strcmp(p.pw_shell, "/bin/zsh"));
 
-    r = rename("tests/passwd.nsscash.tmp", "tests/passwd.nsscash");
+    r = rename(NSSCASH_PASSWD_FILE ".tmp", NSSCASH_PASSWD_FILE);
     assert(r == 0);
 
     r = unlink("tests/limits");
@@ -0,0 +1,199 @@
+/*
+ * Tests for the search functions
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Include the implementation to test the static functions
+#include "../search.c"
+
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static void check_compare(const char *key, const char *name) {
+    char buf[NAME_PADDED_SIZE] __attribute__((aligned(32)));
+    const char *padded = pad_name(&(struct search_key){ .name = key }, buf);
+    assert(padded != NULL);
+
+    int exp = sign(strcmp(key, name));
+    assert(sign(name_compare(padded, name)) == exp);
+#if defined(__x86_64__)
+    assert(sign(name_compare_sse2(padded, name)) == exp);
+    if (__builtin_cpu_supports("avx2")) {
+        assert(sign(name_compare_avx2(padded, name)) == exp);
+    }
+#endif
+}
+
+static void test_name_compare(void) {
+    // Two pages, the second is inaccessible to detect reads past the end
+    size_t size = (size_t)sysconf(_SC_PAGESIZE);
+    char *x = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(x != MAP_FAILED);
+    assert(mprotect(x + size, size, PROT_NONE) == 0);
+
+    const char *keys[] = {
+        "",
+        "a",
+        "root",
+        "systemd-network",
+        "0123456789abcdef",
+        "0123456789abcdef0123456789abcdef",
+        "0123456789abcdef0123456789abcdef0123456789",
+        "\xff\x80high",
+    };
+    const char *names[] = {
+        "",
+        "a",
+        "b",
+        "roo",
+        "root",
+        "roots",
+        "systemd-networ",
+        "systemd-network",
+        "systemd-networkd",
+        "0123456789abcdef",
+        "0123456789abcdef0123456789abcdeF",
+        "0123456789abcdef0123456789abcdef",
+        "0123456789abcdef0123456789abcdef0123456789",
+        "0123456789abcdef0123456789abcdef01234567890",
+        "\xff\x80high",
+        "\x7fhigh",
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(*keys); i++) {
+        for (size_t j = 0; j < sizeof(names) / sizeof(*names); j++) {
+            size_t len = strlen(names[j]) + 1;
+            // Names at every position before the end of the mapping
+            for (size_t k = len; k < len + 64; k++) {
+                char *name = x + size - k;
+                memcpy(name, names[j], len);
+                check_compare(keys[i], name);
+            }
+        }
+    }
+
+    assert(munmap(x, 2 * size) == 0);
+}
+
+static void test_pad_name(void) {
+    char buf[NAME_PADDED_SIZE] __attribute__((aligned(32)));
+    char name[NAME_PADDED_SIZE + 1];
+
+    memset(name, 'x', sizeof(name));
+    name[NAME_PADDED_SIZE - 1] = '\0';
+    assert(pad_name(&(struct search_key){ .name = name }, buf) == buf);
+    name[NAME_PADDED_SIZE - 1] = 'x';
+    name[NAME_PADDED_SIZE] = '\0';
+    assert(pad_name(&(struct search_key){ .name = name }, buf) == NULL);
+    assert(pad_name(&(struct search_key){ .id = 1 }, buf) == NULL);
+}
+
+static void test_search(void) {
+    // Entries are the names followed by NUL, the index contains the offsets
+    const char data[] = "a\0b\0b\0c\0d\0e\0f\0g";
+    const uint64_t index[] = { 0, 2, 4, 6, 8, 10, 12, 14 };
+    const uint64_t count = sizeof(index) / sizeof(*index);
+
+    const char *names[] = { "a", "b", "c", "d", "e", "f", "g" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        const struct search_key key = {
+            .name = names[i],
+            .data = data,
+        };
+        uint64_t *x = search_first(&key, index, count);
+        assert(x != NULL);
+        assert(!strcmp(data + *x, names[i]));
+    }
+    // The first of multiple matching entries
+    const struct search_key b = {
+        .name = "b",
+        .data = data,
+    };
+    assert(search_first(&b, index, count) == index + 1);
+
+    const char *missing[] = { "", "0", "aa", "h" };
+    for (size_t i = 0; i < sizeof(missing) / sizeof(*missing); i++) {
+        const struct search_key key = {
+            .name = missing[i],
+            .data = data,
+        };
+        assert(search_first(&key, index, count) == NULL);
+    }
+    assert(search_first(&b, index, 0) == NULL);
+}
+
+static void test_search_id(void) {
+    // Entries are the ids, the index contains the offsets
+    uint64_t data[64];
+    uint64_t index[64];
+    // File with only an index with uint32_t slots
+    struct {
+        struct header h;
+        uint32_t index[64];
+    } f = {
+        .h.version = FEATURE_INDEX32,
+    };
+    for (uint64_t i = 0; i < 64; i++) {
+        data[i] = 2 * (i / 2) + 10; // each id twice
+        index[i] = i * 8;
+        f.index[i] = (uint32_t)i;
+    }
+
+    for (uint64_t count = 0; count <= 64; count++) {
+        f.h.count = count;
+        for (uint64_t id = 0; id < 2 * 32 + 20; id++) {
+            const struct search_key key = {
+                .id = id,
+                .data = data,
+            };
+            // Expected first slot by linear search
+            uint64_t exp = count;
+            for (uint64_t i = 0; i < count; i++) {
+                if (data[i] == id) {
+                    exp = i;
+                    break;
+                }
+            }
+
+            uint64_t *x = search_first(&key, index, count);
+            assert(exp == count ? x == NULL : x == index + exp);
+
+            uint64_t off;
+            bool found = search_index(&key, &f.h,
+                    (uint64_t)((const char *)f.index - f.h.data), &off);
+            assert(found == (exp != count));
+            assert(!found || off == exp * 8);
+        }
+    }
+}
+
+int main(void) {
+    test_name_compare();
+    test_pad_name();
+    test_search();
+    test_search_id();
+
+    return EXIT_SUCCESS;
+}
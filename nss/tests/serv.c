@@ -0,0 +1,231 @@
+/*
+ * Tests for the NSS cash module
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cash_nss.h"
+
+
+static void test_getservent(void) {
+    struct servent x;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp_small[10];
+    int errnop = 0;
+
+    s = _nss_cash_setservent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+
+    // Multiple calls with too small buffer don't advance any internal indices
+    s = _nss_cash_getservent_r(&x, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getservent_r(&x, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "tcpmux"));
+    assert(x.s_port == htons(1));
+    assert(!strcmp(x.s_proto, "tcp"));
+    assert(x.s_aliases != NULL);
+    assert(x.s_aliases[0] == NULL);
+
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "echo"));
+    assert(!strcmp(x.s_proto, "tcp"));
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "echo"));
+    assert(!strcmp(x.s_proto, "udp"));
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "discard"));
+    assert(x.s_port == htons(9));
+    assert(!strcmp(x.s_aliases[0], "sink"));
+    assert(!strcmp(x.s_aliases[1], "null"));
+    assert(x.s_aliases[2] == NULL);
+    for (int i = 0; i < 27; i++) {
+        s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+    }
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "kerberos"));
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_endservent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+
+    // Test with cash file is not present
+
+    assert(rename("tests/services.nsscash", "tests/services.nsscash.tmp") == 0);
+    s = _nss_cash_setservent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getservent_r(&x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    s = _nss_cash_endservent();
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(rename("tests/services.nsscash.tmp", "tests/services.nsscash") == 0);
+}
+
+static void test_getservbyname(void) {
+    struct servent x;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp_small[10];
+    int errnop = 0;
+
+    s = _nss_cash_getservbyname_r("echo", NULL, &x, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getservbyname_r("nope", NULL, &x, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND); // does not exist
+    assert(errnop == ENOENT);
+
+    // Without protocol the first entry in input order is returned
+    s = _nss_cash_getservbyname_r("echo", NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "echo"));
+    assert(x.s_port == htons(7));
+    assert(!strcmp(x.s_proto, "tcp"));
+
+    s = _nss_cash_getservbyname_r("echo", "udp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "echo"));
+    assert(x.s_port == htons(7));
+    assert(!strcmp(x.s_proto, "udp"));
+
+    s = _nss_cash_getservbyname_r("echo", "sctp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    // Lookup by alias
+    s = _nss_cash_getservbyname_r("null", "udp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "discard"));
+    assert(x.s_port == htons(9));
+    assert(!strcmp(x.s_proto, "udp"));
+    assert(!strcmp(x.s_aliases[0], "sink"));
+    assert(!strcmp(x.s_aliases[1], "null"));
+    assert(x.s_aliases[2] == NULL);
+
+    s = _nss_cash_getservbyname_r("krb5", NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "kerberos"));
+    assert(x.s_port == htons(88));
+    assert(!strcmp(x.s_proto, "tcp"));
+
+    s = _nss_cash_getservbyname_r("www", "tcp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "http"));
+    assert(x.s_port == htons(80));
+
+    s = _nss_cash_getservbyname_r("", NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+
+    // Test with cash file is not present
+
+    assert(rename("tests/services.nsscash", "tests/services.nsscash.tmp") == 0);
+    s = _nss_cash_getservbyname_r("echo", NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    assert(rename("tests/services.nsscash.tmp", "tests/services.nsscash") == 0);
+}
+
+static void test_getservbyport(void) {
+    struct servent x;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp_small[10];
+    int errnop = 0;
+
+    s = _nss_cash_getservbyport_r(htons(7), NULL, &x, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getservbyport_r(htons(8), NULL, &x, tmp_small, sizeof(tmp_small), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND); // does not exist
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_getservbyport_r(htons(7), NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "echo"));
+    assert(!strcmp(x.s_proto, "tcp"));
+
+    s = _nss_cash_getservbyport_r(htons(7), "udp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "echo"));
+    assert(!strcmp(x.s_proto, "udp"));
+
+    // Different names for tcp and udp
+    s = _nss_cash_getservbyport_r(htons(21), "tcp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "ftp"));
+    s = _nss_cash_getservbyport_r(htons(21), "udp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "fsp"));
+    assert(!strcmp(x.s_aliases[0], "fspd"));
+    assert(x.s_aliases[1] == NULL);
+
+    s = _nss_cash_getservbyport_r(htons(67), "tcp", &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_getservbyport_r(htons(88), NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(x.s_name, "kerberos"));
+    assert(!strcmp(x.s_aliases[0], "kerberos5"));
+    assert(!strcmp(x.s_aliases[1], "krb5"));
+    assert(!strcmp(x.s_aliases[2], "kerberos-sec"));
+    assert(x.s_aliases[3] == NULL);
+
+    s = _nss_cash_getservbyport_r(htons(65535), NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+
+    // Test with cash file is not present
+
+    assert(rename("tests/services.nsscash", "tests/services.nsscash.tmp") == 0);
+    s = _nss_cash_getservbyport_r(htons(7), NULL, &x, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    assert(rename("tests/services.nsscash.tmp", "tests/services.nsscash") == 0);
+}
+
+int main(void) {
+    test_getservent();
+    test_getservbyname();
+    test_getservbyport();
+
+    return EXIT_SUCCESS;
+}
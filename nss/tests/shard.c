@@ -0,0 +1,207 @@
+/*
+ * Tests for the NSS cash module with sharded files
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cash_nss.h"
+
+
+// shard_path returns the path of shard i of kind of the sharded file at path
+// (see map_shard() in ../shard.c) in buf.
+static const char *shard_path(char *buf, size_t size, const char *path, const char *kind, int i) {
+    FILE *fh = fopen(path, "rb");
+    assert(fh != NULL);
+    uint64_t off_data, name_shards, id_shards, hash;
+    assert(fseek(fh, 6 * 8, SEEK_SET) == 0);
+    assert(fread(&off_data, sizeof(off_data), 1, fh) == 1);
+    assert(fseek(fh, 7 * 8 + (long)off_data, SEEK_SET) == 0);
+    assert(fread(&name_shards, sizeof(name_shards), 1, fh) == 1);
+    assert(fread(&id_shards, sizeof(id_shards), 1, fh) == 1);
+    // Skip id_start[] and the hashes of the name shards for id shards
+    uint64_t skip = id_shards + (uint64_t)i;
+    if (!strcmp(kind, "id")) {
+        skip += name_shards;
+    }
+    assert(fseek(fh, (long)(skip * sizeof(hash)), SEEK_CUR) == 0);
+    assert(fread(&hash, sizeof(hash), 1, fh) == 1);
+    fclose(fh);
+
+    int n = snprintf(buf, size, "%s.%016" PRIx64 ".%s.%d",
+                     path, hash, kind, i);
+    assert(n > 0 && (size_t)n < size);
+    return buf;
+}
+
+// Enumeration iterates over all id shards (sorted by id range, not in input
+// order); each entry must also be found by name and id in its shards.
+static void test_passwd(void) {
+    struct passwd p, q;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp2[1024];
+    int errnop = 0;
+
+    s = _nss_cash_setpwent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+
+    int count = 0;
+    while ((s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop))
+            == NSS_STATUS_SUCCESS) {
+        count++;
+
+        s = _nss_cash_getpwnam_r(p.pw_name, &q, tmp2, sizeof(tmp2), &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+        assert(q.pw_uid == p.pw_uid);
+        assert(!strcmp(q.pw_dir, p.pw_dir));
+
+        s = _nss_cash_getpwuid_r(p.pw_uid, &q, tmp2, sizeof(tmp2), &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+        assert(!strcmp(q.pw_name, p.pw_name));
+
+        // The first id shard starts with the lowest ids
+        if (count == 1) {
+            assert(p.pw_uid == 0);
+        }
+    }
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    assert(count == 27);
+
+    // End of enumeration is stable
+    s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    s = _nss_cash_endpwent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+    s = _nss_cash_getpwnam_r("nope", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getpwuid_r(42, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getpwuid_r(65535, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    // Missing root file
+    assert(rename(NSSCASH_PASSWD_FILE, NSSCASH_PASSWD_FILE ".tmp") == 0);
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    assert(rename(NSSCASH_PASSWD_FILE ".tmp", NSSCASH_PASSWD_FILE) == 0);
+
+    // Missing shard only affects lookups of entries in this shard
+    char id0[4096];
+    shard_path(id0, sizeof(id0), NSSCASH_PASSWD_FILE, "id", 0);
+    assert(rename(id0, NSSCASH_PASSWD_FILE ".tmp") == 0);
+    s = _nss_cash_getpwuid_r(0, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getpwuid_r(65534, &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(p.pw_name, "nobody"));
+    s = _nss_cash_getpwnam_r("root", &p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(p.pw_uid == 0);
+    assert(rename(NSSCASH_PASSWD_FILE ".tmp", id0) == 0);
+
+    // A removed shard (e.g. a changed one after an update) aborts
+    // the enumeration, it must not look like its end
+    char id1[4096];
+    shard_path(id1, sizeof(id1), NSSCASH_PASSWD_FILE, "id", 1);
+    s = _nss_cash_setpwent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(rename(id1, NSSCASH_PASSWD_FILE ".tmp") == 0);
+    while ((s = _nss_cash_getpwent_r(&p, tmp, sizeof(tmp), &errnop))
+            == NSS_STATUS_SUCCESS) {
+    }
+    assert(s == NSS_STATUS_UNAVAIL);
+    assert(errnop == ESTALE);
+    s = _nss_cash_endpwent();
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(rename(NSSCASH_PASSWD_FILE ".tmp", id1) == 0);
+}
+
+static void test_group(void) {
+    struct group g, h;
+    enum nss_status s;
+    char tmp[1024];
+    char tmp2[1024];
+    int errnop = 0;
+
+    s = _nss_cash_setgrent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+
+    int count = 0;
+    while ((s = _nss_cash_getgrent_r(&g, tmp, sizeof(tmp), &errnop))
+            == NSS_STATUS_SUCCESS) {
+        count++;
+
+        s = _nss_cash_getgrnam_r(g.gr_name, &h, tmp2, sizeof(tmp2), &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+        assert(h.gr_gid == g.gr_gid);
+
+        s = _nss_cash_getgrgid_r(g.gr_gid, &h, tmp2, sizeof(tmp2), &errnop);
+        assert(s == NSS_STATUS_SUCCESS);
+        assert(!strcmp(h.gr_name, g.gr_name));
+
+        size_t i = 0;
+        for (; g.gr_mem[i] != NULL; i++) {
+            assert(h.gr_mem[i] != NULL);
+            assert(!strcmp(h.gr_mem[i], g.gr_mem[i]));
+        }
+        assert(h.gr_mem[i] == NULL);
+    }
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    assert(count == 55);
+
+    s = _nss_cash_endgrent();
+    assert(s == NSS_STATUS_SUCCESS);
+
+    s = _nss_cash_getgrnam_r("daemon", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(g.gr_gid == 1);
+    assert(!strcmp(g.gr_mem[0], "andariel"));
+    assert(!strcmp(g.gr_mem[4], "baal"));
+    assert(g.gr_mem[5] == NULL);
+
+    s = _nss_cash_getgrnam_r("nope", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getgrgid_r(14, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+}
+
+int main(void) {
+    test_passwd();
+    test_group();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+/*
+ * Tests for nsscash-table
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+// run executes cmd and stores its output in buf. Returns the exit status.
+static int run(const char *cmd, char *buf, size_t size) {
+    FILE *fh = popen(cmd, "r");
+    assert(fh != NULL);
+    size_t n = fread(buf, 1, size - 1, fh);
+    buf[n] = '\0';
+    int r = pclose(fh);
+    assert(r != -1);
+    assert(WIFEXITED(r));
+    return WEXITSTATUS(r);
+}
+
+static void test_lookup(void) {
+    char buf[4096];
+    int r;
+
+    // Unique index
+    r = run("./nsscash-table tests/table.nsscash key home",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf, "home:-rw,hard:nfs1:/export/home\n"));
+    r = run("./nsscash-table tests/table.nsscash key data",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf, "data:-ro:nfs2:/export/data\n"));
+    r = run("./nsscash-table tests/table.nsscash key nope",
+            buf, sizeof(buf));
+    assert(r == 2);
+    assert(!strcmp(buf, ""));
+
+    // Non-unique index, rows in input order
+    r = run("./nsscash-table tests/table.nsscash options -rw,hard",
+            buf, sizeof(buf));
+    assert(r == 0);
+    assert(!strcmp(buf,
+        "home:-rw,hard:nfs1:/export/home\n"
+        "scratch:-rw,hard:nfs1:/export/scratch\n"));
+    r = run("./nsscash-table tests/table.nsscash options -rw",
+            buf, sizeof(buf));
+    assert(r == 2);
+    assert(!strcmp(buf, ""));
+
+    // Errors
+    r = run("./nsscash-table tests/table.nsscash location nfs1 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1); // not indexed
+    assert(!strcmp(buf, ""));
+    r = run("./nsscash-table tests/table.nsscash nope x 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+    r = run("./nsscash-table tests/does-not-exist key home 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+    // Not a table file
+    r = run("./nsscash-table tests/passwd.nsscash key root 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+}
+
+static void test_invalid(void) {
+    char buf[4096];
+    int r;
+
+    // Truncated in the schema (which starts after the header and the index
+    // of the three rows at 56 + 3 * 8)
+    r = run("head -c 96 tests/table.nsscash > tests/table-invalid.nsscash && "
+            "./nsscash-table tests/table-invalid.nsscash key home 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+    // Truncated before the column names at the beginning of the data
+    r = run("head -c 232 tests/table.nsscash > tests/table-invalid.nsscash && "
+            "./nsscash-table tests/table-invalid.nsscash key home 2> /dev/null",
+            buf, sizeof(buf));
+    assert(r == 1);
+    assert(!strcmp(buf, ""));
+
+    r = unlink("tests/table-invalid.nsscash");
+    assert(r == 0);
+}
+
+int main(void) {
+    test_lookup();
+    test_invalid();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/*
+ * Tests for the NSS cash module with implicit user private groups
+ *
+ * Copyright (C) 2019-2021  Simon Ruderich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cash_nss.h"
+
+
+static void test_getgrnam(void) {
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    // Explicit groups
+    s = _nss_cash_getgrnam_r("daemon", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(g.gr_gid == 1);
+    assert(!strcmp(g.gr_mem[0], "andariel"));
+    s = _nss_cash_getgrnam_r("nogroup", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(g.gr_gid == 65534);
+
+    // Implicit user private groups
+    s = _nss_cash_getgrnam_r("root", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "root"));
+    assert(!strcmp(g.gr_passwd, "x"));
+    assert(g.gr_gid == 0);
+    assert(g.gr_mem[0] == NULL);
+    s = _nss_cash_getgrnam_r("systemd-coredump", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "systemd-coredump"));
+    assert(g.gr_gid == 999);
+    assert(g.gr_mem[0] == NULL);
+
+    // Users without user private group
+    s = _nss_cash_getgrnam_r("sync", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    // gid 65534 is used by nogroup
+    s = _nss_cash_getgrnam_r("nobody", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    s = _nss_cash_getgrnam_r("nope", &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+
+    // Buffer too small
+    s = _nss_cash_getgrnam_r("root", &g, tmp, 8, &errnop);
+    assert(s == NSS_STATUS_TRYAGAIN);
+    assert(errnop == ERANGE);
+    s = _nss_cash_getgrnam_r("root", &g, tmp, 40, &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "root"));
+}
+
+static void test_getgrgid(void) {
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    s = _nss_cash_getgrgid_r(4, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "adm"));
+
+    s = _nss_cash_getgrgid_r(0, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "root"));
+    assert(g.gr_mem[0] == NULL);
+    s = _nss_cash_getgrgid_r(41, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "gnats"));
+    assert(g.gr_gid == 41);
+
+    // uid 100 (_apt) has primary gid 65534
+    s = _nss_cash_getgrgid_r(100, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "users"));
+    s = _nss_cash_getgrgid_r(106, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_SUCCESS);
+    assert(!strcmp(g.gr_name, "input"));
+    s = _nss_cash_getgrgid_r(14, &g, tmp, sizeof(tmp), &errnop);
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+}
+
+static void test_getgrent(void) {
+    struct group g;
+    enum nss_status s;
+    char tmp[1024];
+    int errnop = 0;
+
+    int count = 0;
+    int upgs = 0;
+    s = _nss_cash_setgrent(0);
+    assert(s == NSS_STATUS_SUCCESS);
+    for (;;) {
+        // Retry with a larger buffer as done by glibc
+        s = _nss_cash_getgrent_r(&g, tmp, 14, &errnop);
+        if (s == NSS_STATUS_TRYAGAIN) {
+            assert(errnop == ERANGE);
+            s = _nss_cash_getgrent_r(&g, tmp, sizeof(tmp), &errnop);
+        }
+        if (s != NSS_STATUS_SUCCESS) {
+            break;
+        }
+        if (count == 0) {
+            assert(!strcmp(g.gr_name, "daemon"));
+        }
+        if (!strcmp(g.gr_name, "root")) {
+            assert(g.gr_gid == 0);
+            upgs++;
+        } else if (!strcmp(g.gr_name, "systemd-coredump")) {
+            assert(g.gr_gid == 999);
+            upgs++;
+        }
+        count++;
+    }
+    assert(s == NSS_STATUS_NOTFOUND);
+    assert(errnop == ENOENT);
+    // All groups of tests/group
+    assert(count == 55);
+    assert(upgs == 2);
+    s = _nss_cash_endgrent();
+    assert(s == NSS_STATUS_SUCCESS);
+}
+
+int main(void) {
+    test_getgrnam();
+    test_getgrgid();
+    test_getgrent();
+
+    return EXIT_SUCCESS;
+}
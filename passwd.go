@@ -152,19 +152,108 @@ func SerializePasswd(p Passwd) ([]byte, error) {
 	return res.Bytes(), nil
 }
 
-func SerializePasswds(w io.Writer, pws []Passwd) error {
+// SerializePasswdCompact serializes p like SerializePasswd() but stores all
+// strings except the name in strs (FeatureStringTable). Most of these
+// strings (password placeholder, shell, home directory base) are shared by
+// many users.
+func SerializePasswdCompact(p Passwd, strs *stringTable) ([]byte, error) {
+	var refs [4]uint32
+	for i, x := range []string{p.Passwd, p.Gecos, p.Dir, p.Shell} {
+		off, err := strs.add(x)
+		if err != nil {
+			return nil, err
+		}
+		refs[i] = off
+	}
+	// Ensure the offsets can fit the length of this entry
+	if len(p.Name)+1 > math.MaxUint16 {
+		return nil, fmt.Errorf("passwd too large to serialize: %v, %v",
+			len(p.Name)+1, p)
+	}
+
+	var res bytes.Buffer // serialized result
+	le := binary.LittleEndian
+
+	id := make([]byte, 8)
+	// uid
+	le.PutUint64(id, p.Uid)
+	res.Write(id)
+	// gid
+	le.PutUint64(id, p.Gid)
+	res.Write(id)
+
+	off := make([]byte, 4)
+	// off_passwd, off_gecos, off_dir, off_shell
+	for _, x := range refs {
+		le.PutUint32(off, x)
+		res.Write(off)
+	}
+	// data_size
+	le.PutUint16(off, uint16(len(p.Name)+1))
+	res.Write(off[:2])
+
+	res.Write([]byte(p.Name))
+	res.WriteByte(0)
+	// We must pad each entry so that all uint64 at the beginning of the
+	// struct are 8 byte aligned
+	alignBufferTo(&res, 8)
+
+	return res.Bytes(), nil
+}
+
+func SerializePasswds(w io.Writer, pws []Passwd, opts SerializeOptions) error {
+	if len(opts.Hot) == 0 {
+		return serializePasswds(w, pws, opts)
+	}
+
+	var x bytes.Buffer
+	err := serializePasswds(&x, pws, opts)
+	if err != nil {
+		return err
+	}
+	return writeWithHot(w, x.Bytes(), hotPasswds(pws, opts.Hot))
+}
+
+func serializePasswds(w io.Writer, pws []Passwd, opts SerializeOptions) error {
+	version := uint64(PasswdVersion)
+	var strs *stringTable
+	index32 := opts.Compact
+	if opts.Compact {
+		version |= FeatureStringTable | FeatureIndex32
+		strs = newStringTable()
+	}
+
 	// Serialize passwords and store offsets
 	var data bytes.Buffer
 	offsets := make(map[Passwd]uint64)
-	for _, p := range pws {
+	order := layoutOrder(len(pws),
+		func(i int) string { return pws[i].Name }, opts.Counts)
+	for _, i := range order {
+		p := pws[i]
 		// TODO: warn about duplicate entries
 		offsets[p] = uint64(data.Len())
-		x, err := SerializePasswd(p)
+		var x []byte
+		var err error
+		if strs != nil {
+			x, err = SerializePasswdCompact(p, strs)
+		} else {
+			x, err = SerializePasswd(p)
+		}
 		if err != nil {
 			return err
 		}
 		data.Write(x)
 	}
+	// The string table is stored at the beginning of the data section so
+	// its offsets are relative to the data section as well
+	var table bytes.Buffer
+	if strs != nil {
+		table.Write(strs.data.Bytes())
+		alignBufferTo(&table, 8)
+		for p := range offsets {
+			offsets[p] += uint64(table.Len())
+		}
+	}
 
 	// Copy to prevent sorting from modifying the argument
 	sorted := make([]Passwd, len(pws))
@@ -178,8 +267,10 @@ func SerializePasswds(w io.Writer, pws []Passwd) error {
 	// debugging easier
 	var indexOrig bytes.Buffer
 	for _, p := range pws {
-		le.PutUint64(tmp, offsets[p])
-		indexOrig.Write(tmp)
+		err := writeIndexSlot(&indexOrig, offsets[p], index32)
+		if err != nil {
+			return err
+		}
 	}
 
 	// Create index sorted after id
@@ -188,8 +279,10 @@ func SerializePasswds(w io.Writer, pws []Passwd) error {
 		return sorted[i].Uid < sorted[j].Uid
 	})
 	for _, p := range sorted {
-		le.PutUint64(tmp, offsets[p])
-		indexId.Write(tmp)
+		err := writeIndexSlot(&indexId, offsets[p], index32)
+		if err != nil {
+			return err
+		}
 	}
 
 	// Create index sorted after name
@@ -198,12 +291,18 @@ func SerializePasswds(w io.Writer, pws []Passwd) error {
 		return sorted[i].Name < sorted[j].Name
 	})
 	for _, p := range sorted {
-		le.PutUint64(tmp, offsets[p])
-		indexName.Write(tmp)
+		err := writeIndexSlot(&indexName, offsets[p], index32)
+		if err != nil {
+			return err
+		}
 	}
 
+	alignBufferTo(&indexOrig, 8)
+	alignBufferTo(&indexId, 8)
+	alignBufferTo(&indexName, 8)
+
 	// Sanity check
-	if len(pws)*8 != indexOrig.Len() ||
+	if indexSize(len(pws), index32) != indexOrig.Len() ||
 		indexOrig.Len() != indexId.Len() ||
 		indexId.Len() != indexName.Len() {
 		return fmt.Errorf("indexes have inconsistent length")
@@ -214,7 +313,7 @@ func SerializePasswds(w io.Writer, pws []Passwd) error {
 	// magic
 	w.Write([]byte("NSS-CASH"))
 	// version
-	le.PutUint64(tmp, PasswdVersion)
+	le.PutUint64(tmp, version)
 	w.Write(tmp)
 	// count
 	le.PutUint64(tmp, uint64(len(pws)))
@@ -248,6 +347,10 @@ func SerializePasswds(w io.Writer, pws []Passwd) error {
 	if err != nil {
 		return err
 	}
+	_, err = table.WriteTo(w)
+	if err != nil {
+		return err
+	}
 	_, err = data.WriteTo(w)
 	if err != nil {
 		return err
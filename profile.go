@@ -0,0 +1,146 @@
+// Profile nsscash itself, e.g. conversions of large files on production data
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"fmt"
+	"log"
+	"net"
+	"net/http"
+	httppprof "net/http/pprof"
+	"os"
+	"runtime"
+	"runtime/pprof"
+	"runtime/trace"
+)
+
+// startProfiling writes a CPU profile to cpuPath and an execution trace to
+// tracePath and serves the pprof endpoints on pprofAddr (which must be a
+// loopback address); all are optional. The returned function stops them and
+// writes a heap profile to memPath, it must be called before exiting.
+func startProfiling(cpuPath, memPath, tracePath, pprofAddr string) (func() error, error) {
+	var stops []func() error
+	stop := func() error {
+		var res error
+		for i := len(stops) - 1; i >= 0; i-- {
+			err := stops[i]()
+			if err != nil && res == nil {
+				res = err
+			}
+		}
+		stops = nil
+		return res
+	}
+
+	if cpuPath != "" {
+		f, err := os.Create(cpuPath)
+		if err != nil {
+			return nil, err
+		}
+		err = pprof.StartCPUProfile(f)
+		if err != nil {
+			f.Close()
+			return nil, err
+		}
+		stops = append(stops, func() error {
+			pprof.StopCPUProfile()
+			return f.Close()
+		})
+	}
+
+	if tracePath != "" {
+		f, err := os.Create(tracePath)
+		if err != nil {
+			stop()
+			return nil, err
+		}
+		err = trace.Start(f)
+		if err != nil {
+			f.Close()
+			stop()
+			return nil, err
+		}
+		stops = append(stops, func() error {
+			trace.Stop()
+			return f.Close()
+		})
+	}
+
+	if pprofAddr != "" {
+		err := checkPprofAddr(pprofAddr)
+		if err != nil {
+			stop()
+			return nil, err
+		}
+		ln, err := net.Listen("tcp", pprofAddr)
+		if err != nil {
+			stop()
+			return nil, err
+		}
+		// Don't use http.DefaultServeMux to serve nothing else
+		mux := http.NewServeMux()
+		mux.HandleFunc("/debug/pprof/", httppprof.Index)
+		mux.HandleFunc("/debug/pprof/cmdline", httppprof.Cmdline)
+		mux.HandleFunc("/debug/pprof/profile", httppprof.Profile)
+		mux.HandleFunc("/debug/pprof/symbol", httppprof.Symbol)
+		mux.HandleFunc("/debug/pprof/trace", httppprof.Trace)
+		go http.Serve(ln, mux)
+		log.Printf("serving pprof on http://%s/debug/pprof/", ln.Addr())
+		stops = append(stops, ln.Close)
+	}
+
+	if memPath != "" {
+		stops = append(stops, func() error {
+			return writeMemProfile(memPath)
+		})
+	}
+
+	return stop, nil
+}
+
+// checkPprofAddr verifies that addr is a loopback address as the pprof
+// endpoints must not be reachable from other hosts.
+func checkPprofAddr(addr string) error {
+	host, _, err := net.SplitHostPort(addr)
+	if err != nil {
+		return err
+	}
+	if host == "localhost" {
+		return nil
+	}
+	ip := net.ParseIP(host)
+	if ip == nil || !ip.IsLoopback() {
+		return fmt.Errorf("-pprof %q: not a loopback address", addr)
+	}
+	return nil
+}
+
+func writeMemProfile(path string) error {
+	f, err := os.Create(path)
+	if err != nil {
+		return err
+	}
+	// Include all allocations up to now
+	runtime.GC()
+	err = pprof.WriteHeapProfile(f)
+	if err != nil {
+		f.Close()
+		return err
+	}
+	return f.Close()
+}
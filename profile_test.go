@@ -0,0 +1,80 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+func TestStartProfiling(t *testing.T) {
+	dir, err := ioutil.TempDir("", "nsscash")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+
+	cpu := filepath.Join(dir, "cpu.prof")
+	mem := filepath.Join(dir, "mem.prof")
+	trace := filepath.Join(dir, "trace.out")
+	stop, err := startProfiling(cpu, mem, trace, "127.0.0.1:0")
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = stop()
+	if err != nil {
+		t.Fatal(err)
+	}
+	for _, x := range []string{cpu, mem, trace} {
+		fi, err := os.Stat(x)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if fi.Size() == 0 {
+			t.Errorf("%q is empty", x)
+		}
+	}
+
+	_, err = startProfiling("", "", "", "0.0.0.0:0")
+	if err == nil {
+		t.Errorf("non-loopback address: got no error")
+	}
+}
+
+func TestCheckPprofAddr(t *testing.T) {
+	tests := []struct {
+		addr string
+		ok   bool
+	}{
+		{"localhost:6060", true},
+		{"127.0.0.1:6060", true},
+		{"[::1]:6060", true},
+		{":6060", false},
+		{"0.0.0.0:6060", false},
+		{"192.0.2.1:6060", false},
+		{"example.org:6060", false},
+		{"localhost", false},
+	}
+
+	for _, tc := range tests {
+		err := checkPprofAddr(tc.addr)
+		if (err == nil) != tc.ok {
+			t.Errorf("%q: got %v, want ok %v", tc.addr, err, tc.ok)
+		}
+	}
+}
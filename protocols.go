@@ -0,0 +1,269 @@
+// Parse /etc/protocols files and serialize them
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"sort"
+	"strconv"
+	"strings"
+
+	"github.com/pkg/errors"
+)
+
+// Version written in SerializeProtocols()
+const ProtocolVersion = 1
+
+type Protocol struct {
+	Name    string
+	Number  uint64
+	Aliases []string
+}
+
+// ParseProtocols parses a file in the format of /etc/protocols and returns
+// all entries as slice of Protocol structs.
+func ParseProtocols(r io.Reader) ([]Protocol, error) {
+	var res []Protocol
+
+	s := bufio.NewReader(r)
+	for {
+		t, err := s.ReadString('\n')
+		if err != nil {
+			if err == io.EOF {
+				if t != "" {
+					return nil, fmt.Errorf(
+						"no newline in last line: %q",
+						t)
+				}
+				break
+			}
+			return nil, err
+		}
+
+		// Comments and empty lines are permitted in /etc/protocols
+		line := t
+		i := strings.IndexByte(line, '#')
+		if i >= 0 {
+			line = line[:i]
+		}
+		x := strings.Fields(line)
+		if len(x) == 0 {
+			continue
+		}
+		if len(x) < 2 {
+			return nil, fmt.Errorf("invalid line %q", t)
+		}
+
+		number, err := strconv.ParseUint(x[1], 10, 8)
+		if err != nil {
+			return nil, errors.Wrapf(err,
+				"invalid protocol number in line %q", t)
+		}
+
+		var aliases []string
+		// No aliases must result in a nil slice (as in ParseGroups()),
+		// not an empty slice
+		if len(x) > 2 {
+			aliases = x[2:]
+		}
+		res = append(res, Protocol{
+			Name:    x[0],
+			Number:  number,
+			Aliases: aliases,
+		})
+	}
+
+	return res, nil
+}
+
+func SerializeProtocol(p Protocol) ([]byte, error) {
+	le := binary.LittleEndian
+
+	// Concatenate all (NUL-terminated) strings and store the offsets
+	var aliases bytes.Buffer
+	var aliases_off []uint16
+	for _, a := range p.Aliases {
+		aliases_off = append(aliases_off, uint16(aliases.Len()))
+		aliases.Write([]byte(a))
+		aliases.WriteByte(0)
+	}
+	var data bytes.Buffer
+	data.Write([]byte(p.Name))
+	data.WriteByte(0)
+	alignBufferTo(&data, 2) // align the following uint16
+	offAliasesOff := uint16(data.Len())
+	// Offsets for aliases
+	offAliases := offAliasesOff + 2*uint16(len(aliases_off))
+	for _, o := range aliases_off {
+		tmp := make([]byte, 2)
+		le.PutUint16(tmp, offAliases+o)
+		data.Write(tmp)
+	}
+	// And the aliases concatenated as above
+	data.Write(aliases.Bytes())
+	// Ensure the offsets can fit the length of this entry
+	if data.Len() > math.MaxUint16 {
+		return nil, fmt.Errorf("protocol too large to serialize: %v, %v",
+			data.Len(), p)
+	}
+	size := uint16(data.Len())
+
+	var res bytes.Buffer // serialized result
+
+	id := make([]byte, 8)
+	// number
+	le.PutUint64(id, p.Number)
+	res.Write(id)
+
+	off := make([]byte, 2)
+	// off_aliases_off
+	le.PutUint16(off, offAliasesOff)
+	res.Write(off)
+	// aliases_count
+	le.PutUint16(off, uint16(len(p.Aliases)))
+	res.Write(off)
+	// data_size
+	le.PutUint16(off, size)
+	res.Write(off)
+
+	res.Write(data.Bytes())
+	// We must pad each entry so that all uint64 at the beginning of the
+	// struct are 8 byte aligned
+	alignBufferTo(&res, 8)
+
+	return res.Bytes(), nil
+}
+
+func SerializeProtocols(w io.Writer, prs []Protocol) error {
+	// Serialize protocols and store offsets; use the position instead of
+	// a map as in SerializeServices()
+	var data bytes.Buffer
+	offsets := make([]uint64, len(prs))
+	for i, p := range prs {
+		offsets[i] = uint64(data.Len())
+		x, err := SerializeProtocol(p)
+		if err != nil {
+			return err
+		}
+		data.Write(x)
+	}
+
+	// Key records for the name index; each protocol can be found by its
+	// name and by all its aliases
+	var keys []nameKey
+	for i, p := range prs {
+		keys = append(keys, nameKey{
+			name:  p.Name,
+			entry: offsets[i],
+		})
+		for _, a := range p.Aliases {
+			keys = append(keys, nameKey{
+				name:  a,
+				entry: offsets[i],
+			})
+		}
+	}
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	// Create index "sorted" in input order, used when iterating over all
+	// protocol entries (getprotoent_r); keeping the original order makes
+	// debugging easier
+	var indexOrig bytes.Buffer
+	for i := range prs {
+		le.PutUint64(tmp, offsets[i])
+		indexOrig.Write(tmp)
+	}
+
+	// Create index sorted after number; the stable sort keeps the input
+	// order for duplicate numbers (e.g. "ip" and "hopopt" use 0)
+	var indexId bytes.Buffer
+	sorted := make([]int, len(prs))
+	for i := range sorted {
+		sorted[i] = i
+	}
+	sort.SliceStable(sorted, func(i, j int) bool {
+		return prs[sorted[i]].Number < prs[sorted[j]].Number
+	})
+	for _, i := range sorted {
+		le.PutUint64(tmp, offsets[i])
+		indexId.Write(tmp)
+	}
+
+	// Create index sorted after name (including aliases)
+	indexName := serializeNameKeys(&data, keys)
+
+	// Sanity check
+	if len(prs)*8 != indexOrig.Len() ||
+		indexOrig.Len() != indexId.Len() ||
+		len(keys)*8+8 != indexName.Len() {
+		return fmt.Errorf("indexes have inconsistent length")
+	}
+
+	// Write result
+
+	// magic
+	w.Write([]byte("NSS-CASH"))
+	// version
+	le.PutUint64(tmp, ProtocolVersion)
+	w.Write(tmp)
+	// count
+	le.PutUint64(tmp, uint64(len(prs)))
+	w.Write(tmp)
+	// off_orig_index
+	offset := uint64(0)
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_id_index
+	offset += uint64(indexOrig.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_name_index
+	offset += uint64(indexId.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_data
+	offset += uint64(indexName.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+
+	_, err := indexOrig.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = indexId.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = indexName.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = data.WriteTo(w)
+	if err != nil {
+		return err
+	}
+
+	return nil
+}
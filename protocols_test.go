@@ -0,0 +1,80 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"fmt"
+	"reflect"
+	"strings"
+	"testing"
+)
+
+func TestParseProtocols(t *testing.T) {
+	tests := []struct {
+		data string
+		exp  []Protocol
+		err  error
+	}{
+		{
+			"",
+			nil,
+			nil,
+		},
+		{
+			"ip 0 IP",
+			nil,
+			fmt.Errorf("no newline in last line: \"ip 0 IP\""),
+		},
+		{
+			"ip\n",
+			nil,
+			fmt.Errorf("invalid line \"ip\\n\""),
+		},
+		{
+			"# Internet (IP) protocols\n" +
+				"\n" +
+				"ip\t0\tIP\t\t# internet protocol\n" +
+				"foo\t254\n",
+			[]Protocol{
+				Protocol{
+					Name:   "ip",
+					Number: 0,
+					Aliases: []string{
+						"IP",
+					},
+				},
+				Protocol{
+					Name:    "foo",
+					Number:  254,
+					Aliases: nil,
+				},
+			},
+			nil,
+		},
+	}
+
+	for n, tc := range tests {
+		res, err := ParseProtocols(strings.NewReader(tc.data))
+		if !reflect.DeepEqual(err, tc.err) {
+			t.Errorf("%d: err = %v, want %v",
+				n, err, tc.err)
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %v, want %v",
+				n, res, tc.exp)
+		}
+	}
+}
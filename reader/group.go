@@ -0,0 +1,127 @@
+// Read group entries from nsscash files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package reader
+
+// Size of struct group_entry and struct group_entry_compact/_large without
+// data[] (see nss/entry.h)
+const (
+	groupEntrySize        = 8 + 4*2
+	groupEntryCompactSize = 8 + 4*4
+	groupEntryLargeSize   = groupEntryCompactSize
+)
+
+type Group struct {
+	Name   []byte
+	Passwd []byte
+	Gid    uint64
+
+	data    []byte
+	memOffs []byte // mem_count uint16 offsets into data
+	// Only for featureMemberTable: data section with the member table,
+	// memOffs contains uint32 offsets into it
+	table []byte
+	// Only for featureLargeGroups: memOffs contains uint32 offsets
+	large bool
+}
+
+// MemberCount returns the number of members of the group.
+func (g *Group) MemberCount() int {
+	if g.table != nil || g.large {
+		return len(g.memOffs) / 4
+	}
+	return len(g.memOffs) / 2
+}
+
+// Member returns the name of member i (0 <= i < MemberCount()).
+func (g *Group) Member(i int) []byte {
+	if g.table != nil {
+		return cString(g.table[le.Uint32(g.memOffs[4*i:]):])
+	} else if g.large {
+		return cString(g.data[le.Uint32(g.memOffs[4*i:]):])
+	}
+	return cString(g.data[le.Uint16(g.memOffs[2*i:]):])
+}
+
+func (f *File) toGroup(e []byte) Group {
+	if f.features&(featureMemberTable|featureLargeGroups) != 0 {
+		// struct group_entry_compact and struct group_entry_large have
+		// the same layout
+		data := e[groupEntryCompactSize:]
+		data = data[:le.Uint32(e[20:])] // data_size
+		offMemOff := le.Uint32(e[12:])
+		count := le.Uint32(e[16:])
+		g := Group{
+			Name:    cString(data),
+			Passwd:  cString(data[le.Uint32(e[8:]):]),
+			Gid:     le.Uint64(e),
+			data:    data,
+			memOffs: data[offMemOff : uint64(offMemOff)+4*uint64(count)],
+		}
+		if f.features&featureMemberTable != 0 {
+			g.table = f.data
+		} else {
+			g.large = true
+		}
+		return g
+	}
+
+	data := e[groupEntrySize:]
+	data = data[:le.Uint16(e[14:])] // data_size
+	offMemOff := le.Uint16(e[10:])
+	count := int(le.Uint16(e[12:]))
+	return Group{
+		Name:    cString(data),
+		Passwd:  cString(data[le.Uint16(e[8:]):]),
+		Gid:     le.Uint64(e),
+		data:    data,
+		memOffs: data[offMemOff : int(offMemOff)+2*count],
+	}
+}
+
+// Group returns the entry at position i (0 <= i < Len()) in the order of
+// the original file; like getgrent_r().
+func (f *File) Group(i int) (Group, bool) {
+	if i < 0 || i >= f.count {
+		return Group{}, false
+	}
+	return f.toGroup(f.entry(f.origIndex, i)), true
+}
+
+// GroupByGid returns the entry with the given gid; like getgrgid_r().
+func (f *File) GroupByGid(gid uint64) (Group, bool) {
+	e := f.searchId(gid)
+	if e == nil {
+		return Group{}, false
+	}
+	return f.toGroup(e), true
+}
+
+// GroupByName returns the entry with the given name; like getgrnam_r().
+func (f *File) GroupByName(name string) (Group, bool) {
+	offset := groupEntrySize
+	if f.features&featureMemberTable != 0 {
+		offset = groupEntryCompactSize
+	} else if f.features&featureLargeGroups != 0 {
+		offset = groupEntryLargeSize
+	}
+	e := f.searchName(name, offset)
+	if e == nil {
+		return Group{}, false
+	}
+	return f.toGroup(e), true
+}
@@ -0,0 +1,94 @@
+// Read passwd entries from nsscash files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package reader
+
+// Size of struct passwd_entry and struct passwd_entry_compact without data[]
+// (see nss/entry.h)
+const (
+	passwdEntrySize        = 8 + 8 + 5*2
+	passwdEntryCompactSize = 8 + 8 + 4*4 + 2
+)
+
+type Passwd struct {
+	Name   []byte
+	Passwd []byte
+	Uid    uint64
+	Gid    uint64
+	Gecos  []byte
+	Dir    []byte
+	Shell  []byte
+}
+
+func (f *File) toPasswd(e []byte) Passwd {
+	if f.features&featureStringTable != 0 {
+		data := e[passwdEntryCompactSize:]
+		data = data[:le.Uint16(e[32:])] // data_size
+		return Passwd{
+			Name:   cString(data),
+			Passwd: cString(f.data[le.Uint32(e[16:]):]),
+			Uid:    le.Uint64(e),
+			Gid:    le.Uint64(e[8:]),
+			Gecos:  cString(f.data[le.Uint32(e[20:]):]),
+			Dir:    cString(f.data[le.Uint32(e[24:]):]),
+			Shell:  cString(f.data[le.Uint32(e[28:]):]),
+		}
+	}
+
+	data := e[passwdEntrySize:]
+	data = data[:le.Uint16(e[24:])] // data_size
+	return Passwd{
+		Name:   cString(data),
+		Passwd: cString(data[le.Uint16(e[16:]):]),
+		Uid:    le.Uint64(e),
+		Gid:    le.Uint64(e[8:]),
+		Gecos:  cString(data[le.Uint16(e[18:]):]),
+		Dir:    cString(data[le.Uint16(e[20:]):]),
+		Shell:  cString(data[le.Uint16(e[22:]):]),
+	}
+}
+
+// Passwd returns the entry at position i (0 <= i < Len()) in the order of
+// the original file; like getpwent_r().
+func (f *File) Passwd(i int) (Passwd, bool) {
+	if i < 0 || i >= f.count {
+		return Passwd{}, false
+	}
+	return f.toPasswd(f.entry(f.origIndex, i)), true
+}
+
+// PasswdByUid returns the entry with the given uid; like getpwuid_r().
+func (f *File) PasswdByUid(uid uint64) (Passwd, bool) {
+	e := f.searchId(uid)
+	if e == nil {
+		return Passwd{}, false
+	}
+	return f.toPasswd(e), true
+}
+
+// PasswdByName returns the entry with the given name; like getpwnam_r().
+func (f *File) PasswdByName(name string) (Passwd, bool) {
+	offset := passwdEntrySize
+	if f.features&featureStringTable != 0 {
+		offset = passwdEntryCompactSize
+	}
+	e := f.searchName(name, offset)
+	if e == nil {
+		return Passwd{}, false
+	}
+	return f.toPasswd(e), true
+}
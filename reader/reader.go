@@ -0,0 +1,333 @@
+// Package reader reads nsscash passwd and group files directly, without NSS
+// or cgo
+//
+// The lookups follow the semantics of the NSS module (nss/pw.c and
+// nss/gr.c). All returned byte slices point directly into the file (mmapped
+// with Open) and must not be modified or used after Close. Lookups which find
+// an entry don't allocate.
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package reader
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"syscall"
+)
+
+// Versions supported by this reader, see nss/file.c; version 2 adds a
+// section table
+const (
+	version         = 1
+	versionSections = 2
+)
+
+// Optional format features in the upper 32 bits of the version, see
+// nss/file.h
+const (
+	featureStringTable uint64 = 1 << (32 + iota)
+	featureMemberTable
+	featureLargeGroups
+	featureIndex32
+	featureSharded
+	featureCombined
+	featureImplicitUPG
+	featureTable
+
+	versionMask   = 1<<32 - 1
+	knownFeatures = featureStringTable | featureMemberTable |
+		featureLargeGroups | featureIndex32 | featureImplicitUPG
+)
+
+const headerSize = 7 * 8
+const sectionSize = 4 + 4 + 8 + 8
+
+// Section flag: the file must be rejected if the section type is unknown
+const sectionRequired = 1
+
+// Section types, see nss/file.h
+const (
+	sectionPasswd = 1 // passwd file in a combined file
+	sectionGroup  = 2 // group file in a combined file
+	sectionHot    = 3 // hot-entry table
+)
+
+// sectionKnown returns true if sections of typ are supported, like
+// section_known() in nss/file.c. The hot-entry table only speeds up lookups
+// of the NSS module and is ignored by this package; passwd and group
+// sections are only used in combined files which are rejected by New().
+func sectionKnown(typ uint32) bool {
+	switch typ {
+	case sectionPasswd, sectionGroup, sectionHot:
+		return true
+	default:
+		return false
+	}
+}
+
+var le = binary.LittleEndian
+
+// File is an nsscash passwd or group file. It's safe for concurrent use.
+type File struct {
+	mapped []byte // nil if not mmapped
+
+	features  uint64
+	count     int
+	origIndex []byte
+	idIndex   []byte
+	nameIndex []byte
+	data      []byte
+	sections  []byte // section table (without count), version 2 only
+	raw       []byte // everything after the header
+}
+
+// Open mmaps the nsscash file at path.
+func Open(path string) (*File, error) {
+	x, err := mmapFile(path)
+	if err != nil {
+		return nil, err
+	}
+
+	res, err := New(x)
+	if err != nil {
+		syscall.Munmap(x)
+		return nil, fmt.Errorf("%s: %v", path, err)
+	}
+	res.mapped = x
+	return res, nil
+}
+
+// mmapFile mmaps the nsscash file at path (which must be at least as large
+// as the header) read-only.
+func mmapFile(path string) ([]byte, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	stat, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+	size := stat.Size()
+	if size < headerSize || int64(int(size)) != size {
+		return nil, fmt.Errorf("%s: invalid size %d", path, size)
+	}
+	x, err := syscall.Mmap(int(f.Fd()), 0, int(size),
+		syscall.PROT_READ, syscall.MAP_PRIVATE)
+	if err != nil {
+		return nil, &os.PathError{Op: "mmap", Path: path, Err: err}
+	}
+	return x, nil
+}
+
+// New uses x as content of an nsscash file. x must not be modified while the
+// File is used.
+func New(x []byte) (*File, error) {
+	if len(x) < headerSize || string(x[:8]) != "NSS-CASH" {
+		return nil, fmt.Errorf("invalid magic")
+	}
+	v := le.Uint64(x[8:])
+	if (v&versionMask != version && v&versionMask != versionSections) ||
+		v&^(versionMask|knownFeatures) != 0 {
+		return nil, fmt.Errorf("unsupported version %#x", v)
+	}
+
+	count := le.Uint64(x[16:])
+	offOrig := le.Uint64(x[24:])
+	offId := le.Uint64(x[32:])
+	offName := le.Uint64(x[40:])
+	offData := le.Uint64(x[48:])
+
+	slot := uint64(8)
+	if v&featureIndex32 != 0 {
+		slot = 4
+	}
+
+	data := x[headerSize:]
+	size := uint64(len(data))
+	if count > size/slot ||
+		offOrig > size || size-offOrig < slot*count ||
+		offId > size || size-offId < slot*count ||
+		offName > size || size-offName < slot*count ||
+		offData > size {
+		return nil, fmt.Errorf("invalid header")
+	}
+
+	var sections []byte
+	if v&versionMask == versionSections {
+		if size < 8 || le.Uint64(data) > (size-8)/sectionSize {
+			return nil, fmt.Errorf("invalid section table")
+		}
+		sections = data[8 : 8+le.Uint64(data)*sectionSize]
+		for i := 0; i < len(sections); i += sectionSize {
+			flags := le.Uint32(sections[i+4:])
+			off := le.Uint64(sections[i+8:])
+			length := le.Uint64(sections[i+16:])
+			if off > size || size-off < length {
+				return nil, fmt.Errorf("invalid section %d",
+					i/sectionSize)
+			}
+			if flags&sectionRequired != 0 &&
+				!sectionKnown(le.Uint32(sections[i:])) {
+				return nil, fmt.Errorf(
+					"unsupported required section type %d",
+					le.Uint32(sections[i:]))
+			}
+		}
+	}
+
+	return &File{
+		features:  v &^ versionMask,
+		count:     int(count),
+		origIndex: data[offOrig : offOrig+slot*count],
+		idIndex:   data[offId : offId+slot*count],
+		nameIndex: data[offName : offName+slot*count],
+		data:      data[offData:],
+		sections:  sections,
+		raw:       data,
+	}, nil
+}
+
+// Section returns the content of the first section with type typ (version 2
+// files only).
+func (f *File) Section(typ uint32) ([]byte, bool) {
+	for i := 0; i < len(f.sections); i += sectionSize {
+		if le.Uint32(f.sections[i:]) != typ {
+			continue
+		}
+		off := le.Uint64(f.sections[i+8:])
+		length := le.Uint64(f.sections[i+16:])
+		return f.raw[off : off+length], true
+	}
+	return nil, false
+}
+
+// Close unmaps the file. All slices returned from lookups become invalid.
+func (f *File) Close() error {
+	if f.mapped == nil {
+		return nil
+	}
+	err := syscall.Munmap(f.mapped)
+	f.mapped = nil
+	return err
+}
+
+// ImplicitUPG returns true if the group file omits the user private groups
+// of the passwd file. They are synthesized by the NSS module but not by the
+// lookup functions of this package.
+func (f *File) ImplicitUPG() bool {
+	return f.features&featureImplicitUPG != 0
+}
+
+// Len returns the number of entries in the file.
+func (f *File) Len() int {
+	return f.count
+}
+
+// entry returns the data of the entry at position i of index.
+func (f *File) entry(index []byte, i int) []byte {
+	if f.features&featureIndex32 != 0 {
+		return f.data[uint64(le.Uint32(index[4*i:]))*8:]
+	}
+	return f.data[le.Uint64(index[8*i:]):]
+}
+
+// searchId returns the first entry in the id index with the given id (stored
+// as first uint64 of each entry) or nil. Like the NSS module (see
+// DEFINE_LOWER_BOUND() in nss/search.c) it searches the lower bound so
+// duplicate ids return the same entry.
+func (f *File) searchId(id uint64) []byte {
+	// Manual binary search, sort.Search() would require a closure
+	low, high := 0, f.count
+	for low < high {
+		middle := int(uint(low+high) >> 1)
+		if le.Uint64(f.entry(f.idIndex, middle)) < id {
+			low = middle + 1
+		} else {
+			high = middle
+		}
+	}
+	if low == f.count {
+		return nil
+	}
+	e := f.entry(f.idIndex, low)
+	if le.Uint64(e) != id {
+		return nil
+	}
+	return e
+}
+
+// searchName returns the first entry in the name index with the given name
+// (stored as first string in the entry data after a header of size offset)
+// or nil, see searchId().
+func (f *File) searchName(name string, offset int) []byte {
+	low, high := 0, f.count
+	for low < high {
+		middle := int(uint(low+high) >> 1)
+		e := f.entry(f.nameIndex, middle)
+		if compare(cString(e[offset:]), name) < 0 {
+			low = middle + 1
+		} else {
+			high = middle
+		}
+	}
+	if low == f.count {
+		return nil
+	}
+	e := f.entry(f.nameIndex, low)
+	if compare(cString(e[offset:]), name) != 0 {
+		return nil
+	}
+	return e
+}
+
+// compare compares like strcmp(3) (as used by the NSS module) but without
+// converting b to a string.
+func compare(b []byte, s string) int {
+	n := len(b)
+	if len(s) < n {
+		n = len(s)
+	}
+	for i := 0; i < n; i++ {
+		if b[i] != s[i] {
+			if b[i] < s[i] {
+				return -1
+			}
+			return 1
+		}
+	}
+	if len(b) < len(s) {
+		return -1
+	} else if len(b) > len(s) {
+		return 1
+	}
+	return 0
+}
+
+// cString returns the NUL-terminated string at the beginning of x (without
+// the NUL).
+func cString(x []byte) []byte {
+	i := bytes.IndexByte(x, 0)
+	if i < 0 {
+		return x
+	}
+	return x[:i]
+}
@@ -0,0 +1,241 @@
+// Read tables from nsscash files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package reader
+
+import (
+	"bytes"
+	"fmt"
+	"sort"
+	"syscall"
+)
+
+// Version of table files, see TableVersion in table.go of nsscash
+const tableVersion = 1
+
+// Table is an nsscash table file providing keyed lookups. It's safe for
+// concurrent use.
+type Table struct {
+	mapped []byte // nil if not mmapped
+
+	Columns []string
+
+	count     uint64
+	origIndex []byte
+	data      []byte // header's data
+	rows      []byte // data section
+	indices   map[int]tableIndex
+}
+
+type tableIndex struct {
+	flags uint64
+	index []byte // without the leading count
+	count uint64
+}
+
+// OpenTable mmaps the nsscash table file at path.
+func OpenTable(path string) (*Table, error) {
+	x, err := mmapFile(path)
+	if err != nil {
+		return nil, err
+	}
+
+	res, err := NewTable(x)
+	if err != nil {
+		syscall.Munmap(x)
+		return nil, fmt.Errorf("%s: %v", path, err)
+	}
+	res.mapped = x
+	return res, nil
+}
+
+// NewTable uses x as content of an nsscash table file (as written by
+// SerializeTable() of nsscash). x must not be modified while the Table is
+// used.
+func NewTable(x []byte) (*Table, error) {
+	if len(x) < headerSize || string(x[:8]) != "NSS-CASH" {
+		return nil, fmt.Errorf("invalid magic")
+	}
+	v := le.Uint64(x[8:])
+	if v&featureTable == 0 {
+		return nil, fmt.Errorf("not a table file")
+	}
+	if v != tableVersion|featureTable {
+		return nil, fmt.Errorf("unsupported version %#x", v)
+	}
+	t := &Table{
+		count:   le.Uint64(x[16:]),
+		data:    x[headerSize:],
+		indices: make(map[int]tableIndex),
+	}
+	offOrig := le.Uint64(x[3*8:])
+	offSchema := le.Uint64(x[5*8:])
+	offData := le.Uint64(x[6*8:])
+	size := uint64(len(t.data))
+	if offOrig > size || offSchema > size || offData > size ||
+		t.count > (size-offOrig)/8 {
+		return nil, fmt.Errorf("invalid offsets")
+	}
+	t.origIndex = t.data[offOrig : offOrig+8*t.count]
+	t.rows = t.data[offData:]
+
+	schema := t.data[offSchema:]
+	if len(schema) < 16 {
+		return nil, fmt.Errorf("invalid schema")
+	}
+	columns := le.Uint64(schema)
+	indices := le.Uint64(schema[8:])
+	if uint64(len(schema)-16)/8 < columns ||
+		(uint64(len(schema)-16)/8-columns)/3 < indices {
+		return nil, fmt.Errorf("invalid schema")
+	}
+	for i := uint64(0); i < columns; i++ {
+		name, err := tableString(t.rows, le.Uint64(schema[16+8*i:]))
+		if err != nil {
+			return nil, err
+		}
+		t.Columns = append(t.Columns, name)
+	}
+	for i := uint64(0); i < indices; i++ {
+		x := schema[16+8*columns+3*8*i:]
+		col := le.Uint64(x)
+		off := le.Uint64(x[16:])
+		if col >= columns || off > size || size-off < 8 {
+			return nil, fmt.Errorf("invalid index")
+		}
+		count := le.Uint64(t.data[off:])
+		if (size-off-8)/8 < count {
+			return nil, fmt.Errorf("invalid index")
+		}
+		t.indices[int(col)] = tableIndex{
+			flags: le.Uint64(x[8:]),
+			index: t.data[off+8 : off+8+8*count],
+			count: count,
+		}
+	}
+
+	return t, nil
+}
+
+// Close unmaps the file.
+func (t *Table) Close() error {
+	if t.mapped == nil {
+		return nil
+	}
+	err := syscall.Munmap(t.mapped)
+	t.mapped = nil
+	return err
+}
+
+// Len returns the number of rows in the table.
+func (t *Table) Len() int {
+	return int(t.count)
+}
+
+// Row returns the row at position i (in input order).
+func (t *Table) Row(i int) ([]string, error) {
+	if i < 0 || uint64(i) >= t.count {
+		return nil, fmt.Errorf("invalid row %d", i)
+	}
+	return t.row(le.Uint64(t.origIndex[8*i:]))
+}
+
+// Lookup returns all rows whose column has the given value, in input order.
+func (t *Table) Lookup(column, value string) ([][]string, error) {
+	col := -1
+	for i, c := range t.Columns {
+		if c == column {
+			col = i
+		}
+	}
+	if col < 0 {
+		return nil, fmt.Errorf("unknown column %q", column)
+	}
+	idx, ok := t.indices[col]
+	if !ok {
+		return nil, fmt.Errorf("column %q is not indexed", column)
+	}
+
+	key := func(i int) (string, uint64, error) {
+		off := le.Uint64(idx.index[8*i:])
+		if off > uint64(len(t.rows)) || uint64(len(t.rows))-off < 8 {
+			return "", 0, fmt.Errorf("invalid offset")
+		}
+		name, err := tableString(t.rows, off+8)
+		return name, le.Uint64(t.rows[off:]), err
+	}
+
+	// Binary search for the first key record with the given value
+	var err error
+	i := sort.Search(int(idx.count), func(i int) bool {
+		name, _, e := key(i)
+		if e != nil {
+			err = e
+			return true
+		}
+		return name >= value
+	})
+	if err != nil {
+		return nil, err
+	}
+
+	var res [][]string
+	for ; i < int(idx.count); i++ {
+		name, row, err := key(i)
+		if err != nil {
+			return nil, err
+		}
+		if name != value {
+			break
+		}
+		x, err := t.row(row)
+		if err != nil {
+			return nil, err
+		}
+		res = append(res, x)
+	}
+	return res, nil
+}
+
+func (t *Table) row(off uint64) ([]string, error) {
+	size := uint64(len(t.rows))
+	if off > size || size-off < 4+4*uint64(len(t.Columns)) {
+		return nil, fmt.Errorf("invalid row offset")
+	}
+	var res []string
+	for i := range t.Columns {
+		x, err := tableString(t.rows,
+			off+uint64(le.Uint32(t.rows[off+4+4*uint64(i):])))
+		if err != nil {
+			return nil, err
+		}
+		res = append(res, x)
+	}
+	return res, nil
+}
+
+// tableString returns the NUL-terminated string starting at off in x.
+func tableString(x []byte, off uint64) (string, error) {
+	if off >= uint64(len(x)) {
+		return "", fmt.Errorf("invalid string offset")
+	}
+	i := bytes.IndexByte(x[off:], 0)
+	if i < 0 {
+		return "", fmt.Errorf("unterminated string")
+	}
+	return string(x[off : off+uint64(i)]), nil
+}
@@ -0,0 +1,107 @@
+// Optional sections of version 2 nsscash files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+)
+
+// Version written by AddSections()
+const SectionVersion = 2
+
+// Readers must reject files with sections which have this flag but an
+// unknown type; sections without it are ignored if unknown
+const SectionRequired uint32 = 1
+
+// Section is an optional part of a version 2 file, see struct section in
+// nss/file.h.
+type Section struct {
+	Type  uint32
+	Flags uint32
+	Data  []byte
+}
+
+const headerSize = 7 * 8
+const sectionSize = 4 + 4 + 8 + 8
+
+// AddSections converts the serialized version 1 file x into a version 2 file
+// with the given sections. The section table and the section contents are
+// inserted at the beginning of the data (directly after the header, so small
+// sections share the first page with it) and the offsets in the header are
+// adjusted. All other offsets are relative to the data section and stay
+// valid.
+func AddSections(x []byte, sections []Section) ([]byte, error) {
+	le := binary.LittleEndian
+
+	if len(x) < headerSize || string(x[:8]) != "NSS-CASH" {
+		return nil, fmt.Errorf("invalid magic")
+	}
+	v := le.Uint64(x[8:])
+	if v&(1<<32-1) != 1 {
+		return nil, fmt.Errorf("unsupported version %#x", v)
+	}
+
+	tableSize := uint64(8 + len(sections)*sectionSize)
+	size := tableSize
+	for _, s := range sections {
+		size += (uint64(len(s.Data)) + 7) / 8 * 8
+	}
+	data := x[headerSize:]
+
+	var res bytes.Buffer
+	tmp := make([]byte, 8)
+
+	res.Write(x[:8])
+	// version
+	le.PutUint64(tmp, v&^(1<<32-1)|SectionVersion)
+	res.Write(tmp)
+	// count
+	res.Write(x[16:24])
+	// off_orig_index, off_id_index, off_name_index, off_data
+	for i := 0; i < 4; i++ {
+		le.PutUint64(tmp, le.Uint64(x[24+8*i:])+size)
+		res.Write(tmp)
+	}
+
+	// Section table, followed by the contents and the original data
+	le.PutUint64(tmp, uint64(len(sections)))
+	res.Write(tmp)
+	offset := tableSize
+	for _, s := range sections {
+		le.PutUint32(tmp, s.Type)
+		res.Write(tmp[:4])
+		le.PutUint32(tmp, s.Flags)
+		res.Write(tmp[:4])
+		le.PutUint64(tmp, offset)
+		res.Write(tmp)
+		le.PutUint64(tmp, uint64(len(s.Data)))
+		res.Write(tmp)
+
+		offset += (uint64(len(s.Data)) + 7) / 8 * 8
+	}
+
+	for _, s := range sections {
+		res.Write(s.Data)
+		alignBufferTo(&res, 8)
+	}
+	res.Write(data)
+
+	return res.Bytes(), nil
+}
@@ -0,0 +1,106 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func TestAddSections(t *testing.T) {
+	orig, err := ioutil.ReadFile("nss/tests/passwd")
+	if err != nil {
+		t.Fatal(err)
+	}
+	pws, err := ParsePasswds(bytes.NewReader(orig))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	for _, compact := range []bool{false, true} {
+		var x bytes.Buffer
+		err = SerializePasswds(&x, pws, SerializeOptions{
+			Compact: compact,
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		// Unknown optional sections are ignored
+		y, err := AddSections(x.Bytes(), []Section{
+			{Type: 7, Data: []byte("abc")},
+			{Type: 8, Data: nil},
+			{Type: 9, Data: []byte("0123456789")},
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+		if len(y)%8 != 0 {
+			t.Errorf("unaligned size %d", len(y))
+		}
+		f, err := reader.New(y)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if f.Len() != len(pws) {
+			t.Errorf("len: got %d, want %d", f.Len(), len(pws))
+		}
+		for i, p := range pws {
+			a, ok := f.PasswdByName(p.Name)
+			if !ok || a.Uid != p.Uid {
+				t.Errorf("name %q: got %v %v", p.Name, a, ok)
+			}
+			b, ok := f.Passwd(i)
+			if !ok || string(b.Shell) != p.Shell {
+				t.Errorf("%d: got %v %v", i, b, ok)
+			}
+		}
+		for _, tc := range []struct {
+			typ uint32
+			exp string
+			ok  bool
+		}{
+			{7, "abc", true},
+			{8, "", true},
+			{9, "0123456789", true},
+			{10, "", false},
+		} {
+			res, ok := f.Section(tc.typ)
+			if string(res) != tc.exp || ok != tc.ok {
+				t.Errorf("section %d: got %q %v, want %q %v",
+					tc.typ, res, ok, tc.exp, tc.ok)
+			}
+		}
+
+		// Unknown required sections are rejected
+		y, err = AddSections(x.Bytes(), []Section{
+			{Type: 7, Flags: SectionRequired, Data: []byte("abc")},
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+		_, err = reader.New(y)
+		mustBeErrorWithSubstring(t, err,
+			"unsupported required section type 7")
+
+		// Only version 1 files can be converted
+		_, err = AddSections(y, nil)
+		mustBeErrorWithSubstring(t, err, "unsupported version 0x")
+	}
+}
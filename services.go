@@ -0,0 +1,282 @@
+// Parse /etc/services files and serialize them
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"sort"
+	"strconv"
+	"strings"
+
+	"github.com/pkg/errors"
+)
+
+// Version written in SerializeServices()
+const ServiceVersion = 1
+
+type Service struct {
+	Name    string
+	Port    uint64
+	Proto   string
+	Aliases []string
+}
+
+// ParseServices parses a file in the format of /etc/services and returns all
+// entries as slice of Service structs.
+func ParseServices(r io.Reader) ([]Service, error) {
+	var res []Service
+
+	s := bufio.NewReader(r)
+	for {
+		t, err := s.ReadString('\n')
+		if err != nil {
+			if err == io.EOF {
+				if t != "" {
+					return nil, fmt.Errorf(
+						"no newline in last line: %q",
+						t)
+				}
+				break
+			}
+			return nil, err
+		}
+
+		// Comments and empty lines are permitted in /etc/services
+		line := t
+		i := strings.IndexByte(line, '#')
+		if i >= 0 {
+			line = line[:i]
+		}
+		x := strings.Fields(line)
+		if len(x) == 0 {
+			continue
+		}
+		if len(x) < 2 {
+			return nil, fmt.Errorf("invalid line %q", t)
+		}
+
+		y := strings.Split(x[1], "/")
+		if len(y) != 2 || y[1] == "" {
+			return nil, fmt.Errorf("invalid port/proto in line %q", t)
+		}
+		port, err := strconv.ParseUint(y[0], 10, 16)
+		if err != nil {
+			return nil, errors.Wrapf(err, "invalid port in line %q", t)
+		}
+
+		var aliases []string
+		// No aliases must result in a nil slice (as in ParseGroups()),
+		// not an empty slice
+		if len(x) > 2 {
+			aliases = x[2:]
+		}
+		res = append(res, Service{
+			Name:    x[0],
+			Port:    port,
+			Proto:   y[1],
+			Aliases: aliases,
+		})
+	}
+
+	return res, nil
+}
+
+func SerializeService(s Service) ([]byte, error) {
+	le := binary.LittleEndian
+
+	// Concatenate all (NUL-terminated) strings and store the offsets
+	var aliases bytes.Buffer
+	var aliases_off []uint16
+	for _, a := range s.Aliases {
+		aliases_off = append(aliases_off, uint16(aliases.Len()))
+		aliases.Write([]byte(a))
+		aliases.WriteByte(0)
+	}
+	var data bytes.Buffer
+	data.Write([]byte(s.Name))
+	data.WriteByte(0)
+	offProto := uint16(data.Len())
+	data.Write([]byte(s.Proto))
+	data.WriteByte(0)
+	alignBufferTo(&data, 2) // align the following uint16
+	offAliasesOff := uint16(data.Len())
+	// Offsets for aliases
+	offAliases := offAliasesOff + 2*uint16(len(aliases_off))
+	for _, o := range aliases_off {
+		tmp := make([]byte, 2)
+		le.PutUint16(tmp, offAliases+o)
+		data.Write(tmp)
+	}
+	// And the aliases concatenated as above
+	data.Write(aliases.Bytes())
+	// Ensure the offsets can fit the length of this entry
+	if data.Len() > math.MaxUint16 {
+		return nil, fmt.Errorf("service too large to serialize: %v, %v",
+			data.Len(), s)
+	}
+	size := uint16(data.Len())
+
+	var res bytes.Buffer // serialized result
+
+	id := make([]byte, 8)
+	// port
+	le.PutUint64(id, s.Port)
+	res.Write(id)
+
+	off := make([]byte, 2)
+	// off_proto
+	le.PutUint16(off, offProto)
+	res.Write(off)
+	// off_aliases_off
+	le.PutUint16(off, offAliasesOff)
+	res.Write(off)
+	// aliases_count
+	le.PutUint16(off, uint16(len(s.Aliases)))
+	res.Write(off)
+	// data_size
+	le.PutUint16(off, size)
+	res.Write(off)
+
+	res.Write(data.Bytes())
+	// We must pad each entry so that all uint64 at the beginning of the
+	// struct are 8 byte aligned
+	alignBufferTo(&res, 8)
+
+	return res.Bytes(), nil
+}
+
+func SerializeServices(w io.Writer, svs []Service) error {
+	// Serialize services and store offsets; services can contain
+	// duplicates (the same service under multiple names) so use the
+	// position instead of a map
+	var data bytes.Buffer
+	offsets := make([]uint64, len(svs))
+	for i, s := range svs {
+		offsets[i] = uint64(data.Len())
+		x, err := SerializeService(s)
+		if err != nil {
+			return err
+		}
+		data.Write(x)
+	}
+
+	// Key records for the name index; each service can be found by its
+	// name and by all its aliases
+	var keys []nameKey
+	for i, s := range svs {
+		keys = append(keys, nameKey{
+			name:  s.Name,
+			entry: offsets[i],
+		})
+		for _, a := range s.Aliases {
+			keys = append(keys, nameKey{
+				name:  a,
+				entry: offsets[i],
+			})
+		}
+	}
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	// Create index "sorted" in input order, used when iterating over all
+	// service entries (getservent_r); keeping the original order makes
+	// debugging easier
+	var indexOrig bytes.Buffer
+	for i := range svs {
+		le.PutUint64(tmp, offsets[i])
+		indexOrig.Write(tmp)
+	}
+
+	// Create index sorted after port; the same port is used for multiple
+	// protocols, the stable sort keeps the input order for them so the
+	// first matching entry is returned when no protocol is requested
+	var indexId bytes.Buffer
+	sorted := make([]int, len(svs))
+	for i := range sorted {
+		sorted[i] = i
+	}
+	sort.SliceStable(sorted, func(i, j int) bool {
+		return svs[sorted[i]].Port < svs[sorted[j]].Port
+	})
+	for _, i := range sorted {
+		le.PutUint64(tmp, offsets[i])
+		indexId.Write(tmp)
+	}
+
+	// Create index sorted after name (including aliases)
+	indexName := serializeNameKeys(&data, keys)
+
+	// Sanity check
+	if len(svs)*8 != indexOrig.Len() ||
+		indexOrig.Len() != indexId.Len() ||
+		len(keys)*8+8 != indexName.Len() {
+		return fmt.Errorf("indexes have inconsistent length")
+	}
+
+	// Write result
+
+	// magic
+	w.Write([]byte("NSS-CASH"))
+	// version
+	le.PutUint64(tmp, ServiceVersion)
+	w.Write(tmp)
+	// count
+	le.PutUint64(tmp, uint64(len(svs)))
+	w.Write(tmp)
+	// off_orig_index
+	offset := uint64(0)
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_id_index
+	offset += uint64(indexOrig.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_name_index
+	offset += uint64(indexId.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_data
+	offset += uint64(indexName.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+
+	_, err := indexOrig.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = indexId.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = indexName.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = data.WriteTo(w)
+	if err != nil {
+		return err
+	}
+
+	return nil
+}
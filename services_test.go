@@ -0,0 +1,106 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"fmt"
+	"reflect"
+	"strings"
+	"testing"
+)
+
+func TestParseServices(t *testing.T) {
+	tests := []struct {
+		data string
+		exp  []Service
+		err  error
+	}{
+		{
+			"",
+			nil,
+			nil,
+		},
+		{
+			"echo 7/tcp",
+			nil,
+			fmt.Errorf("no newline in last line: \"echo 7/tcp\""),
+		},
+		{
+			"# comment only\n\n",
+			nil,
+			nil,
+		},
+		{
+			"echo\n",
+			nil,
+			fmt.Errorf("invalid line \"echo\\n\""),
+		},
+		{
+			"echo 7\n",
+			nil,
+			fmt.Errorf("invalid port/proto in line \"echo 7\\n\""),
+		},
+		{
+			"echo\t\t7/tcp\n",
+			[]Service{
+				Service{
+					Name:    "echo",
+					Port:    7,
+					Proto:   "tcp",
+					Aliases: nil,
+				},
+			},
+			nil,
+		},
+		{
+			"# Network services\n" +
+				"discard\t9/udp\t\tsink null\n" +
+				"http\t\t80/tcp\t\twww\t\t# WorldWideWeb HTTP\n",
+			[]Service{
+				Service{
+					Name:  "discard",
+					Port:  9,
+					Proto: "udp",
+					Aliases: []string{
+						"sink",
+						"null",
+					},
+				},
+				Service{
+					Name:  "http",
+					Port:  80,
+					Proto: "tcp",
+					Aliases: []string{
+						"www",
+					},
+				},
+			},
+			nil,
+		},
+	}
+
+	for n, tc := range tests {
+		res, err := ParseServices(strings.NewReader(tc.data))
+		if !reflect.DeepEqual(err, tc.err) {
+			t.Errorf("%d: err = %v, want %v",
+				n, err, tc.err)
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %v, want %v",
+				n, res, tc.exp)
+		}
+	}
+}
@@ -0,0 +1,223 @@
+// Split passwd/group files into shards
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"crypto/sha512"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"regexp"
+	"sort"
+)
+
+// Version written in serializeShards()
+const ShardRootVersion = 1
+
+// Shard is one file of a sharded passwd/group file. It's stored next to the
+// root file with Suffix appended to the path.
+type Shard struct {
+	Suffix string
+	Body   []byte
+}
+
+// shardSuffix returns the suffix of shard i of the given kind ("name" or
+// "id") with the given content hash, see map_shard() in nss/shard.c.
+func shardSuffix(hash uint64, kind string, i int) string {
+	return fmt.Sprintf(".%016x.%s.%d", hash, kind, i)
+}
+
+// shardSuffixRegexp matches the suffixes returned by shardSuffix().
+var shardSuffixRegexp = regexp.MustCompile(`^\.[0-9a-f]{16}\.(name|id)\.[0-9]+$`)
+
+// shardHash is the 64-bit FNV-1a hash of name, see shard_hash() in
+// nss/shard.c.
+func shardHash(name string) uint64 {
+	h := uint64(14695981039346656037)
+	for i := 0; i < len(name); i++ {
+		h ^= uint64(name[i])
+		h *= 1099511628211
+	}
+	return h
+}
+
+// serializeShards splits count entries into n shards by hash of their name
+// and into up to n shards by ranges of their id. Each entry is stored in
+// one name and one id shard so lookups by name or id have to map only a
+// single shard. serialize writes a normal file containing the given entries
+// (as indices into the original list, in input order).
+//
+// The root file written to w contains the number of shards, the first id
+// of each id shard and the content hash of each shard. The hash is part of
+// the path of the shard: changed shards are stored under new paths and
+// replacing the root file switches atomically to them while unchanged
+// shards keep their files.
+func serializeShards(w io.Writer, n int, count int,
+	name func(i int) string, id func(i int) uint64,
+	serialize func(w io.Writer, entries []int) error) ([]Shard, error) {
+
+	if n < 1 {
+		return nil, fmt.Errorf("invalid shard count %d", n)
+	}
+
+	var shards []Shard
+	var hashes []uint64 // of shards
+	add := func(kind string, i int, entries []int) error {
+		var x bytes.Buffer
+		err := serialize(&x, entries)
+		if err != nil {
+			return err
+		}
+		sum := sha512.Sum512(x.Bytes())
+		hash := binary.LittleEndian.Uint64(sum[:])
+		shards = append(shards, Shard{
+			Suffix: shardSuffix(hash, kind, i),
+			Body:   x.Bytes(),
+		})
+		hashes = append(hashes, hash)
+		return nil
+	}
+
+	// Shards by hash of the name
+	byName := make([][]int, n)
+	for i := 0; i < count; i++ {
+		x := shardHash(name(i)) % uint64(n)
+		byName[x] = append(byName[x], i)
+	}
+	for i, x := range byName {
+		err := add("name", i, x)
+		if err != nil {
+			return nil, err
+		}
+	}
+
+	// Shards by id range with about the same number of entries; entries
+	// with the same id must be in the same shard
+	sorted := make([]int, count)
+	for i := range sorted {
+		sorted[i] = i
+	}
+	sort.SliceStable(sorted, func(i, j int) bool {
+		return id(sorted[i]) < id(sorted[j])
+	})
+	var idStart []uint64
+	start := 0
+	for start < count || len(idStart) == 0 {
+		end := start + (count+n-1)/n
+		if end > count {
+			end = count
+		}
+		for end < count && end > 0 && id(sorted[end]) == id(sorted[end-1]) {
+			end++
+		}
+		first := uint64(0) // the first shard contains all lower ids
+		if len(idStart) > 0 {
+			first = id(sorted[start])
+		}
+
+		entries := make([]int, end-start)
+		copy(entries, sorted[start:end])
+		sort.Ints(entries) // keep input order
+		err := add("id", len(idStart), entries)
+		if err != nil {
+			return nil, err
+		}
+		idStart = append(idStart, first)
+		start = end
+	}
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	var data bytes.Buffer
+	// name_shards
+	le.PutUint64(tmp, uint64(n))
+	data.Write(tmp)
+	// id_shards
+	le.PutUint64(tmp, uint64(len(idStart)))
+	data.Write(tmp)
+	// id_start
+	for _, x := range idStart {
+		le.PutUint64(tmp, x)
+		data.Write(tmp)
+	}
+	// Hashes of the name shards followed by those of the id shards (in the
+	// order of shards)
+	for _, x := range hashes {
+		le.PutUint64(tmp, x)
+		data.Write(tmp)
+	}
+
+	// Write result; the root has no indices, only data
+
+	// magic
+	w.Write([]byte("NSS-CASH"))
+	// version
+	le.PutUint64(tmp, ShardRootVersion|FeatureSharded)
+	w.Write(tmp)
+	// count
+	le.PutUint64(tmp, uint64(count))
+	w.Write(tmp)
+	// off_orig_index, off_id_index, off_name_index, off_data
+	le.PutUint64(tmp, 0)
+	for i := 0; i < 4; i++ {
+		w.Write(tmp)
+	}
+	_, err := data.WriteTo(w)
+	if err != nil {
+		return nil, err
+	}
+
+	return shards, nil
+}
+
+// SerializePasswdShards is like SerializePasswds() but splits the entries
+// into n shards, see serializeShards().
+func SerializePasswdShards(w io.Writer, pws []Passwd, n int, opts SerializeOptions) ([]Shard, error) {
+	return serializeShards(w, n, len(pws),
+		func(i int) string { return pws[i].Name },
+		func(i int) uint64 { return pws[i].Uid },
+		func(w io.Writer, entries []int) error {
+			x := make([]Passwd, 0, len(entries))
+			for _, i := range entries {
+				x = append(x, pws[i])
+			}
+			return SerializePasswds(w, x, opts)
+		})
+}
+
+// SerializeGroupShards is like SerializeGroups() but splits the entries into
+// n shards, see serializeShards().
+func SerializeGroupShards(w io.Writer, grs []Group, n int, opts SerializeOptions) ([]Shard, error) {
+	// The NSS module checks for conflicting groups only in one shard
+	if opts.ImplicitUPG {
+		return nil, fmt.Errorf("implicit user private groups are " +
+			"not supported in sharded files")
+	}
+	return serializeShards(w, n, len(grs),
+		func(i int) string { return grs[i].Name },
+		func(i int) uint64 { return grs[i].Gid },
+		func(w io.Writer, entries []int) error {
+			x := make([]Group, 0, len(entries))
+			for _, i := range entries {
+				x = append(x, grs[i])
+			}
+			return SerializeGroups(w, x, opts)
+		})
+}
@@ -0,0 +1,282 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"reflect"
+	"sort"
+	"strings"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func TestShardHash(t *testing.T) {
+	tests := []struct {
+		name string
+		exp  uint64
+	}{
+		// Reference values of 64-bit FNV-1a
+		{"", 0xcbf29ce484222325},
+		{"a", 0xaf63dc4c8601ec8c},
+		{"foobar", 0x85944171f73967e8},
+	}
+
+	for n, tc := range tests {
+		res := shardHash(tc.name)
+		if res != tc.exp {
+			t.Errorf("%d: got %x, want %x", n, res, tc.exp)
+		}
+	}
+}
+
+func TestShardsPasswd(t *testing.T) {
+	src := "nss/tests/passwd"
+	orig, err := ioutil.ReadFile(src)
+	if err != nil {
+		t.Fatal(err)
+	}
+	pws, err := ParsePasswds(bytes.NewReader(orig))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	for _, n := range []int{1, 3, 50} {
+		path := mustConvert(t, "passwd", src, SerializeOptions{
+			Shards: n,
+		})
+		defer os.RemoveAll(filepath.Dir(path))
+
+		// The root file is not a normal nsscash file
+		_, err := reader.Open(path)
+		mustBeErrorWithSubstring(t, err, "unsupported")
+
+		names, ids := mustShardSuffixes(t, path)
+		if len(names) != n {
+			t.Errorf("%d: got %d name shards", n, len(names))
+		}
+
+		// Each entry is found in its name shard
+		for _, x := range pws {
+			f, err := reader.Open(path +
+				names[shardHash(x.Name)%uint64(n)])
+			if err != nil {
+				t.Fatal(err)
+			}
+			p, ok := f.PasswdByName(x.Name)
+			if !ok || p.Uid != x.Uid {
+				t.Errorf("%d: name %q: got %v %v",
+					n, x.Name, p, ok)
+			}
+			f.Close()
+		}
+
+		// The id shards contain each entry exactly once, sorted by
+		// id range
+		var uids []uint64
+		for i, x := range ids {
+			f, err := reader.Open(path + x)
+			if err != nil {
+				t.Fatal(err)
+			}
+			for j := 0; j < f.Len(); j++ {
+				p, _ := f.Passwd(j)
+				if len(uids) > 0 && j == 0 &&
+					p.Uid <= uids[len(uids)-1] {
+					t.Errorf("%d: id shard %d overlaps",
+						n, i)
+				}
+				uids = append(uids, p.Uid)
+			}
+			f.Close()
+		}
+		var exp []uint64
+		for _, x := range pws {
+			exp = append(exp, x.Uid)
+		}
+		sort.Slice(uids, func(i, j int) bool {
+			return uids[i] < uids[j]
+		})
+		sort.Slice(exp, func(i, j int) bool {
+			return exp[i] < exp[j]
+		})
+		if !reflect.DeepEqual(uids, exp) {
+			t.Errorf("%d: got %v, want %v", n, uids, exp)
+		}
+
+		// Converting again keeps the shards
+		err = mainConvert("passwd", src, path, TableSchema{},
+			SerializeOptions{Shards: n})
+		if err != nil {
+			t.Fatal(err)
+		}
+		names2, ids2 := mustShardSuffixes(t, path)
+		if !reflect.DeepEqual(names2, names) ||
+			!reflect.DeepEqual(ids2, ids) {
+			t.Errorf("%d: shards changed: %v %v -> %v %v",
+				n, names, ids, names2, ids2)
+		}
+
+		// A changed entry changes only its name and id shard, the
+		// files of the other shards are kept
+		changed := filepath.Join(filepath.Dir(path), "passwd")
+		err = ioutil.WriteFile(changed, []byte(strings.Replace(
+			string(orig), "root:x:0:0:root:", "root:x:0:0:admin:",
+			1)), 0644)
+		if err != nil {
+			t.Fatal(err)
+		}
+		err = mainConvert("passwd", changed, path, TableSchema{},
+			SerializeOptions{Shards: n})
+		if err != nil {
+			t.Fatal(err)
+		}
+		err = os.Remove(changed)
+		if err != nil {
+			t.Fatal(err)
+		}
+		names2, ids2 = mustShardSuffixes(t, path)
+		var kept []string
+		for i := range names {
+			if names2[i] != names[i] {
+				continue
+			}
+			kept = append(kept, path+names[i])
+		}
+		for i := range ids {
+			if ids2[i] != ids[i] {
+				continue
+			}
+			kept = append(kept, path+ids[i])
+		}
+		if len(kept) != len(names)+len(ids)-2 {
+			t.Errorf("%d: kept %d of %d shards", n,
+				len(kept), len(names)+len(ids))
+		}
+		for _, x := range append(names2, ids2...) {
+			_, err := os.Stat(path + x)
+			if err != nil {
+				t.Error(err)
+			}
+		}
+
+		// Fewer shards remove the unused shard files; other files
+		// are kept
+		other := []string{
+			path + ".name.0",
+			path + ".0123456789abcdef.id.0.orig",
+			path + "x.0123456789abcdef.id.0",
+		}
+		for _, x := range other {
+			err = ioutil.WriteFile(x, nil, 0644)
+			if err != nil {
+				t.Fatal(err)
+			}
+		}
+		err = mainConvert("passwd", src, path, TableSchema{},
+			SerializeOptions{Shards: 1})
+		if err != nil {
+			t.Fatal(err)
+		}
+		names1, ids1 := mustShardSuffixes(t, path)
+		xs, err := filepath.Glob(path + "*")
+		if err != nil {
+			t.Fatal(err)
+		}
+		sort.Strings(xs)
+		want := append([]string{
+			path,
+			path + ids1[0],
+			path + names1[0],
+		}, other...)
+		sort.Strings(want)
+		if !reflect.DeepEqual(xs, want) {
+			t.Errorf("%d: got %v, want %v", n, xs, want)
+		}
+	}
+}
+
+// mustShardSuffixes returns the suffixes of the name and id shards
+// referenced by the root of the sharded file at path.
+func mustShardSuffixes(t *testing.T, path string) ([]string, []string) {
+	x, err := ioutil.ReadFile(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	le := binary.LittleEndian
+	// The root has no indices, only data
+	data := x[headerSize:]
+	nameShards := int(le.Uint64(data))
+	idShards := int(le.Uint64(data[8:]))
+	if len(data) != 16+8*(2*idShards+nameShards) {
+		t.Fatalf("%q: invalid root file", path)
+	}
+	hashes := data[16+8*idShards:]
+
+	var names, ids []string
+	for i := 0; i < nameShards; i++ {
+		names = append(names,
+			shardSuffix(le.Uint64(hashes[8*i:]), "name", i))
+	}
+	for i := 0; i < idShards; i++ {
+		ids = append(ids, shardSuffix(
+			le.Uint64(hashes[8*(nameShards+i):]), "id", i))
+	}
+	return names, ids
+}
+
+func TestShardsGroupSameId(t *testing.T) {
+	// Entries with the same id must be in the same id shard
+	grs := []Group{
+		{Name: "a", Gid: 1},
+		{Name: "b", Gid: 2},
+		{Name: "c", Gid: 2},
+		{Name: "d", Gid: 2},
+		{Name: "e", Gid: 3},
+	}
+
+	var root bytes.Buffer
+	shards, err := SerializeGroupShards(&root, grs, 4, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	var res [][]uint64
+	for _, s := range shards {
+		if !strings.Contains(s.Suffix, ".id.") {
+			continue
+		}
+		f, err := reader.New(s.Body)
+		if err != nil {
+			t.Fatal(err)
+		}
+		var gids []uint64
+		for i := 0; i < f.Len(); i++ {
+			g, _ := f.Group(i)
+			gids = append(gids, g.Gid)
+		}
+		res = append(res, gids)
+	}
+	exp := [][]uint64{{1, 2, 2, 2}, {3}}
+	if !reflect.DeepEqual(res, exp) {
+		t.Errorf("got %v, want %v", res, exp)
+	}
+}
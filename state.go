@@ -31,6 +31,9 @@ type State struct {
 	// Key is File.Url
 	LastModified map[string]time.Time
 	Checksum     map[string]string // SHA512 in hex
+	// Number of responses by HTTP status code (200 or 304), used for
+	// metrics (see WriteMetrics())
+	Responses map[string]map[int]uint64
 }
 
 func LoadState(path string) (*State, error) {
@@ -56,10 +59,20 @@ func LoadState(path string) (*State, error) {
 	if state.Checksum == nil {
 		state.Checksum = make(map[string]string)
 	}
+	if state.Responses == nil {
+		state.Responses = make(map[string]map[int]uint64)
+	}
 
 	return &state, nil
 }
 
+func (s *State) countResponse(url string, status int) {
+	if s.Responses[url] == nil {
+		s.Responses[url] = make(map[int]uint64)
+	}
+	s.Responses[url][status]++
+}
+
 func WriteState(path string, state *State) error {
 	// Update the state file even if nothing has changed to provide a
 	// simple way to check if nsscash ran successfully (the state is only
@@ -0,0 +1,84 @@
+// Print lookup statistics recorded by the NSS module
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"fmt"
+	"io"
+	"sort"
+)
+
+// Names of the statistics in the order of their slots in the statistics file
+// (a counter file), see enum stat_slot in nss/stats.h
+var statNames = []string{
+	"passwd_lookups",
+	"passwd_found",
+	"passwd_notfound",
+	"passwd_erange",
+	"passwd_unavail",
+	"group_lookups",
+	"group_found",
+	"group_notfound",
+	"group_erange",
+	"group_unavail",
+	"maps",
+	"map_nsec",
+}
+
+// PrintStats writes the statistics stored in the counter files of path as
+// "name value" lines to w, summed over all uids. The statistics of each uid
+// follow as "uid <uid> name value" lines.
+func PrintStats(w io.Writer, path string) error {
+	files, err := loadCounterFiles(path)
+	if err != nil {
+		return err
+	}
+	if len(files) == 0 {
+		return fmt.Errorf("%q: statistics file does not exist", path)
+	}
+	var uids []int
+	for uid, c := range files {
+		if len(c.slots) < len(statNames) {
+			return fmt.Errorf("%q: too few slots for statistics",
+				counterPath(path, uid))
+		}
+		uids = append(uids, uid)
+	}
+	sort.Ints(uids)
+
+	for i, x := range statNames {
+		var sum uint64
+		for _, c := range files {
+			sum += c.slots[i]
+		}
+		_, err := fmt.Fprintf(w, "%s %d\n", x, sum)
+		if err != nil {
+			return err
+		}
+	}
+	for _, uid := range uids {
+		for i, x := range statNames {
+			_, err := fmt.Fprintf(w, "uid %d %s %d\n",
+				uid, x, files[uid].slots[i])
+			if err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
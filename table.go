@@ -0,0 +1,332 @@
+// Parse arbitrary colon-delimited tables and serialize them
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"strings"
+)
+
+// Version written in SerializeTable() (together with FeatureTable)
+const TableVersion = 1
+
+// Flags of an index in the table schema
+const (
+	TableIndexUnique = 1 << iota
+)
+
+// TableSchema describes the columns of a table and which columns are
+// indexed. The values of columns in Index must be unique, columns in
+// MultiIndex can contain the same value in multiple rows.
+type TableSchema struct {
+	Columns    []string
+	Index      []string
+	MultiIndex []string
+}
+
+// Validate checks that the schema is usable for SerializeTable().
+func (s TableSchema) Validate() error {
+	if len(s.Columns) == 0 {
+		return fmt.Errorf("no columns")
+	}
+	seen := make(map[string]bool)
+	for _, c := range s.Columns {
+		if c == "" {
+			return fmt.Errorf("empty column name")
+		}
+		if seen[c] {
+			return fmt.Errorf("duplicate column %q", c)
+		}
+		seen[c] = true
+	}
+	indexed := make(map[string]bool)
+	for _, c := range append(append([]string{}, s.Index...), s.MultiIndex...) {
+		if !seen[c] {
+			return fmt.Errorf("index on unknown column %q", c)
+		}
+		if indexed[c] {
+			return fmt.Errorf("duplicate index on column %q", c)
+		}
+		indexed[c] = true
+	}
+	return nil
+}
+
+func (s TableSchema) column(name string) int {
+	for i, c := range s.Columns {
+		if c == name {
+			return i
+		}
+	}
+	return -1
+}
+
+// ParseTable parses a file with lines of colon-separated columns and returns
+// all rows. The last column contains the remainder of the line (and can
+// therefore contain colons). Empty lines and lines starting with "#" are
+// ignored.
+func ParseTable(r io.Reader, columns int) ([][]string, error) {
+	var res [][]string
+
+	s := bufio.NewReader(r)
+	for {
+		t, err := s.ReadString('\n')
+		if err != nil {
+			if err == io.EOF {
+				if t != "" {
+					return nil, fmt.Errorf(
+						"no newline in last line: %q",
+						t)
+				}
+				break
+			}
+			return nil, err
+		}
+
+		// ReadString() contains the delimiter
+		line := strings.TrimSuffix(t, "\n")
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+
+		x := strings.SplitN(line, ":", columns)
+		if len(x) != columns {
+			return nil, fmt.Errorf("invalid line %q", t)
+		}
+		res = append(res, x)
+	}
+
+	return res, nil
+}
+
+func SerializeTableRow(row []string) ([]byte, error) {
+	le := binary.LittleEndian
+
+	// Offsets are relative to the beginning of the row
+	start := 4 + 4*len(row)
+
+	// Concatenate all (NUL-terminated) strings and store the offsets
+	var data bytes.Buffer
+	offs := make([]uint64, len(row))
+	for i, x := range row {
+		offs[i] = uint64(start + data.Len())
+		data.Write([]byte(x))
+		data.WriteByte(0)
+	}
+	// Ensure the offsets can fit the length of this entry
+	if uint64(start+data.Len()) > math.MaxUint32 {
+		return nil, fmt.Errorf("row too large to serialize: %v, %v",
+			data.Len(), row)
+	}
+
+	var res bytes.Buffer // serialized result
+
+	off := make([]byte, 4)
+	// data_size
+	le.PutUint32(off, uint32(data.Len()))
+	res.Write(off)
+	// off[]
+	for _, o := range offs {
+		le.PutUint32(off, uint32(o))
+		res.Write(off)
+	}
+
+	res.Write(data.Bytes())
+	// Pad each entry to 8 bytes like the other types
+	alignBufferTo(&res, 8)
+
+	return res.Bytes(), nil
+}
+
+func SerializeTable(w io.Writer, schema TableSchema, rows [][]string) error {
+	err := schema.Validate()
+	if err != nil {
+		return err
+	}
+
+	le := binary.LittleEndian
+	tmp := make([]byte, 8)
+
+	// Column names are stored at the beginning of the data section
+	var data bytes.Buffer
+	offColumns := make([]uint64, len(schema.Columns))
+	for i, c := range schema.Columns {
+		offColumns[i] = uint64(data.Len())
+		data.Write([]byte(c))
+		data.WriteByte(0)
+	}
+	alignBufferTo(&data, 8)
+
+	// Serialize rows and store offsets; rows can contain duplicates so use
+	// the position instead of a map
+	offsets := make([]uint64, len(rows))
+	for i, r := range rows {
+		if len(r) != len(schema.Columns) {
+			return fmt.Errorf("row has invalid column count: %v", r)
+		}
+		offsets[i] = uint64(data.Len())
+		x, err := SerializeTableRow(r)
+		if err != nil {
+			return err
+		}
+		data.Write(x)
+	}
+
+	// Create index "sorted" in input order, used when iterating over all
+	// rows; keeping the original order makes debugging easier
+	var indexOrig bytes.Buffer
+	for i := range rows {
+		le.PutUint64(tmp, offsets[i])
+		indexOrig.Write(tmp)
+	}
+
+	// Create an index for each indexed column; the indices reference key
+	// records with the value of the column (see serializeNameKeys())
+	type index struct {
+		column int
+		flags  uint64
+		data   bytes.Buffer
+	}
+	var indices []*index
+	for _, x := range []struct {
+		columns []string
+		flags   uint64
+	}{
+		{schema.Index, TableIndexUnique},
+		{schema.MultiIndex, 0},
+	} {
+		for _, c := range x.columns {
+			col := schema.column(c)
+
+			var keys []nameKey
+			seen := make(map[string]bool)
+			for i, r := range rows {
+				if x.flags&TableIndexUnique != 0 {
+					if seen[r[col]] {
+						return fmt.Errorf("duplicate "+
+							"value %q in unique "+
+							"column %q", r[col], c)
+					}
+					seen[r[col]] = true
+				}
+				keys = append(keys, nameKey{
+					name:  r[col],
+					entry: offsets[i],
+				})
+			}
+
+			indices = append(indices, &index{
+				column: col,
+				flags:  x.flags,
+				data:   serializeNameKeys(&data, keys),
+			})
+		}
+	}
+
+	// Schema describing the table, stored at off_name_index (there's no id
+	// index); offsets of the indices are relative to the header's data
+	// like the offsets in the header
+	schemaSize := 8 + 8 + 8*len(schema.Columns) + 3*8*len(indices)
+	var indexSchema bytes.Buffer
+	// column_count
+	le.PutUint64(tmp, uint64(len(schema.Columns)))
+	indexSchema.Write(tmp)
+	// index_count
+	le.PutUint64(tmp, uint64(len(indices)))
+	indexSchema.Write(tmp)
+	// off_column_names[]
+	for _, o := range offColumns {
+		le.PutUint64(tmp, o)
+		indexSchema.Write(tmp)
+	}
+	// indices[]
+	offset := uint64(indexOrig.Len() + schemaSize)
+	for _, x := range indices {
+		// column
+		le.PutUint64(tmp, uint64(x.column))
+		indexSchema.Write(tmp)
+		// flags
+		le.PutUint64(tmp, x.flags)
+		indexSchema.Write(tmp)
+		// off_index
+		le.PutUint64(tmp, offset)
+		indexSchema.Write(tmp)
+		offset += uint64(x.data.Len())
+	}
+
+	// Sanity check
+	if len(rows)*8 != indexOrig.Len() ||
+		schemaSize != indexSchema.Len() {
+		return fmt.Errorf("indexes have inconsistent length")
+	}
+
+	// Write result
+
+	// magic
+	w.Write([]byte("NSS-CASH"))
+	// version
+	le.PutUint64(tmp, TableVersion|FeatureTable)
+	w.Write(tmp)
+	// count
+	le.PutUint64(tmp, uint64(len(rows)))
+	w.Write(tmp)
+	// off_orig_index
+	offset = uint64(0)
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_id_index (unused, empty)
+	offset += uint64(indexOrig.Len())
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_name_index (schema)
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+	// off_data
+	offset += uint64(indexSchema.Len())
+	for _, x := range indices {
+		offset += uint64(x.data.Len())
+	}
+	le.PutUint64(tmp, offset)
+	w.Write(tmp)
+
+	_, err = indexOrig.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	_, err = indexSchema.WriteTo(w)
+	if err != nil {
+		return err
+	}
+	for _, x := range indices {
+		_, err = x.data.WriteTo(w)
+		if err != nil {
+			return err
+		}
+	}
+	_, err = data.WriteTo(w)
+	if err != nil {
+		return err
+	}
+
+	return nil
+}
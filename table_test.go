@@ -0,0 +1,217 @@
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"math"
+	"reflect"
+	"strings"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func TestParseTable(t *testing.T) {
+	tests := []struct {
+		data    string
+		columns int
+		exp     [][]string
+		err     error
+	}{
+		{
+			"",
+			3,
+			nil,
+			nil,
+		},
+		{
+			"a:b:c",
+			3,
+			nil,
+			fmt.Errorf("no newline in last line: \"a:b:c\""),
+		},
+		{
+			"a:b\n",
+			3,
+			nil,
+			fmt.Errorf("invalid line \"a:b\\n\""),
+		},
+		{
+			"# comment\n" +
+				"\n" +
+				"home:-rw:nfs:/export/home\n" +
+				"data::\n",
+			3,
+			[][]string{
+				{"home", "-rw", "nfs:/export/home"},
+				{"data", "", ""},
+			},
+			nil,
+		},
+	}
+
+	for n, tc := range tests {
+		res, err := ParseTable(strings.NewReader(tc.data), tc.columns)
+		if !reflect.DeepEqual(err, tc.err) {
+			t.Errorf("%d: err = %v, want %v",
+				n, err, tc.err)
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %v, want %v",
+				n, res, tc.exp)
+		}
+	}
+}
+
+func TestSerializeTable(t *testing.T) {
+	schema := TableSchema{
+		Columns:    []string{"key", "server", "path"},
+		Index:      []string{"key"},
+		MultiIndex: []string{"server"},
+	}
+	rows := [][]string{
+		{"home", "nfs1", "/export/home"},
+		{"data", "nfs2", "/export/data"},
+		{"scratch", "nfs1", "/export/scratch"},
+		{"", "nfs3", "/"},
+	}
+
+	var x bytes.Buffer
+	err := SerializeTable(&x, schema, rows)
+	if err != nil {
+		t.Fatal(err)
+	}
+	tf, err := reader.NewTable(x.Bytes())
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !reflect.DeepEqual(tf.Columns, schema.Columns) {
+		t.Errorf("columns = %v, want %v", tf.Columns, schema.Columns)
+	}
+
+	tests := []struct {
+		column string
+		value  string
+		exp    [][]string
+		err    error
+	}{
+		{"key", "home", [][]string{rows[0]}, nil},
+		{"key", "data", [][]string{rows[1]}, nil},
+		{"key", "", [][]string{rows[3]}, nil},
+		{"key", "nope", nil, nil},
+		{"server", "nfs1", [][]string{rows[0], rows[2]}, nil},
+		{"server", "nfs2", [][]string{rows[1]}, nil},
+		{"server", "nfs0", nil, nil},
+		{"path", "/", nil,
+			fmt.Errorf("column \"path\" is not indexed")},
+		{"nope", "", nil,
+			fmt.Errorf("unknown column \"nope\"")},
+	}
+	for n, tc := range tests {
+		res, err := tf.Lookup(tc.column, tc.value)
+		if !reflect.DeepEqual(err, tc.err) {
+			t.Errorf("%d: err = %v, want %v",
+				n, err, tc.err)
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %v, want %v",
+				n, res, tc.exp)
+		}
+	}
+
+	for i, r := range rows {
+		res, err := tf.Row(i)
+		if err != nil || !reflect.DeepEqual(res, r) {
+			t.Errorf("row %d: got %v %v, want %v", i, res, err, r)
+		}
+	}
+
+	// Unique columns must not contain duplicates
+	err = SerializeTable(&x, schema, append(rows, rows[0]))
+	mustBeErrorWithSubstring(t, err,
+		"duplicate value \"home\" in unique column \"key\"")
+	// Invalid schemas
+	err = SerializeTable(&x, TableSchema{}, rows)
+	mustBeErrorWithSubstring(t, err, "no columns")
+	err = SerializeTable(&x, TableSchema{
+		Columns: []string{"a"},
+		Index:   []string{"b"},
+	}, nil)
+	mustBeErrorWithSubstring(t, err, "index on unknown column \"b\"")
+}
+
+func TestNewTableInvalid(t *testing.T) {
+	var x bytes.Buffer
+	err := SerializeTable(&x, TableSchema{
+		Columns:    []string{"key", "server", "path"},
+		Index:      []string{"key"},
+		MultiIndex: []string{"server"},
+	}, [][]string{
+		{"home", "nfs1", "/export/home"},
+		{"data", "nfs2", "/export/data"},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	valid := x.Bytes()
+
+	// Passwd (and group) files are no table files
+	var pw bytes.Buffer
+	err = SerializePasswds(&pw, []Passwd{{
+		Name:  "root",
+		Gecos: "root",
+		Dir:   "/root",
+		Shell: "/bin/sh",
+	}}, SerializeOptions{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	_, err = reader.NewTable(pw.Bytes())
+	mustBeErrorWithSubstring(t, err, "not a table file")
+
+	// Corrupt files are rejected or return errors but never panic
+	le := binary.LittleEndian
+	use := func(y []byte) {
+		tf, err := reader.NewTable(y)
+		if err != nil {
+			return
+		}
+		for i := 0; i < tf.Len(); i++ {
+			tf.Row(i)
+		}
+		for _, c := range tf.Columns {
+			tf.Lookup(c, "home")
+		}
+	}
+	for i := range valid {
+		use(valid[:i])
+		for _, b := range []byte{0x00, 0x01, 0x80, 0xff} {
+			y := append([]byte(nil), valid...)
+			y[i] = b
+			use(y)
+		}
+		if i%8 == 0 && i+8 <= len(valid) {
+			y := append([]byte(nil), valid...)
+			le.PutUint64(y[i:], math.MaxUint64)
+			use(y)
+			le.PutUint64(y[i:], math.MaxUint64/8+1)
+			use(y)
+		}
+	}
+}
@@ -0,0 +1,128 @@
+// Implicit user private groups for group files
+
+// Copyright (C) 2019-2021  Simon Ruderich
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"reflect"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+// removeImplicitUPGs returns grs without the user private groups of pws
+// (FeatureImplicitUPG). The NSS module synthesizes a group for each user
+// whose uid equals its primary gid if no group with the user's name or gid
+// exists; therefore only groups which are identical to the synthesized ones
+// are removed: same name and gid as the user, password "x", no members and
+// neither name nor gid used by another group. If the NSS module would not
+// synthesize exactly the removed groups (e.g. for users without user private
+// group or duplicate names or uids in pws) false is returned and grs must be
+// stored completely.
+func removeImplicitUPGs(grs []Group, pws []Passwd) ([]Group, bool) {
+	names := make(map[string]int)
+	gids := make(map[uint64]int)
+	for _, g := range grs {
+		names[g.Name]++
+		gids[g.Gid]++
+	}
+	upgs := make(map[string]uint64)
+	for _, p := range pws {
+		if p.Uid == p.Gid {
+			upgs[p.Name] = p.Gid
+		}
+	}
+
+	res := make([]Group, 0, len(grs))
+	removed := make(map[GroupKey]int)
+	for _, g := range grs {
+		gid, ok := upgs[g.Name]
+		if ok && gid == g.Gid && g.Passwd == "x" &&
+			len(g.Members) == 0 &&
+			names[g.Name] == 1 && gids[g.Gid] == 1 {
+			removed[GroupKey{Name: g.Name, Gid: g.Gid}]++
+			continue
+		}
+		res = append(res, g)
+	}
+
+	// Verify the NSS module synthesizes exactly the removed groups, see
+	// is_upg() in nss/gr.c
+	remainingNames := make(map[string]bool)
+	remainingGids := make(map[uint64]bool)
+	for _, g := range res {
+		remainingNames[g.Name] = true
+		remainingGids[g.Gid] = true
+	}
+	userNames := make(map[string]int)
+	uids := make(map[uint64]int)
+	for _, p := range pws {
+		userNames[p.Name]++
+		uids[p.Uid]++
+	}
+	synthesized := make(map[GroupKey]int)
+	for _, p := range pws {
+		if p.Uid != p.Gid ||
+			remainingNames[p.Name] || remainingGids[p.Gid] {
+			continue
+		}
+		// Lookups by name or uid in passwd might return another user
+		if userNames[p.Name] != 1 || uids[p.Uid] != 1 {
+			return grs, false
+		}
+		synthesized[GroupKey{Name: p.Name, Gid: p.Gid}]++
+	}
+	if !reflect.DeepEqual(removed, synthesized) {
+		return grs, false
+	}
+	return res, true
+}
+
+// parsePasswdFile parses the file path in the format of /etc/passwd.
+func parsePasswdFile(path string) ([]Passwd, error) {
+	x, err := ioutil.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	return ParsePasswds(bytes.NewReader(x))
+}
+
+// readPasswds returns all entries of the (not sharded) nsscash passwd file
+// path.
+func readPasswds(path string) ([]Passwd, error) {
+	f, err := reader.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	res := make([]Passwd, 0, f.Len())
+	for i := 0; i < f.Len(); i++ {
+		p, _ := f.Passwd(i)
+		res = append(res, Passwd{
+			Name:   string(p.Name),
+			Passwd: string(p.Passwd),
+			Uid:    p.Uid,
+			Gid:    p.Gid,
+			Gecos:  string(p.Gecos),
+			Dir:    string(p.Dir),
+			Shell:  string(p.Shell),
+		})
+	}
+	return res, nil
+}
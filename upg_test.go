@@ -0,0 +1,211 @@
+// Tests for implicit user private groups
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+package main
+
+import (
+	"bytes"
+	"reflect"
+	"strings"
+	"testing"
+
+	"ruderich.org/simon/nsscash/reader"
+)
+
+func TestRemoveImplicitUPGs(t *testing.T) {
+	pws := []Passwd{
+		{Name: "root", Uid: 0, Gid: 0},
+		{Name: "daemon", Uid: 1, Gid: 1},
+		{Name: "bin", Uid: 2, Gid: 2},
+		{Name: "sys", Uid: 3, Gid: 3},
+		{Name: "sync", Uid: 4, Gid: 65534},
+		{Name: "games", Uid: 5, Gid: 5},
+		{Name: "man", Uid: 6, Gid: 6},
+		{Name: "lp", Uid: 7, Gid: 7},
+	}
+	// Users which would get groups not present in the group file
+	phantomPws := []Passwd{
+		{Name: "root", Uid: 0, Gid: 0},
+		{Name: "toor", Uid: 0, Gid: 0},
+		{Name: "foo", Uid: 1005, Gid: 1005},
+	}
+	phantomGrs := []Group{
+		{Name: "root", Passwd: "x", Gid: 0},
+		{Name: "users", Passwd: "x", Gid: 100,
+			Members: []string{"foo"}},
+	}
+
+	tests := []struct {
+		pws []Passwd
+		grs []Group
+		exp []string
+		ok  bool
+	}{
+		{
+			nil,
+			nil,
+			nil,
+			true,
+		},
+		{
+			pws,
+			[]Group{
+				// Removed
+				{Name: "root", Passwd: "x", Gid: 0},
+				// Members
+				{Name: "daemon", Passwd: "x", Gid: 1,
+					Members: []string{"root"}},
+				// Password
+				{Name: "bin", Passwd: "*", Gid: 2},
+				// Different gid
+				{Name: "sys", Passwd: "x", Gid: 30},
+				// Not a user private group
+				{Name: "sync", Passwd: "x", Gid: 4},
+				// Duplicate gid
+				{Name: "games", Passwd: "x", Gid: 5},
+				{Name: "games2", Passwd: "x", Gid: 5},
+				// Duplicate name
+				{Name: "man", Passwd: "x", Gid: 6},
+				{Name: "man", Passwd: "x", Gid: 60},
+				// Removed
+				{Name: "lp", Passwd: "x", Gid: 7},
+				// No user
+				{Name: "adm", Passwd: "x", Gid: 8},
+			},
+			[]string{
+				"daemon", "bin", "sys", "sync",
+				"games", "games2", "man", "man", "adm",
+			},
+			true,
+		},
+		// root without group
+		{
+			pws[:1],
+			nil,
+			nil,
+			false,
+		},
+		// Duplicate uid (toor) and user without group (foo)
+		{
+			phantomPws,
+			phantomGrs,
+			[]string{"root", "users"},
+			false,
+		},
+		// Only the duplicate uid
+		{
+			phantomPws[:2],
+			phantomGrs,
+			[]string{"root", "users"},
+			false,
+		},
+		// Only the user without group
+		{
+			[]Passwd{phantomPws[0], phantomPws[2]},
+			phantomGrs,
+			[]string{"root", "users"},
+			false,
+		},
+		// Duplicate name
+		{
+			[]Passwd{
+				{Name: "root", Uid: 0, Gid: 0},
+				{Name: "root", Uid: 1, Gid: 1},
+			},
+			[]Group{
+				{Name: "adm", Passwd: "x", Gid: 4},
+			},
+			[]string{"adm"},
+			false,
+		},
+	}
+
+	for n, tc := range tests {
+		grs, ok := removeImplicitUPGs(tc.grs, tc.pws)
+		var res []string
+		for _, g := range grs {
+			res = append(res, g.Name)
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %q, want %q", n, res, tc.exp)
+		}
+		if ok != tc.ok {
+			t.Errorf("%d: ok = %v, want %v", n, ok, tc.ok)
+		}
+	}
+}
+
+func TestSerializeGroupsImplicitUPG(t *testing.T) {
+	tests := []struct {
+		passwd  string
+		group   string
+		feature bool
+		exp     []string
+	}{
+		{
+			"root:x:0:0:root:/root:/bin/bash\n" +
+				"foo:x:1005:100::/home/foo:/bin/sh\n",
+			"root:x:0:\n" +
+				"users:x:100:foo\n",
+			true,
+			[]string{"users"},
+		},
+		{
+			"root:x:0:0:root:/root:/bin/bash\n" +
+				"toor:x:0:0:root:/root:/bin/bash\n" +
+				"foo:x:1005:1005::/home/foo:/bin/sh\n",
+			"root:x:0:\n" +
+				"users:x:100:foo\n",
+			false,
+			[]string{"root", "users"},
+		},
+	}
+
+	for n, tc := range tests {
+		pws, err := ParsePasswds(strings.NewReader(tc.passwd))
+		if err != nil {
+			t.Fatal(err)
+		}
+		grs, err := ParseGroups(strings.NewReader(tc.group))
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		var x bytes.Buffer
+		err = SerializeGroups(&x, grs, SerializeOptions{
+			ImplicitUPG: true,
+			UPGPasswds:  pws,
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+		f, err := reader.New(x.Bytes())
+		if err != nil {
+			t.Fatal(err)
+		}
+		if f.ImplicitUPG() != tc.feature {
+			t.Errorf("%d: ImplicitUPG() = %v, want %v",
+				n, f.ImplicitUPG(), tc.feature)
+		}
+		var res []string
+		for i := 0; i < f.Len(); i++ {
+			g, _ := f.Group(i)
+			res = append(res, string(g.Name))
+		}
+		if !reflect.DeepEqual(res, tc.exp) {
+			t.Errorf("%d: res = %q, want %q", n, res, tc.exp)
+		}
+	}
+}